@@ -0,0 +1,235 @@
+/*
+ * Frame memory for OpenCV with OpenGL
+ * See arena.h for an overview.
+ */
+
+#include "arena.h"
+#include <algorithm>
+#include <cstdlib>
+#include <new>
+using namespace cv;
+using namespace std;
+
+FrameArena::FrameArena(size_t size) : blockSize(max(size, (size_t) 64)), offset(0), usedBefore(0) {
+    block = static_cast<char *>(malloc(blockSize));
+    if (!block) throw bad_alloc();
+}
+
+FrameArena::~FrameArena() {
+    for (size_t i = 0; i < full.size(); i++) free(full[i].first);
+    free(block);
+}
+
+/**
+ * @return the first offset from base, at or after offset, that is aligned
+ */
+static inline size_t alignedOffset(const char *base, size_t offset, size_t alignment) {
+    size_t address = (size_t) base + offset;
+    return offset + ((alignment - address % alignment) % alignment);
+}
+
+void *FrameArena::allocate(size_t bytes, size_t alignment) {
+    size_t start = alignedOffset(block, offset, alignment);
+    if (start + bytes > blockSize) {
+        // Retire the block for the rest of the frame, and start a bigger one
+        full.push_back(make_pair(block, blockSize));
+        usedBefore += offset;
+        blockSize = max(2 * blockSize, bytes + alignment);
+        block = static_cast<char *>(malloc(blockSize));
+        if (!block) throw bad_alloc();
+        start = alignedOffset(block, 0, alignment);
+    }
+    offset = start + bytes;
+    return block + start;
+}
+
+void FrameArena::reset() {
+    if (!full.empty()) {
+        size_t total = capacity();
+        for (size_t i = 0; i < full.size(); i++) free(full[i].first);
+        full.clear();
+        free(block);
+        blockSize = total;
+        block = static_cast<char *>(malloc(blockSize));
+        if (!block) throw bad_alloc();
+    }
+    offset = 0;
+    usedBefore = 0;
+}
+
+size_t FrameArena::capacity() const {
+    size_t total = blockSize;
+    for (size_t i = 0; i < full.size(); i++) total += full[i].second;
+    return total;
+}
+
+/**
+ * The size a buffer is allocated at: small buffers as they are, larger
+ * ones rounded up to whole pages, so that buffers of nearly the same size
+ * (such as regions of interest that shift by a pixel) are interchangeable.
+ */
+static size_t bufferSize(size_t bytes) {
+    const size_t page = 4096;
+    return bytes < page ? bytes : (bytes + page - 1) / page * page;
+}
+
+// Each thread's cache of small buffers: at most this many, of at most this size
+static const size_t kCachedBuffers = 4;
+static const size_t kCachedSize = 1 << 20;
+
+/**
+ * The buffers a thread freed last, for it to take again without a lock.
+ * When the thread ends, they go to the shared pool.
+ */
+struct PooledMatCache {
+    const PooledMatAllocator *owner;
+    size_t count;
+    size_t sizes[kCachedBuffers];
+    void *buffers[kCachedBuffers];      // oldest first
+
+    PooledMatCache() : owner(0), count(0) {}
+    ~PooledMatCache() {
+        for (size_t i = 0; i < count; i++) owner->keep(sizes[i], buffers[i]);
+    }
+};
+
+static thread_local PooledMatCache threadCache;
+
+PooledMatAllocator::PooledMatAllocator(size_t maxIdle, size_t maxSize)
+    : idleBytes(0), maxIdleBytes(maxIdle), maxPerSize(max(maxSize, (size_t) 1)) {
+}
+
+PooledMatAllocator::~PooledMatAllocator() {
+    for (IdleList::iterator it = idleList.begin(); it != idleList.end(); ++it) fastFree(it->data);
+}
+
+UMatData *PooledMatAllocator::allocate(int dims, const int *sizes, int type, void *data0, size_t *step,
+                                       int /*flags*/, UMatUsageFlags /*usageFlags*/) const {
+    // The layout, as cv::Mat's standard allocator computes it
+    size_t total = CV_ELEM_SIZE(type);
+    for (int i = dims - 1; i >= 0; i--) {
+        if (step) {
+            if (data0 && step[i] != CV_AUTOSTEP) {
+                CV_Assert(total <= step[i]);
+                total = step[i];
+            } else {
+                step[i] = total;
+            }
+        }
+        total *= sizes[i];
+    }
+
+    // This thread's cache first, the newest buffer of the size; then the
+    // shared pool
+    uchar *data = static_cast<uchar *>(data0);
+    size_t size = bufferSize(total);
+    if (!data && size >= 4096) {
+        PooledMatCache &cache = threadCache;
+        if (cache.owner == this) {
+            for (size_t i = cache.count; i-- > 0;) {
+                if (cache.sizes[i] != size) continue;
+                data = static_cast<uchar *>(cache.buffers[i]);
+                for (size_t j = i + 1; j < cache.count; j++) {
+                    cache.sizes[j - 1] = cache.sizes[j];
+                    cache.buffers[j - 1] = cache.buffers[j];
+                }
+                cache.count--;
+                break;
+            }
+        }
+        if (!data) data = static_cast<uchar *>(take(size));
+    }
+    if (!data) data = static_cast<uchar *>(fastMalloc(size));
+
+    UMatData *u = new UMatData(this);
+    u->data = u->origdata = data;
+    u->size = total;
+    if (data0) u->flags |= UMatData::USER_ALLOCATED;
+    return u;
+}
+
+bool PooledMatAllocator::allocate(UMatData *u, int /*accessFlags*/, UMatUsageFlags /*usageFlags*/) const {
+    return u != 0;
+}
+
+void PooledMatAllocator::deallocate(UMatData *u) const {
+    if (!u) return;
+    CV_Assert(u->urefcount == 0 && u->refcount == 0);
+    if (!(u->flags & UMatData::USER_ALLOCATED) && u->origdata) {
+        size_t size = bufferSize(u->size);
+        if (size < 4096) {
+            fastFree(u->origdata);
+        } else if (size <= kCachedSize && (threadCache.owner == 0 || threadCache.owner == this)) {
+            // Small buffers stay with the thread; the oldest moves to the
+            // shared pool to make room
+            PooledMatCache &cache = threadCache;
+            cache.owner = this;
+            if (cache.count == kCachedBuffers) {
+                keep(cache.sizes[0], cache.buffers[0]);
+                for (size_t j = 1; j < cache.count; j++) {
+                    cache.sizes[j - 1] = cache.sizes[j];
+                    cache.buffers[j - 1] = cache.buffers[j];
+                }
+                cache.count--;
+            }
+            cache.sizes[cache.count] = size;
+            cache.buffers[cache.count] = u->origdata;
+            cache.count++;
+        } else {
+            keep(size, u->origdata);
+        }
+        u->origdata = 0;
+    }
+    delete u;
+}
+
+void *PooledMatAllocator::take(size_t size) const {
+    lock_guard<mutex> guard(lock);
+    map<size_t, deque<IdleList::iterator> >::iterator it = bySize.find(size);
+    if (it == bySize.end() || it->second.empty()) return 0;
+    IdleList::iterator newest = it->second.back();
+    void *data = newest->data;
+    it->second.pop_back();
+    if (it->second.empty()) bySize.erase(it);
+    idleList.erase(newest);
+    idleBytes -= size;
+    return data;
+}
+
+void PooledMatAllocator::keep(size_t size, void *data) const {
+    if (size > maxIdleBytes) {
+        fastFree(data);
+        return;
+    }
+    lock_guard<mutex> guard(lock);
+
+    // Make room: first within the size, then across sizes, dropping the
+    // buffers least recently freed, which belong to sizes no longer in use
+    if (bySize[size].size() >= maxPerSize) evictOldest(size);
+    while (idleBytes + size > maxIdleBytes) evictOldest(idleList.front().size);
+
+    IdleBuffer buffer = { size, data };
+    idleList.push_back(buffer);
+    bySize[size].push_back(--idleList.end());
+    idleBytes += size;
+}
+
+void PooledMatAllocator::evictOldest(size_t size) const {
+    map<size_t, deque<IdleList::iterator> >::iterator it = bySize.find(size);
+    IdleList::iterator oldest = it->second.front();
+    fastFree(oldest->data);
+    idleBytes -= size;
+    idleList.erase(oldest);
+    it->second.pop_front();
+    if (it->second.empty()) bySize.erase(it);
+}
+
+size_t PooledMatAllocator::idle() const {
+    lock_guard<mutex> guard(lock);
+    return idleBytes;
+}
+
+PooledMatAllocator *PooledMatAllocator::instance() {
+    static PooledMatAllocator *pool = new PooledMatAllocator();
+    return pool;
+}
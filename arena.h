@@ -0,0 +1,168 @@
+/*
+ * Frame memory for OpenCV with OpenGL
+ *
+ * Two ways to keep the heap out of the frame loop, where a long session
+ * would otherwise allocate and free the same buffers thousands of times a
+ * minute, fragmenting the heap and now and then stalling a frame:
+ * - FrameArena hands out memory for data that lives for one frame, by
+ *   moving a pointer along a block; reset() takes it all back at once at
+ *   the start of the next frame.  Standard containers use it through
+ *   ArenaAllocator (see FrameVector).  Lists handed to OpenCV, such as the
+ *   marker corners and poses, cannot use it, since OpenCV's array wrappers
+ *   only take vectors with the standard allocator; they are kept between
+ *   frames instead, and refilled in place.
+ * - PooledMatAllocator keeps the buffers of freed cv::Mats, by size, and
+ *   hands them out again to the next Mat of that size.  Installed as the
+ *   default allocator, it also serves the temporary images OpenCV's own
+ *   functions (such as marker detection) create every frame.  Each thread
+ *   keeps a few small buffers of its own, without a lock; the rest are
+ *   shared, and when sizes change (a detection region that moves and
+ *   grows), the buffers least recently freed make way for the new ones.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <opencv2/core/core.hpp>
+#include <cstddef>
+#include <deque>
+#include <list>
+#include <map>
+#include <mutex>
+#include <vector>
+
+class FrameArena {
+public:
+    /**
+     * @param blockSize the size of the first block, in bytes
+     */
+    FrameArena(size_t blockSize = 64 * 1024);
+    ~FrameArena();
+
+    /**
+     * Allocate memory, valid until the next reset().  When the block is
+     * full, another, larger one is added for the rest of the frame.
+     * @param bytes the size
+     * @param alignment a power of two
+     * @return the memory, never null
+     */
+    void *allocate(size_t bytes, size_t alignment = sizeof(double));
+
+    /**
+     * Take back everything allocated.  If the frame needed more than one
+     * block, they are replaced with a single one big enough for all of it,
+     * so that a steady frame loop settles on one block.
+     */
+    void reset();
+
+    /**
+     * @return the bytes allocated since the last reset()
+     */
+    size_t used() const { return usedBefore + offset; }
+
+    /**
+     * @return the bytes of the blocks
+     */
+    size_t capacity() const;
+
+private:
+    FrameArena(const FrameArena &);
+    FrameArena &operator=(const FrameArena &);
+
+    char *block;                    // the block being allocated from
+    size_t blockSize, offset;
+    std::vector<std::pair<char *, size_t> > full;   // the blocks filled this frame
+    size_t usedBefore;              // the bytes allocated from the full blocks
+};
+
+/**
+ * An allocator for standard containers, taking memory from a FrameArena.
+ * Freeing does nothing: the memory comes back when the arena is reset.
+ */
+template <class T>
+class ArenaAllocator {
+public:
+    typedef T value_type;
+
+    ArenaAllocator(FrameArena &arena) : arena(&arena) {}
+    template <class U> ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {}
+
+    T *allocate(size_t n) { return static_cast<T *>(arena->allocate(n * sizeof(T), alignof(T))); }
+    void deallocate(T *, size_t) {}
+
+    template <class U> bool operator==(const ArenaAllocator<U> &other) const { return arena == other.arena; }
+    template <class U> bool operator!=(const ArenaAllocator<U> &other) const { return arena != other.arena; }
+
+private:
+    template <class U> friend class ArenaAllocator;
+    FrameArena *arena;
+};
+
+/**
+ * A vector whose elements live in a FrameArena, for lists built and used
+ * within one frame: FrameVector<Item> items(arena).
+ */
+template <class T>
+using FrameVector = std::vector<T, ArenaAllocator<T> >;
+
+class PooledMatAllocator : public cv::MatAllocator {
+public:
+    /**
+     * @param maxIdleBytes the most memory to keep in shared buffers not in
+     *        use; beyond that, the least recently freed go back to the heap
+     * @param maxPerSize the most buffers of one size to keep
+     * Threads cache buffers they free, and return them when they end, so
+     * the allocator must outlive them (as instance() does).
+     */
+    PooledMatAllocator(size_t maxIdleBytes = 256 << 20, size_t maxPerSize = 8);
+    ~PooledMatAllocator();
+
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step,
+                           int flags, cv::UMatUsageFlags usageFlags) const;
+    bool allocate(cv::UMatData *u, int accessFlags, cv::UMatUsageFlags usageFlags) const;
+    void deallocate(cv::UMatData *u) const;
+
+    /**
+     * @return the bytes in shared buffers not in use
+     */
+    size_t idle() const;
+
+    /**
+     * @return the pool every thread shares, created on first use and never
+     *         destroyed, so that Mats freed during exit (and the caches of
+     *         threads that end) can still return their buffers to it
+     */
+    static PooledMatAllocator *instance();
+
+private:
+    struct IdleBuffer {
+        size_t size;                // rounded
+        void *data;
+    };
+    typedef std::list<IdleBuffer> IdleList;
+
+    friend struct PooledMatCache;
+
+    /**
+     * @return a shared buffer of the rounded size, or 0 if there is none
+     */
+    void *take(size_t size) const;
+
+    /**
+     * Keep a buffer in the shared pool, making room for it if need be.
+     */
+    void keep(size_t size, void *data) const;
+
+    /**
+     * Free the least recently freed buffer of a size.  Requires the lock.
+     */
+    void evictOldest(size_t size) const;
+
+    mutable std::mutex lock;
+    mutable IdleList idleList;      // least recently freed first
+    mutable std::map<size_t, std::deque<IdleList::iterator> > bySize;   // each size's, least recent first
+    mutable size_t idleBytes;
+    size_t maxIdleBytes, maxPerSize;
+};
+
+#endif // ARENA_H
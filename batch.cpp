@@ -0,0 +1,584 @@
+/*
+ * Batch rendering for OpenCV with OpenGL
+ * See batch.h for an overview.
+ */
+
+#include "batch.h"
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+#include <GL/gl.h>
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include "camera.h"
+#include "culling.h"
+#include "geometry.h"
+#include "meshbuffer.h"
+#include "meshcache.h"
+#include "meshopt.h"
+#include "scene.h"
+#include "simplify.h"
+#include "softraster.h"
+#include "sprite.h"
+#include "tracking.h"
+#ifdef HAVE_EGL
+#include "headless.h"
+#include "regression.h"
+#endif
+using namespace cv;
+using namespace std;
+
+/**
+ * A mesh, loaded once and shared by the workers, which only read it.
+ */
+struct BatchModel {
+    bool packed;
+    Mesh mesh;                          // also unpacked from the file, for the software renderer
+    LodChain lods;
+    PackedMeshFile file;
+    float center[3], radius;            // a sphere around the mesh, for the software renderer
+};
+
+/**
+ * What every worker shares: the settings, the inputs and the models.
+ */
+struct BatchJob {
+    vector<String> files;
+    String outputDir;
+    Size maxSize;                       // the size of each worker's surface
+    CameraModel camera;
+    bool calibrated;                    // false to guess the camera from each image's size
+    SceneRegistry scene;                // the objects, before any marker is seen
+    double lodTolerance;
+    bool software;                      // render on the CPU, without OpenGL
+    bool fixedPose;                     // the objects are where they were in one image, in every image
+    SpriteCache sprites;                // the overlays rendered at the fixed pose, by image size
+    map<String, Ptr<BatchModel> > models;
+    Mesh gem;                           // the gem, for the software renderer
+
+    atomic<size_t> next;                // the queue: the index of the next file to take
+    atomic<int> rendered, failed;
+    mutex output;                       // serializes messages
+};
+
+/**
+ * @return true if the file name has a common image extension
+ */
+static bool isImageFile(const String &name) {
+    size_t dot = name.find_last_of('.');
+    if (dot == String::npos) return false;
+    String ext = name.substr(dot + 1);
+    for (size_t i = 0; i < ext.size(); i++) ext[i] = (char) tolower((unsigned char) ext[i]);
+    return ext == "jpg" || ext == "jpeg" || ext == "png" || ext == "bmp" || ext == "tif" || ext == "tiff";
+}
+
+/**
+ * Load a model for the workers to share, unless it is the gem or already loaded.
+ */
+static void loadModel(BatchJob &job, const String &model) {
+    if (model == "gem" || job.models.count(model)) return;
+    Ptr<BatchModel> m = makePtr<BatchModel>();
+    string error;
+    m->packed = model.size() > 6 && model.substr(model.size() - 6) == ".pmesh";
+    bool ok = m->packed ? m->file.open(model, error) : loadMesh(model, m->mesh, error);
+    if (!ok) {
+        cout << error << "; using the gem" << endl;
+        m = Ptr<BatchModel>();
+    } else if (!m->packed) {
+        optimizeMesh(m->mesh);
+        buildLodChain(m->mesh, m->lods);
+        for (size_t i = 0; i < m->lods.indices.size(); i++) optimizeVertexCache(m->lods.indices[i], m->mesh.vertexCount());
+    } else if (job.software) {
+        unpackMesh(m->file.mesh(), m->mesh, &m->lods);
+    }
+    if (m.get() != 0) {
+        float lo[3], hi[3], radius = 0.0f;
+        m->mesh.bounds(lo, hi);
+        for (int k = 0; k < 3; k++) {
+            m->center[k] = 0.5f * (lo[k] + hi[k]);
+            radius += 0.25f * (hi[k] - lo[k]) * (hi[k] - lo[k]);
+        }
+        m->radius = sqrt(radius);
+    }
+    job.models[model] = m;
+}
+
+/**
+ * Identify an overlay by everything it is drawn with: the image size, the
+ * projection, and the models and their places.
+ */
+static string spriteKey(SceneRegistry &scene, const double projection[16], Size size) {
+    string key((const char *) &size, sizeof(size));
+    key.append((const char *) projection, 16 * sizeof(double));
+    const vector<int> &visible = scene.visible();
+    SceneGraph &graph = scene.graph();
+    for (size_t i = 0; i < visible.size(); i++) {
+        const SceneObject &obj = scene[visible[i]];
+        key += obj.model + '\0';
+        key.append((const char *) graph.world(obj.node), 16 * sizeof(double));
+        key.append((const char *) &obj.scale, sizeof(obj.scale));
+        for (size_t j = 0; j < obj.parts.size(); j++) {
+            const ScenePart &part = scene.part(obj.parts[j]);
+            key += part.model + '\0';
+            key.append((const char *) graph.world(part.node), 16 * sizeof(double));
+            key.append((const char *) &part.scale, sizeof(part.scale));
+        }
+    }
+    return key;
+}
+
+/**
+ * A worker thread's renderer: an OpenGL context, and everything in it, or
+ * a software rasterizer.
+ */
+class BatchWorker {
+public:
+    BatchWorker(BatchJob &job) : job(job), texture(0), gemList(0) {}
+
+    /**
+     * Render images from the queue until it is empty.
+     */
+    void run();
+
+private:
+    bool init();
+    void render(const String &file);
+    void showBackground(const Mat &img);
+    void drawObjects(SceneRegistry &scene, const double projection[16], Size size);
+    void readResult(Size size, Mat &color, Mat *depth = 0);
+    void drawObject(const double world[16], double scale, const String &model, const double projection[16], int viewportHeight);
+    void drawSoftware(const double world[16], double scale, const String &model, const double projection[16], int viewportHeight);
+    void release();
+
+    BatchJob &job;
+#ifdef HAVE_EGL
+    HeadlessContext context;
+#endif
+    unsigned int texture, gemList;
+    map<String, MeshBuffer> meshes;
+    SoftRasterizer raster;
+    MarkerTracker tracker;
+};
+
+void BatchWorker::run() {
+    if (!init()) {
+#ifdef HAVE_EGL
+        lock_guard<mutex> guard(job.output);
+        cout << context.error() << endl;
+#endif
+        return;
+    }
+    for (;;) {
+        size_t i = job.next++;
+        if (i >= job.files.size()) break;
+        render(job.files[i]);
+    }
+    release();
+}
+
+bool BatchWorker::init() {
+    if (job.software) return true;
+#ifdef HAVE_EGL
+    if (!context.create(job.maxSize.width, job.maxSize.height)) return false;
+#endif
+
+    // The same material and lighting as the window
+    glClearColor(0.0, 0.0, 0.0, 0.0);
+    setupLighting();
+    glEnable(GL_DEPTH_TEST);
+
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_DECAL);
+
+    gemList = glGenLists(2);
+    glNewList(gemList, GL_COMPILE);
+        drawGem();
+    glEndList();
+    glNewList(gemList + 1, GL_COMPILE);
+        drawBackground();
+    glEndList();
+
+    // Each context gets its own buffers for the shared meshes
+    for (map<String, Ptr<BatchModel> >::const_iterator it = job.models.begin(); it != job.models.end(); ++it) {
+        const Ptr<BatchModel> &m = it->second;
+        if (m.get() == 0) continue;
+        MeshBuffer &buffer = meshes[it->first];
+        if (m->packed) {
+            buffer.upload(m->file.mesh());
+        } else {
+            buffer.upload(m->mesh, &m->lods);
+        }
+    }
+    return true;
+}
+
+void BatchWorker::render(const String &file) {
+    Mat img = imread(file, IMREAD_COLOR);
+    if (img.empty()) {
+        job.failed++;
+        lock_guard<mutex> guard(job.output);
+        cout << "Unable to read image: " << file << endl;
+        return;
+    }
+
+    // Images larger than the OpenGL surface are scaled down to fit it; the
+    // software renderer takes any size
+    double s = min(1.0, min((double) job.maxSize.width / img.cols, (double) job.maxSize.height / img.rows));
+    if (s < 1.0 && !job.software) {
+        Size full = img.size();
+        resize(img, img, Size(), s, s, INTER_AREA);
+        lock_guard<mutex> guard(job.output);
+        cout << file << ": " << full.width << "x" << full.height << " reduced to "
+             << img.cols << "x" << img.rows << " to fit --size" << endl;
+    }
+
+    CameraModel camera = job.calibrated ? job.camera.scaledTo(img.size()) : CameraModel::guess(img.size());
+    SceneRegistry scene = job.scene;
+    if (!job.fixedPose) {
+        // Every image is a new scene: search all of it, and start every pose afresh
+        tracker.reset();
+        scene.update(tracker.detect(img, 0.0), camera, 0.0);
+    }
+
+    // Place the objects, and their parts
+    double p[16], m[16];
+    double zNear = 0.01, zFar = 1000.0;
+    camera.glProjection(zNear, zFar, p);
+    const vector<int> &visible = scene.visible();
+    SceneGraph &graph = scene.graph();
+    for (size_t i = 0; i < visible.size(); i++) {
+        scene[visible[i]].pose.predict(0.0).glModelview(m);
+        graph.setLocal(scene[visible[i]].node, m);
+    }
+    graph.update();
+
+    Mat result;
+    if (job.fixedPose) {
+        // The overlay is the same on every image of this size: render it
+        // once, by itself, and blend it onto each image
+        string key = spriteKey(scene, p, img.size());
+        Ptr<const OverlaySprite> sprite = job.sprites.find(key);
+        if (sprite.get() == 0) {
+            Mat color, depth;
+            if (job.software) {
+                raster.begin(Mat::zeros(img.size(), CV_8UC3), img.size());
+            } else {
+                glViewport(0, 0, img.cols, img.rows);
+                glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+            }
+            drawObjects(scene, p, img.size());
+            readResult(img.size(), color, &depth);
+            sprite = makePtr<OverlaySprite>(color, depth);
+            job.sprites.insert(key, sprite);
+        }
+        sprite->drawOn(img);
+        result = img;
+    } else {
+        showBackground(img);
+        drawObjects(scene, p, img.size());
+        readResult(img.size(), result);
+    }
+
+    // Write the result under the input's name
+    size_t slash = file.find_last_of("/\\");
+    String name = job.outputDir + "/" + (slash == String::npos ? file : file.substr(slash + 1));
+    if (imwrite(name, result)) {
+        job.rendered++;
+    } else {
+        job.failed++;
+        lock_guard<mutex> guard(job.output);
+        cout << "Unable to write " << name << endl;
+    }
+}
+
+void BatchWorker::showBackground(const Mat &img) {
+    if (job.software) {
+        raster.begin(img, img.size());
+        return;
+    }
+
+    // The background fills the viewport, without writing depth
+    glViewport(0, 0, img.cols, img.rows);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    glOrtho(-2.0, 2.0, -2.0, 2.0, -1.0, 1.0);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    glDisable(GL_LIGHTING);
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, img.cols, img.rows, 0, GL_BGR, GL_UNSIGNED_BYTE, img.ptr());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glDepthMask(GL_FALSE);
+    glCallList(gemList + 1);
+    glDepthMask(GL_TRUE);
+    glDisable(GL_TEXTURE_2D);
+}
+
+void BatchWorker::drawObjects(SceneRegistry &scene, const double p[16], Size size) {
+    const vector<int> &visible = scene.visible();
+    if (visible.empty()) return;
+    if (job.software) {
+        raster.setProjection(p);
+    } else {
+        glMatrixMode(GL_PROJECTION);
+        glLoadMatrixd(p);
+        glMatrixMode(GL_MODELVIEW);
+        glEnable(GL_LIGHTING);
+        glEnable(GL_NORMALIZE);
+    }
+
+    // The objects, as seen through the camera
+    SceneGraph &graph = scene.graph();
+    for (size_t i = 0; i < visible.size(); i++) {
+        const SceneObject &obj = scene[visible[i]];
+        drawObject(graph.world(obj.node), obj.scale, obj.model, p, size.height);
+        for (size_t j = 0; j < obj.parts.size(); j++) {
+            const ScenePart &part = scene.part(obj.parts[j]);
+            drawObject(graph.world(part.node), part.scale, part.model, p, size.height);
+        }
+    }
+    if (!job.software) glDisable(GL_NORMALIZE);
+}
+
+void BatchWorker::readResult(Size size, Mat &color, Mat *depth) {
+    if (job.software) {
+        raster.finish();
+        color = raster.image();
+        if (depth) *depth = raster.depthImage();
+        return;
+    }
+#ifdef HAVE_EGL
+    color = readFramebuffer(size.width, size.height);
+    if (depth) {
+        depth->create(size, CV_32F);
+        glReadPixels(0, 0, size.width, size.height, GL_DEPTH_COMPONENT, GL_FLOAT, depth->ptr());
+        flip(*depth, *depth, 0);
+    }
+#endif
+}
+
+void BatchWorker::drawObject(const double world[16], double scale, const String &model, const double projection[16],
+                             int viewportHeight) {
+    if (job.software) {
+        drawSoftware(world, scale, model, projection, viewportHeight);
+        return;
+    }
+
+    map<String, MeshBuffer>::const_iterator it = meshes.find(model);
+    const MeshBuffer *mesh = it != meshes.end() ? &it->second : 0;
+
+    float center[3], radius;
+    if (mesh) {
+        mesh->boundingSphere(center, radius);
+    } else {
+        gemBounds(center, radius);
+    }
+    double m[16];
+    for (int k = 0; k < 16; k++) m[k] = k < 12 ? world[k] * scale : world[k];
+    if (!sphereInFrustum(projection, m, center, radius)) return;
+
+    glLoadMatrixd(m);
+    if (mesh) {
+        mesh->draw(mesh->selectLevel(job.lodTolerance));
+    } else {
+        glCallList(gemList);
+    }
+}
+
+void BatchWorker::drawSoftware(const double world[16], double scale, const String &model, const double projection[16],
+                               int viewportHeight) {
+    map<String, Ptr<BatchModel> >::const_iterator it = job.models.find(model);
+    const BatchModel *shared = it != job.models.end() ? it->second.get() : 0;
+    const Mesh &mesh = shared ? shared->mesh : job.gem;
+
+    float center[3], radius;
+    if (shared) {
+        for (int k = 0; k < 3; k++) center[k] = shared->center[k];
+        radius = shared->radius;
+    } else {
+        gemBounds(center, radius);
+    }
+    double m[16];
+    for (int k = 0; k < 16; k++) m[k] = k < 12 ? world[k] * scale : world[k];
+    if (!sphereInFrustum(projection, m, center, radius)) return;
+
+    // The same level of detail as OpenGL would draw
+    const vector<uint32_t> *indices = &mesh.indices;
+    if (shared && !shared->lods.errors.empty()) {
+        int level = selectLevel(&shared->lods.errors[0], (int) shared->lods.errors.size(), center, radius,
+                                m, projection, viewportHeight, job.lodTolerance);
+        if (level > 0) indices = &shared->lods.indices[level - 1];
+    }
+    if (indices->empty()) return;
+    raster.drawTriangles(&mesh.positions[0], mesh.normals.empty() ? 0 : &mesh.normals[0], mesh.vertexCount(),
+                         &(*indices)[0], indices->size(), m);
+}
+
+void BatchWorker::release() {
+    if (job.software) return;
+    for (map<String, MeshBuffer>::iterator it = meshes.begin(); it != meshes.end(); ++it) it->second.release();
+    glDeleteTextures(1, &texture);
+    glDeleteLists(gemList, 2);
+#ifdef HAVE_EGL
+    context.destroy();
+#endif
+}
+
+int batchCommand(int argc, char *argv[]) {
+    String folder, cameraFile = "camera.yml", sceneFile = "scene.yml", modelFile;
+    double markerLength = 1.0, lodTolerance = 1.0;
+    int threads = getNumberOfCPUs();
+    Size maxSize(1920, 1080);
+    String outputDir, renderer = "gl", fixedPoseImage;
+    for (int i = 0; i < argc; i++) {
+        String arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--output" && hasValue) {
+            outputDir = argv[++i];
+        } else if (arg == "--threads" && hasValue) {
+            threads = max(1, atoi(argv[++i]));
+        } else if (arg == "--size" && hasValue) {
+            sscanf(argv[++i], "%dx%d", &maxSize.width, &maxSize.height);
+        } else if (arg == "--camera" && hasValue) {
+            cameraFile = argv[++i];
+        } else if (arg == "--scene" && hasValue) {
+            sceneFile = argv[++i];
+        } else if (arg == "--model" && hasValue) {
+            modelFile = argv[++i];
+        } else if (arg == "--marker-length" && hasValue) {
+            markerLength = atof(argv[++i]);
+        } else if (arg == "--lod-tolerance" && hasValue) {
+            lodTolerance = atof(argv[++i]);
+        } else if (arg == "--renderer" && hasValue) {
+            renderer = argv[++i];
+        } else if (arg == "--fixed-pose" && hasValue) {
+            fixedPoseImage = argv[++i];
+        } else if (arg[0] != '-' && folder.empty()) {
+            folder = arg;
+        }
+    }
+    if (folder.empty() || outputDir.empty() || maxSize.width <= 0 || maxSize.height <= 0 ||
+        (renderer != "gl" && renderer != "cpu")) {
+        cout << "Usage: OpenCVWithOpenGL batch FOLDER --output DIR [options]" << endl;
+        cout << "Options:" << endl;
+        cout << "  --output DIR          where to write the composited images" << endl;
+        cout << "  --threads N           worker threads, each with its own context (default: one per core)" << endl;
+        cout << "  --size WxH            largest image rendered with OpenGL; larger ones are scaled down" << endl;
+        cout << "                        (default 1920x1080)" << endl;
+        cout << "  --camera FILE         camera calibration (default camera.yml; guessed if missing)" << endl;
+        cout << "  --scene FILE          objects to place on markers (default scene.yml)" << endl;
+        cout << "  --model FILE          model for markers the scene does not list (default the gem)" << endl;
+        cout << "  --marker-length L     side of a marker, in scene units (default 1)" << endl;
+        cout << "  --lod-tolerance PX    simplification error allowed on screen, in pixels (default 1)" << endl;
+        cout << "  --renderer gl|cpu     render with OpenGL, or with the software rasterizer (default gl," << endl;
+        cout << "                        or cpu when no OpenGL context can be created)" << endl;
+        cout << "  --fixed-pose IMAGE    find the markers in IMAGE only, and draw the objects there on every" << endl;
+        cout << "                        image, rendering them once per image size" << endl;
+        return -1;
+    }
+
+    BatchJob job;
+    vector<String> names;
+    glob(folder + "/*", names, false);
+    for (size_t i = 0; i < names.size(); i++) {
+        if (isImageFile(names[i])) job.files.push_back(names[i]);
+    }
+    if (job.files.empty()) {
+        cout << "No images found in " << folder << endl;
+        return -1;
+    }
+    job.outputDir = outputDir;
+    job.maxSize = maxSize;
+    job.calibrated = job.camera.load(cameraFile);
+    if (!job.calibrated) cout << "No camera calibration in " << cameraFile << "; guessing" << endl;
+    job.lodTolerance = lodTolerance;
+
+    // The workers are the parallelism: keep OpenCV (which also runs the
+    // software rasterizer's tiles), and Mesa's software rasterizer, from
+    // each starting a thread per core as well.  Mesa reads its setting
+    // when the first context is created, so this comes before the probe.
+    threads = min(threads, (int) job.files.size());
+    if (threads > 1) {
+        setNumThreads(1);
+#ifndef _WIN32
+        setenv("LP_NUM_THREADS", "1", 0);
+#endif
+    }
+
+    // Without OpenGL, the software rasterizer renders instead
+    job.software = renderer == "cpu";
+#ifdef HAVE_EGL
+    if (!job.software) {
+        HeadlessContext probe;
+        if (!probe.create(16, 16)) {
+            cout << probe.error() << "; using the software renderer" << endl;
+            job.software = true;
+        }
+        probe.destroy();
+    }
+#else
+    job.software = true;
+#endif
+    if (job.software) gemMesh(job.gem);
+    job.scene = SceneRegistry(markerLength);
+    MarkerTracker tracker;
+    if (!job.scene.load(sceneFile, tracker.getDictionary())) job.scene.setAutoModel(modelFile.empty() ? "gem" : modelFile);
+
+    // With a fixed pose, the objects are placed once, for every image
+    job.fixedPose = !fixedPoseImage.empty();
+    if (job.fixedPose) {
+        Mat img = imread(fixedPoseImage, IMREAD_COLOR);
+        if (img.empty()) {
+            cout << "Unable to read image: " << fixedPoseImage << endl;
+            return -1;
+        }
+        CameraModel camera = job.calibrated ? job.camera.scaledTo(img.size()) : CameraModel::guess(img.size());
+        job.scene.update(tracker.detect(img, 0.0), camera, 0.0);
+        if (job.scene.visible().empty()) cout << "No markers found in " << fixedPoseImage << endl;
+    }
+    job.next = 0;
+    job.rendered = 0;
+    job.failed = 0;
+
+    // Load every model the scene can show, once
+    if (!modelFile.empty()) loadModel(job, modelFile);
+    for (size_t i = 0; i < job.scene.size(); i++) {
+        loadModel(job, job.scene[i].model);
+        for (size_t j = 0; j < job.scene[i].parts.size(); j++) loadModel(job, job.scene.part(job.scene[i].parts[j]).model);
+    }
+
+    cout << "Rendering " << job.files.size() << " images, using " << threads << " threads"
+         << (job.software ? " and the software renderer" : "") << endl;
+    int64 start = getTickCount();
+    vector<Ptr<BatchWorker> > workers;
+    vector<thread> pool;
+    for (int i = 0; i < threads; i++) {
+        workers.push_back(makePtr<BatchWorker>(job));
+        pool.push_back(thread(&BatchWorker::run, workers.back().get()));
+    }
+    for (size_t i = 0; i < pool.size(); i++) pool[i].join();
+    double seconds = (getTickCount() - start) / getTickFrequency();
+
+    cout << "Rendered " << job.rendered << " images in " << seconds << " s ("
+         << job.rendered / seconds << " images/s)";
+    if (job.failed > 0) cout << "; " << job.failed << " failed";
+    cout << endl;
+    return job.failed == 0 && job.rendered > 0 ? 0 : 1;
+}
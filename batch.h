@@ -0,0 +1,36 @@
+/*
+ * Batch rendering for OpenCV with OpenGL
+ *
+ * Composites objects onto the markers in a folder of images, offscreen,
+ * writing one output image per input.  Software rasterizers use one core
+ * per context (or a few), so the images are shared out between worker
+ * threads, each with a headless OpenGL context of its own, with its own
+ * texture and mesh buffers; the workers take the next image from a shared
+ * queue as they finish one.  Meshes are loaded and optimized once, before
+ * the workers start, and uploaded by each of them.
+ *
+ * Where there is no OpenGL (no EGL, or no driver), or with --renderer cpu,
+ * each worker renders with a SoftRasterizer instead, drawing the shared
+ * meshes directly.
+ *
+ * With --fixed-pose, the markers are found in one image, and the objects
+ * drawn at the same place on all of them: the overlay is rendered once per
+ * image size, into a sprite (see sprite.h), and only blended onto each
+ * image.
+ *
+ * Usage:
+ *   OpenCVWithOpenGL batch FOLDER --output DIR [options]
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+/**
+ * Run the batch subcommand.
+ * @param argc the number of arguments after "batch"
+ * @param argv the arguments after "batch"
+ * @return the program exit code
+ */
+int batchCommand(int argc, char *argv[]);
+
+#endif // BATCH_H
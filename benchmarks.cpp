@@ -0,0 +1,434 @@
+/*
+ * Benchmarks for OpenCV with OpenGL
+ *
+ * Measures each stage of a frame on its own, using Google Benchmark and an
+ * offscreen OpenGL context:
+ * - decoding images (ohio.jpg, and larger synthetic JPEGs)
+ * - uploading a frame to a texture (glTexImage2D, glTexSubImage2D, and
+ *   glTexSubImage2D from a pixel buffer object)
+ * - drawing the background and the gem
+ * - rendering gems over a 1080p image with the software rasterizer, and
+ *   the same with Mesa's llvmpipe (LIBGL_ALWAYS_SOFTWARE=1), to compare
+ * - recording a stage in the frame trace, from one thread and from several
+ * - reading the rendered frame back (glReadPixels, directly and through a
+ *   pair of pixel buffer objects)
+ *
+ * Every upload and draw benchmark ends its iteration with glFinish, so the
+ * time includes the work the driver deferred.  A direct glReadPixels only
+ * returns once the pixels are in memory; the pixel buffer readback
+ * overlaps each read with the next frame by design, and waits for the
+ * last one after its loop.
+ *
+ * Usage:
+ *   OpenCVWithOpenGL_bench [--image FILE] [Google Benchmark options]
+ * To keep results for comparison between commits, add
+ *   --benchmark_out=results.json --benchmark_out_format=json
+ */
+
+#define GL_GLEXT_PROTOTYPES
+#include <benchmark/benchmark.h>
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <GL/glu.h>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <vector>
+#include "geometry.h"
+#include "headless.h"
+#include "softraster.h"
+#include "trace.h"
+using namespace cv;
+using namespace std;
+
+// Size of the offscreen surface that the draw and readback benchmarks use
+const int surfaceWidth = 1280, surfaceHeight = 720;
+
+// Size of the frames the two gem renderers are compared at
+const int gemWidth = 1920, gemHeight = 1080;
+
+#ifdef OCVGL_SOURCE_DIR
+String imageFile = OCVGL_SOURCE_DIR "/ohio.jpg";
+#else
+String imageFile = "ohio.jpg";
+#endif
+
+/**
+ * @return the sample image, resized to the given size (cached)
+ */
+static const Mat &sampleImage(int w, int h) {
+    static Mat original = imread(imageFile, IMREAD_COLOR);
+    static Mat cached;
+    if (cached.cols != w || cached.rows != h) {
+        if (original.empty()) {
+            // No sample image; use noise, which is at least not trivially compressible
+            cached.create(h, w, CV_8UC3);
+            randu(cached, Scalar::all(0), Scalar::all(255));
+        } else {
+            resize(original, cached, Size(w, h), 0, 0, INTER_LINEAR);
+        }
+    }
+    return cached;
+}
+
+/**
+ * Create a texture of the given size, with the settings the program uses.
+ */
+static GLuint createTexture(int w, int h) {
+    GLuint tex;
+    glGenTextures(1, &tex);
+    glBindTexture(GL_TEXTURE_2D, tex);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, 0);
+    return tex;
+}
+
+/**
+ * Set up the same projection and state as the program's dolly animation.
+ */
+static void setupScene() {
+    glViewport(0, 0, surfaceWidth, surfaceHeight);
+    glMatrixMode(GL_PROJECTION);
+    glLoadIdentity();
+    gluPerspective(45.0, (double) surfaceWidth / surfaceHeight, 1.0, 100.0);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    glTranslatef(0.0f, 0.0f, -5.0f);
+    glEnable(GL_DEPTH_TEST);
+    setupLighting();
+}
+
+// ---- Decode ----
+
+static void BM_ImreadSample(benchmark::State &state) {
+    for (auto _ : state) {
+        Mat img = imread(imageFile, IMREAD_COLOR);
+        benchmark::DoNotOptimize(img.data);
+    }
+}
+BENCHMARK(BM_ImreadSample)->Unit(benchmark::kMillisecond);
+
+static void BM_DecodeJpeg(benchmark::State &state) {
+    vector<uchar> jpeg;
+    imencode(".jpg", sampleImage((int) state.range(0), (int) state.range(1)), jpeg);
+    Mat img;
+    for (auto _ : state) {
+        img = imdecode(jpeg, IMREAD_COLOR);
+        benchmark::DoNotOptimize(img.data);
+    }
+    state.SetBytesProcessed(state.iterations() * (int64_t) jpeg.size());
+}
+BENCHMARK(BM_DecodeJpeg)->Args({960, 591})->Args({1920, 1080})->Args({3840, 2160})->Unit(benchmark::kMillisecond);
+
+// ---- Upload ----
+
+static void BM_UploadTexImage(benchmark::State &state) {
+    int w = (int) state.range(0), h = (int) state.range(1);
+    const Mat &img = sampleImage(w, h);
+    GLuint tex = createTexture(w, h);
+    for (auto _ : state) {
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, w, h, 0, GL_RGB, GL_UNSIGNED_BYTE, img.ptr());
+        glFinish();
+    }
+    state.SetBytesProcessed(state.iterations() * (int64_t) img.total() * img.elemSize());
+    glDeleteTextures(1, &tex);
+}
+BENCHMARK(BM_UploadTexImage)->Args({960, 591})->Args({1920, 1080})->Args({3840, 2160})->Unit(benchmark::kMillisecond);
+
+static void BM_UploadTexSubImage(benchmark::State &state) {
+    int w = (int) state.range(0), h = (int) state.range(1);
+    const Mat &img = sampleImage(w, h);
+    GLuint tex = createTexture(w, h);
+    for (auto _ : state) {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, img.ptr());
+        glFinish();
+    }
+    state.SetBytesProcessed(state.iterations() * (int64_t) img.total() * img.elemSize());
+    glDeleteTextures(1, &tex);
+}
+BENCHMARK(BM_UploadTexSubImage)->Args({960, 591})->Args({1920, 1080})->Args({3840, 2160})->Unit(benchmark::kMillisecond);
+
+static void BM_UploadPbo(benchmark::State &state) {
+    int w = (int) state.range(0), h = (int) state.range(1);
+    const Mat &img = sampleImage(w, h);
+    size_t bytes = img.total() * img.elemSize();
+    GLuint tex = createTexture(w, h);
+    GLuint pbo;
+    glGenBuffers(1, &pbo);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pbo);
+    for (auto _ : state) {
+        // Orphan the old storage, so the copy does not wait for the last upload
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, bytes, 0, GL_STREAM_DRAW);
+        void *dst = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+        memcpy(dst, img.ptr(), bytes);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RGB, GL_UNSIGNED_BYTE, 0);
+        glFinish();
+    }
+    state.SetBytesProcessed(state.iterations() * (int64_t) bytes);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glDeleteBuffers(1, &pbo);
+    glDeleteTextures(1, &tex);
+}
+BENCHMARK(BM_UploadPbo)->Args({960, 591})->Args({1920, 1080})->Args({3840, 2160})->Unit(benchmark::kMillisecond);
+
+// ---- Draw ----
+
+static void BM_DrawBackground(benchmark::State &state) {
+    const Mat &img = sampleImage(960, 591);
+    GLuint tex = createTexture(img.cols, img.rows);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, img.cols, img.rows, GL_RGB, GL_UNSIGNED_BYTE, img.ptr());
+    GLuint list = glGenLists(1);
+    glNewList(list, GL_COMPILE);
+    drawBackground();
+    glEndList();
+
+    setupScene();
+    glDisable(GL_LIGHTING);
+    glEnable(GL_TEXTURE_2D);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_DECAL);
+    for (auto _ : state) {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glCallList(list);
+        glFinish();
+    }
+    glDisable(GL_TEXTURE_2D);
+    glDeleteLists(list, 1);
+    glDeleteTextures(1, &tex);
+}
+BENCHMARK(BM_DrawBackground)->Unit(benchmark::kMicrosecond);
+
+static void BM_DrawGem(benchmark::State &state) {
+    GLuint list = glGenLists(1);
+    glNewList(list, GL_COMPILE);
+    drawGem();
+    glEndList();
+
+    setupScene();
+    glEnable(GL_LIGHTING);
+    for (auto _ : state) {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glCallList(list);
+        glFinish();
+    }
+    glDisable(GL_LIGHTING);
+    glDeleteLists(list, 1);
+}
+BENCHMARK(BM_DrawGem)->Unit(benchmark::kMicrosecond);
+
+static void BM_Clear(benchmark::State &state) {
+    setupScene();
+    for (auto _ : state) {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glFinish();
+    }
+}
+BENCHMARK(BM_Clear)->Unit(benchmark::kMicrosecond);
+
+// ---- Gems at 1080p: the software rasterizer against llvmpipe ----
+
+/**
+ * Set a column-major perspective matrix, as gluPerspective() would.
+ */
+static void perspective(double fovy, double aspect, double zNear, double zFar, double m[16]) {
+    double f = 1.0 / tan(fovy * CV_PI / 360.0);
+    for (int k = 0; k < 16; k++) m[k] = 0.0;
+    m[0] = f / aspect;
+    m[5] = f;
+    m[10] = (zFar + zNear) / (zNear - zFar);
+    m[11] = -1.0;
+    m[14] = 2.0 * zFar * zNear / (zNear - zFar);
+}
+
+/**
+ * Set the modelview matrix of gem i of count, laid out in a square grid
+ * at the dolly's distance, each scaled to its cell.
+ */
+static void gemModelview(int i, int count, double m[16]) {
+    int side = (int) ceil(sqrt((double) count));
+    double scale = 1.0 / side, spacing = 2.4 * scale;
+    for (int k = 0; k < 16; k++) m[k] = 0.0;
+    m[0] = m[5] = m[10] = scale;
+    m[12] = (i % side - (side - 1) / 2.0) * spacing;
+    m[13] = (i / side - (side - 1) / 2.0) * spacing;
+    m[14] = -5.0;
+    m[15] = 1.0;
+}
+
+static void BM_SoftRasterGem(benchmark::State &state) {
+    int count = (int) state.range(0);
+    const Mat &img = sampleImage(gemWidth, gemHeight);
+    Mesh gem;
+    gemMesh(gem);
+    double p[16], m[16];
+    perspective(45.0, (double) gemWidth / gemHeight, 1.0, 100.0, p);
+    SoftRasterizer raster;
+    for (auto _ : state) {
+        raster.begin(img, img.size());
+        raster.setProjection(p);
+        for (int i = 0; i < count; i++) {
+            gemModelview(i, count, m);
+            raster.drawMesh(gem, m);
+        }
+        raster.finish();
+        benchmark::DoNotOptimize(raster.image().data);
+    }
+}
+BENCHMARK(BM_SoftRasterGem)->Arg(1)->Arg(25)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+static void BM_GlGemLlvmpipe(benchmark::State &state) {
+    String renderer = (const char *) glGetString(GL_RENDERER);
+    if (renderer.find("llvmpipe") == String::npos) {
+        state.SkipWithError("not llvmpipe; run with LIBGL_ALWAYS_SOFTWARE=1");
+        return;
+    }
+
+    // A 1080p framebuffer, larger than the surface
+    GLuint framebuffer, renderbuffers[2];
+    glGenFramebuffers(1, &framebuffer);
+    glGenRenderbuffers(2, renderbuffers);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[0]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, gemWidth, gemHeight);
+    glBindRenderbuffer(GL_RENDERBUFFER, renderbuffers[1]);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, gemWidth, gemHeight);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, renderbuffers[0]);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, renderbuffers[1]);
+
+    // The image, and the gem, as the program draws them
+    const Mat &img = sampleImage(gemWidth, gemHeight);
+    GLuint tex = createTexture(img.cols, img.rows);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, img.cols, img.rows, GL_BGR, GL_UNSIGNED_BYTE, img.ptr());
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_DECAL);
+    GLuint lists = glGenLists(2);
+    glNewList(lists, GL_COMPILE);
+    drawBackground();
+    glEndList();
+    glNewList(lists + 1, GL_COMPILE);
+    drawGem();
+    glEndList();
+    setupLighting();
+    glEnable(GL_DEPTH_TEST);
+    glViewport(0, 0, gemWidth, gemHeight);
+
+    int count = (int) state.range(0);
+    double p[16], m[16];
+    perspective(45.0, (double) gemWidth / gemHeight, 1.0, 100.0, p);
+    for (auto _ : state) {
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        glMatrixMode(GL_PROJECTION);
+        glLoadIdentity();
+        glOrtho(-2.0, 2.0, -2.0, 2.0, -1.0, 1.0);
+        glMatrixMode(GL_MODELVIEW);
+        glLoadIdentity();
+        glEnable(GL_TEXTURE_2D);
+        glDepthMask(GL_FALSE);
+        glCallList(lists);
+        glDepthMask(GL_TRUE);
+        glDisable(GL_TEXTURE_2D);
+
+        glMatrixMode(GL_PROJECTION);
+        glLoadMatrixd(p);
+        glMatrixMode(GL_MODELVIEW);
+        glEnable(GL_LIGHTING);
+        glEnable(GL_NORMALIZE);
+        for (int i = 0; i < count; i++) {
+            gemModelview(i, count, m);
+            glLoadMatrixd(m);
+            glCallList(lists + 1);
+        }
+        glDisable(GL_NORMALIZE);
+        glDisable(GL_LIGHTING);
+        glFinish();
+    }
+
+    glDeleteLists(lists, 2);
+    glDeleteTextures(1, &tex);
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    glDeleteRenderbuffers(2, renderbuffers);
+    glDeleteFramebuffers(1, &framebuffer);
+}
+BENCHMARK(BM_GlGemLlvmpipe)->Arg(1)->Arg(25)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// ---- Readback ----
+
+static void BM_ReadPixels(benchmark::State &state) {
+    GLenum format = (GLenum) state.range(0);
+    Mat out(surfaceHeight, surfaceWidth, format == GL_BGRA ? CV_8UC4 : CV_8UC3);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    for (auto _ : state) {
+        glReadPixels(0, 0, surfaceWidth, surfaceHeight, format, GL_UNSIGNED_BYTE, out.ptr());
+        benchmark::DoNotOptimize(out.data);
+    }
+    state.SetBytesProcessed(state.iterations() * (int64_t) out.total() * out.elemSize());
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+}
+BENCHMARK(BM_ReadPixels)->Arg(GL_BGR)->Arg(GL_BGRA)->Unit(benchmark::kMillisecond);
+
+static void BM_ReadPixelsPbo(benchmark::State &state) {
+    // Start the read of this frame into one buffer, and map the other,
+    // which holds the previous frame: the usual double-buffered readback
+    size_t bytes = (size_t) surfaceWidth * surfaceHeight * 4;
+    GLuint pbo[2];
+    glGenBuffers(2, pbo);
+    for (int i = 0; i < 2; i++) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[i]);
+        glBufferData(GL_PIXEL_PACK_BUFFER, bytes, 0, GL_STREAM_READ);
+    }
+    Mat out(surfaceHeight, surfaceWidth, CV_8UC4);
+    int frame = 0;
+    for (auto _ : state) {
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[frame & 1]);
+        glReadPixels(0, 0, surfaceWidth, surfaceHeight, GL_BGRA, GL_UNSIGNED_BYTE, 0);
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, pbo[(frame + 1) & 1]);
+        void *src = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+        if (src) {
+            memcpy(out.ptr(), src, bytes);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        frame++;
+    }
+    glFinish();     // the last read, before its buffer is deleted
+    state.SetBytesProcessed(state.iterations() * (int64_t) bytes);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    glDeleteBuffers(2, pbo);
+}
+BENCHMARK(BM_ReadPixelsPbo)->Unit(benchmark::kMillisecond);
+
+// ---- Tracing ----
+
+static void BM_TraceRecord(benchmark::State &state) {
+    // Each thread records as a decoder would: its own frames, every stage
+    // timed with two clock reads
+    FrameTrace &trace = FrameTrace::instance();
+    long frame = 0;
+    for (auto _ : state) {
+        int64_t start = FrameTrace::ticks();
+        trace.record(TRACE_DECODE, frame++, start);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_TraceRecord)->ThreadRange(1, 8)->UseRealTime();
+
+int main(int argc, char *argv[]) {
+    benchmark::Initialize(&argc, argv);
+    for (int i = 1; i < argc; i++) {
+        if (String(argv[i]) == "--image" && i + 1 < argc) imageFile = argv[++i];
+    }
+
+    HeadlessContext context;
+    if (!context.create(surfaceWidth, surfaceHeight)) {
+        cout << context.error() << endl;
+        return 1;
+    }
+    cout << "Renderer: " << glGetString(GL_RENDERER) << endl;
+
+    benchmark::RunSpecifiedBenchmarks();
+    return 0;
+}
@@ -0,0 +1,226 @@
+/*
+ * Camera calibration for OpenCV with OpenGL
+ * See calibration.h for an overview.
+ */
+
+#include "calibration.h"
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+#include <opencv2/aruco/charuco.hpp>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <iostream>
+using namespace cv;
+using namespace std;
+
+CalibrationPattern::CalibrationPattern()
+    : type(CHESSBOARD), size(9, 6), squareLength(1.0f), markerLength(0.5f), dictionary(aruco::DICT_4X4_50) {
+}
+
+/**
+ * Finds the pattern in a range of the images.  Each image writes only its
+ * own slot of the results, so the images can be processed in parallel
+ * without locking.
+ */
+class CornerFinder : public ParallelLoopBody {
+public:
+    CornerFinder(const vector<String> &files, const CalibrationPattern &pattern,
+                 const Ptr<aruco::CharucoBoard> &board,
+                 vector<vector<Point2f> > &corners, vector<vector<int> > &ids, vector<Size> &sizes)
+        : files(files), pattern(pattern), board(board), corners(corners), ids(ids), sizes(sizes) {
+    }
+
+    void operator()(const Range &range) const {
+        for (int i = range.start; i < range.end; i++) {
+            Mat gray = imread(files[i], CV_LOAD_IMAGE_GRAYSCALE);
+            if (gray.empty()) continue;
+            sizes[i] = gray.size();
+            if (pattern.type == CalibrationPattern::CHESSBOARD) {
+                findChessboard(gray, i);
+            } else {
+                findCharuco(gray, i);
+            }
+        }
+    }
+
+private:
+    void findChessboard(const Mat &gray, int i) const {
+        vector<Point2f> found;
+        int flags = CALIB_CB_ADAPTIVE_THRESH | CALIB_CB_NORMALIZE_IMAGE | CALIB_CB_FAST_CHECK;
+        if (!findChessboardCorners(gray, pattern.size, found, flags)) return;
+        cornerSubPix(gray, found, Size(11, 11), Size(-1, -1),
+                     TermCriteria(TermCriteria::EPS + TermCriteria::COUNT, 30, 0.01));
+        corners[i] = found;
+    }
+
+    void findCharuco(const Mat &gray, int i) const {
+        vector<vector<Point2f> > markerCorners;
+        vector<int> markerIds;
+        aruco::detectMarkers(gray, board->dictionary, markerCorners, markerIds);
+        if (markerIds.empty()) return;
+
+        vector<Point2f> found;
+        vector<int> foundIds;
+        aruco::interpolateCornersCharuco(markerCorners, markerIds, gray, board, found, foundIds);
+        if (found.size() < 4) return;
+        corners[i] = found;
+        ids[i] = foundIds;
+    }
+
+    const vector<String> &files;
+    const CalibrationPattern &pattern;
+    Ptr<aruco::CharucoBoard> board;
+    vector<vector<Point2f> > &corners;
+    vector<vector<int> > &ids;
+    vector<Size> &sizes;
+};
+
+int calibrate(const vector<String> &files, const CalibrationPattern &pattern,
+              CameraModel &camera, double &rms) {
+    Ptr<aruco::CharucoBoard> board;
+    if (pattern.type == CalibrationPattern::CHARUCO) {
+        board = aruco::CharucoBoard::create(pattern.size.width, pattern.size.height,
+                                            pattern.squareLength, pattern.markerLength,
+                                            aruco::getPredefinedDictionary(aruco::PREDEFINED_DICTIONARY_NAME(pattern.dictionary)));
+    }
+
+    // Find the pattern in every image, in parallel
+    size_t n = files.size();
+    vector<vector<Point2f> > corners(n);
+    vector<vector<int> > ids(n);
+    vector<Size> sizes(n);
+    parallel_for_(Range(0, (int) n), CornerFinder(files, pattern, board, corners, ids, sizes));
+
+    // Keep the images where the pattern was found, at the size of the first
+    Size imageSize;
+    vector<vector<Point2f> > imagePoints;
+    vector<vector<int> > imageIds;
+    for (size_t i = 0; i < n; i++) {
+        if (corners[i].empty()) continue;
+        if (imageSize.area() == 0) imageSize = sizes[i];
+        if (sizes[i] != imageSize) {
+            cout << "Skipping " << files[i] << ": size differs from the other images" << endl;
+            continue;
+        }
+        imagePoints.push_back(corners[i]);
+        imageIds.push_back(ids[i]);
+    }
+    int used = (int) imagePoints.size();
+    if (used < 3) return used;
+
+    Mat cameraMatrix, distCoeffs;
+    vector<Mat> rvecs, tvecs;
+    if (pattern.type == CalibrationPattern::CHESSBOARD) {
+        vector<Point3f> grid;
+        for (int y = 0; y < pattern.size.height; y++) {
+            for (int x = 0; x < pattern.size.width; x++) {
+                grid.push_back(Point3f(x * pattern.squareLength, y * pattern.squareLength, 0.0f));
+            }
+        }
+        vector<vector<Point3f> > objectPoints(imagePoints.size(), grid);
+        rms = calibrateCamera(objectPoints, imagePoints, imageSize, cameraMatrix, distCoeffs, rvecs, tvecs);
+    } else {
+        rms = aruco::calibrateCameraCharuco(imagePoints, imageIds, board, imageSize,
+                                            cameraMatrix, distCoeffs, rvecs, tvecs);
+    }
+
+    camera.cameraMatrix = cameraMatrix;
+    camera.distCoeffs = distCoeffs;
+    camera.imageSize = imageSize;
+    camera.calibrated = true;
+    return used;
+}
+
+/**
+ * @return true if the file name has a common image extension
+ */
+static bool isImageFile(const String &name) {
+    size_t dot = name.find_last_of('.');
+    if (dot == String::npos) return false;
+    String ext = name.substr(dot + 1);
+    for (size_t i = 0; i < ext.size(); i++) ext[i] = (char) tolower((unsigned char) ext[i]);
+    return ext == "jpg" || ext == "jpeg" || ext == "png" || ext == "bmp" || ext == "tif" || ext == "tiff";
+}
+
+/**
+ * Parse a size given as WIDTHxHEIGHT (e.g. "9x6").
+ */
+static bool parseSize(const char *text, Size &size) {
+    return sscanf(text, "%dx%d", &size.width, &size.height) == 2 && size.width > 1 && size.height > 1;
+}
+
+int calibrateCommand(int argc, char *argv[]) {
+    String folder, output = "camera.yml";
+    CalibrationPattern pattern;
+    for (int i = 0; i < argc; i++) {
+        String arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--chessboard" && hasValue) {
+            pattern.type = CalibrationPattern::CHESSBOARD;
+            if (!parseSize(argv[++i], pattern.size)) {
+                cout << "Invalid pattern size: " << argv[i] << endl;
+                return -1;
+            }
+        } else if (arg == "--charuco" && hasValue) {
+            pattern.type = CalibrationPattern::CHARUCO;
+            if (!parseSize(argv[++i], pattern.size)) {
+                cout << "Invalid pattern size: " << argv[i] << endl;
+                return -1;
+            }
+        } else if (arg == "--square" && hasValue) {
+            pattern.squareLength = (float) atof(argv[++i]);
+        } else if (arg == "--marker" && hasValue) {
+            pattern.markerLength = (float) atof(argv[++i]);
+        } else if (arg == "--dictionary" && hasValue) {
+            pattern.dictionary = atoi(argv[++i]);
+        } else if (arg == "--output" && hasValue) {
+            output = argv[++i];
+        } else if (arg[0] != '-' && folder.empty()) {
+            folder = arg;
+        }
+    }
+    if (folder.empty()) {
+        cout << "Usage: OpenCVWithOpenGL calibrate FOLDER [options]" << endl;
+        cout << "Options:" << endl;
+        cout << "  --chessboard WxH      chessboard with WxH inner corners (default 9x6)" << endl;
+        cout << "  --charuco WxH         ChArUco board with WxH squares" << endl;
+        cout << "  --square S            side of a square, in scene units (default 1)" << endl;
+        cout << "  --marker M            side of a ChArUco marker (default 0.5)" << endl;
+        cout << "  --dictionary N        ArUco dictionary for ChArUco (default 0, DICT_4X4_50)" << endl;
+        cout << "  --output FILE         where to write the calibration (default camera.yml)" << endl;
+        return -1;
+    }
+
+    vector<String> names, files;
+    glob(folder + "/*", names, false);
+    for (size_t i = 0; i < names.size(); i++) {
+        if (isImageFile(names[i])) files.push_back(names[i]);
+    }
+    if (files.empty()) {
+        cout << "No images found in " << folder << endl;
+        return -1;
+    }
+
+    cout << "Finding the pattern in " << files.size() << " images, using "
+         << getNumThreads() << " threads" << endl;
+    int64 start = getTickCount();
+    CameraModel camera;
+    double rms = 0.0;
+    int used = calibrate(files, pattern, camera, rms);
+    double seconds = (getTickCount() - start) / getTickFrequency();
+    if (used < 3) {
+        cout << "The pattern was found in only " << used << " images; at least 3 are needed" << endl;
+        return -1;
+    }
+
+    cout << "Calibrated from " << used << " images in " << seconds << " s, RMS error "
+         << rms << " pixels" << endl;
+    if (!camera.save(output, rms)) {
+        cout << "Unable to write " << output << endl;
+        return -1;
+    }
+    cout << "Wrote " << output << endl;
+    return 0;
+}
@@ -0,0 +1,53 @@
+/*
+ * Camera calibration for OpenCV with OpenGL
+ *
+ * Finds the corners of a chessboard or ChArUco board in a folder of
+ * images, and computes the camera intrinsics with calibrateCamera.
+ * Corner detection is by far the slowest part, so the images are
+ * processed in parallel, across all cores.
+ *
+ * Usage:
+ *   OpenCVWithOpenGL calibrate FOLDER [options]
+ */
+
+#ifndef CALIBRATION_H
+#define CALIBRATION_H
+
+#include <opencv2/core/core.hpp>
+#include <vector>
+#include "camera.h"
+
+/**
+ * The pattern printed on the calibration target.
+ */
+struct CalibrationPattern {
+    enum Type { CHESSBOARD, CHARUCO };
+    Type type;
+    cv::Size size;          // inner corners (chessboard) or squares (ChArUco)
+    float squareLength;     // side of a square, in scene units
+    float markerLength;     // side of a marker (ChArUco only)
+    int dictionary;         // ArUco dictionary (ChArUco only)
+
+    CalibrationPattern();
+};
+
+/**
+ * Calibrate a camera from a set of images of the pattern.
+ * @param files the image files
+ * @param pattern the calibration pattern
+ * @param camera receives the camera intrinsics
+ * @param rms receives the RMS reprojection error, in pixels
+ * @return the number of images in which the pattern was found (calibration needs at least 3)
+ */
+int calibrate(const std::vector<cv::String> &files, const CalibrationPattern &pattern,
+              CameraModel &camera, double &rms);
+
+/**
+ * Run the calibrate subcommand.
+ * @param argc the number of arguments after "calibrate"
+ * @param argv the arguments after "calibrate"
+ * @return the program exit code
+ */
+int calibrateCommand(int argc, char *argv[]);
+
+#endif // CALIBRATION_H
@@ -0,0 +1,89 @@
+/*
+ * Camera model for OpenCV with OpenGL
+ * See camera.h for an overview.
+ */
+
+#include "camera.h"
+using namespace cv;
+
+CameraModel::CameraModel() : calibrated(false) {
+}
+
+CameraModel CameraModel::guess(Size size) {
+    CameraModel c;
+    double f = size.width;
+    c.cameraMatrix = (Mat_<double>(3, 3) << f, 0, size.width * 0.5,
+                                            0, f, size.height * 0.5,
+                                            0, 0, 1);
+    c.distCoeffs = Mat::zeros(1, 5, CV_64F);
+    c.imageSize = size;
+    c.calibrated = false;
+    return c;
+}
+
+bool CameraModel::load(const String &file) {
+    FileStorage fs(file, FileStorage::READ);
+    if (!fs.isOpened()) return false;
+
+    Mat k, d;
+    int w = 0, h = 0;
+    fs["camera_matrix"] >> k;
+    fs["distortion_coefficients"] >> d;
+    fs["image_width"] >> w;
+    fs["image_height"] >> h;
+    if (k.rows != 3 || k.cols != 3 || w <= 0 || h <= 0) return false;
+
+    k.convertTo(cameraMatrix, CV_64F);
+    if (d.empty()) {
+        distCoeffs = Mat::zeros(1, 5, CV_64F);
+    } else {
+        d.convertTo(distCoeffs, CV_64F);
+    }
+    imageSize = Size(w, h);
+    calibrated = true;
+    return true;
+}
+
+bool CameraModel::save(const String &file, double rms) const {
+    FileStorage fs(file, FileStorage::WRITE);
+    if (!fs.isOpened()) return false;
+    fs << "image_width" << imageSize.width;
+    fs << "image_height" << imageSize.height;
+    fs << "camera_matrix" << cameraMatrix;
+    fs << "distortion_coefficients" << distCoeffs;
+    fs << "reprojection_error" << rms;
+    return true;
+}
+
+CameraModel CameraModel::scaledTo(Size size) const {
+    CameraModel c = *this;
+    if (size == imageSize || imageSize.area() == 0) return c;
+
+    double sx = (double) size.width / imageSize.width;
+    double sy = (double) size.height / imageSize.height;
+    c.cameraMatrix = cameraMatrix.clone();
+    c.cameraMatrix.at<double>(0, 0) *= sx;
+    c.cameraMatrix.at<double>(0, 2) *= sx;
+    c.cameraMatrix.at<double>(1, 1) *= sy;
+    c.cameraMatrix.at<double>(1, 2) *= sy;
+    c.imageSize = size;
+    return c;
+}
+
+void CameraModel::glProjection(double zNear, double zFar, double m[16]) const {
+    double fx = cameraMatrix.at<double>(0, 0);
+    double fy = cameraMatrix.at<double>(1, 1);
+    double cx = cameraMatrix.at<double>(0, 2);
+    double cy = cameraMatrix.at<double>(1, 2);
+    double w = imageSize.width;
+    double h = imageSize.height;
+
+    for (int i = 0; i < 16; i++) m[i] = 0.0;
+    m[0] = 2.0 * fx / w;
+    m[5] = 2.0 * fy / h;
+    m[8] = 1.0 - 2.0 * cx / w;      // image x grows to the right, as in OpenGL
+    m[9] = 2.0 * cy / h - 1.0;      // image y grows downward, unlike OpenGL
+    m[10] = -(zFar + zNear) / (zFar - zNear);
+    m[11] = -1.0;
+    m[14] = -2.0 * zFar * zNear / (zFar - zNear);
+}
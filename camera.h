@@ -0,0 +1,66 @@
+/*
+ * Camera model for OpenCV with OpenGL
+ *
+ * Holds the intrinsic parameters of the camera that captured the frames,
+ * and converts them into an OpenGL projection matrix, so 3D content lines
+ * up with the markers in the image.
+ */
+
+#ifndef CAMERA_H
+#define CAMERA_H
+
+#include <opencv2/core/core.hpp>
+
+/**
+ * Intrinsic camera parameters, as produced by cv::calibrateCamera.
+ */
+struct CameraModel {
+    cv::Mat cameraMatrix;   // 3x3, CV_64F
+    cv::Mat distCoeffs;     // 1x5, CV_64F
+    cv::Size imageSize;     // size of the images used for calibration
+    bool calibrated;        // false if the parameters are only a guess
+
+    CameraModel();
+
+    /**
+     * Guess the parameters of an uncalibrated camera: a focal length
+     * about equal to the image width (roughly a 53 degree field of view),
+     * the principal point at the center, and no distortion.
+     * @param size the size of the images
+     */
+    static CameraModel guess(cv::Size size);
+
+    /**
+     * Load the parameters from a file written by save() (YAML or XML).
+     * @param file the file name
+     * @return false if the file could not be read
+     */
+    bool load(const cv::String &file);
+
+    /**
+     * Save the parameters to a file, in the format read by load().
+     * @param file the file name (.yml or .xml)
+     * @param rms the reprojection error from calibration, recorded for reference
+     * @return false if the file could not be written
+     */
+    bool save(const cv::String &file, double rms = 0.0) const;
+
+    /**
+     * Adjust the parameters for images of a different resolution
+     * (with the same aspect ratio) than the calibration images.
+     * @param size the new image size
+     */
+    CameraModel scaledTo(cv::Size size) const;
+
+    /**
+     * Compute an OpenGL projection matrix matching the camera.
+     * The matrix expects eye coordinates in OpenGL convention (y up, looking
+     * down -z); see Pose::glModelview for converting OpenCV poses.
+     * @param zNear the near clipping plane
+     * @param zFar the far clipping plane
+     * @param m receives the matrix, in column-major order (for glLoadMatrixd)
+     */
+    void glProjection(double zNear, double zFar, double m[16]) const;
+};
+
+#endif // CAMERA_H
@@ -0,0 +1,121 @@
+/*
+ * Culling of hidden objects for OpenCV with OpenGL
+ * See culling.h for an overview.
+ */
+
+#include "culling.h"
+#include "glprocs.h"
+#include <cmath>
+using namespace std;
+
+bool sphereInFrustum(const double projection[16], const double modelview[16],
+                     const float center[3], float radius) {
+    // The planes of the view volume, in model coordinates, are sums and
+    // differences of the rows of projection * modelview (Gribb and
+    // Hartmann); the fourth row is the w of clip space
+    double clip[16];
+    for (int col = 0; col < 4; col++) {
+        for (int row = 0; row < 4; row++) {
+            double sum = 0.0;
+            for (int k = 0; k < 4; k++) sum += projection[k * 4 + row] * modelview[col * 4 + k];
+            clip[col * 4 + row] = sum;
+        }
+    }
+    for (int i = 0; i < 6; i++) {
+        int row = i / 2;
+        double sign = (i % 2) ? -1.0 : 1.0;
+        double plane[4];
+        for (int col = 0; col < 4; col++) plane[col] = clip[col * 4 + 3] + sign * clip[col * 4 + row];
+        double len = sqrt(plane[0] * plane[0] + plane[1] * plane[1] + plane[2] * plane[2]);
+        if (len == 0.0) continue;
+        double distance = (plane[0] * center[0] + plane[1] * center[1] + plane[2] * center[2] + plane[3]) / len;
+        if (distance < -radius) return false;
+    }
+    return true;
+}
+
+/**
+ * Draw a cube, centered on a point.
+ */
+static void drawBox(const float center[3], float half) {
+    static const int faces[6][4] = {
+        { 0, 1, 3, 2 }, { 4, 6, 7, 5 }, { 0, 4, 5, 1 },
+        { 2, 3, 7, 6 }, { 0, 2, 6, 4 }, { 1, 5, 7, 3 }
+    };
+    glBegin(GL_QUADS);
+    for (int f = 0; f < 6; f++) {
+        for (int k = 0; k < 4; k++) {
+            int c = faces[f][k];
+            glVertex3f(center[0] + ((c & 1) ? half : -half),
+                       center[1] + ((c & 2) ? half : -half),
+                       center[2] + ((c & 4) ? half : -half));
+        }
+    }
+    glEnd();
+}
+
+OcclusionCuller::OcclusionCuller() : hidden(0) {}
+
+bool OcclusionCuller::begin(int id, const float center[3], float radius) {
+    if (id < 0) return true;
+    if ((size_t) id >= objects.size()) {
+        Object o = { 0, false, false, true };
+        objects.resize(id + 1, o);
+    }
+    Object &o = objects[id];
+    if (o.query == 0) glGenQueries(1, &o.query);
+
+    // Read last frame's answer, if it is ready; otherwise go on as before,
+    // without a new query
+    if (o.pending) {
+        GLint available = 0;
+        glGetQueryObjectiv(o.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            if (!o.visible) hidden++;
+            return o.visible;
+        }
+        GLuint samples = 0;
+        glGetQueryObjectuiv(o.query, GL_QUERY_RESULT, &samples);
+        o.visible = samples > 0;
+        o.pending = false;
+    }
+
+    o.pending = true;
+    if (o.visible) {
+        glBeginQuery(GL_SAMPLES_PASSED, o.query);
+        o.active = true;
+        return true;
+    }
+
+    // Test the box around the sphere, without drawing it
+    glPushAttrib(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_ENABLE_BIT | GL_POLYGON_BIT);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    glDisable(GL_LIGHTING);
+    glDisable(GL_CULL_FACE);
+    glBeginQuery(GL_SAMPLES_PASSED, o.query);
+    drawBox(center, radius);
+    glEndQuery(GL_SAMPLES_PASSED);
+    glPopAttrib();
+    hidden++;
+    return false;
+}
+
+void OcclusionCuller::end(int id) {
+    if (id < 0 || (size_t) id >= objects.size() || !objects[id].active) return;
+    glEndQuery(GL_SAMPLES_PASSED);
+    objects[id].active = false;
+}
+
+void OcclusionCuller::release() {
+    for (size_t i = 0; i < objects.size(); i++) {
+        if (objects[i].query) glDeleteQueries(1, &objects[i].query);
+    }
+    objects.clear();
+}
+
+int OcclusionCuller::takeHiddenCount() {
+    int n = hidden;
+    hidden = 0;
+    return n;
+}
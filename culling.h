@@ -0,0 +1,103 @@
+/*
+ * Culling of hidden objects for OpenCV with OpenGL
+ *
+ * Objects are skipped, rather than drawn and then clipped or hidden, when
+ * they cannot be seen:
+ * - Frustum culling tests a bounding sphere against the six planes of the
+ *   view volume, on the CPU, before anything is sent to OpenGL.
+ * - Occlusion culling asks OpenGL (with a query) how many pixels of an
+ *   object passed the depth and stencil tests.  The answer is read a frame
+ *   later, so the CPU never waits for the GPU; an object found hidden is
+ *   replaced by an invisible box, whose own query tells when it comes back
+ *   into view.  Since the real foreground is written to the depth and
+ *   stencil buffers first (see occlusion.h), an object behind a hand is
+ *   culled as well as one behind another object.
+ * - Drawing objects nearest first makes both pay more: farther objects
+ *   fail the depth test early, pixel by pixel, and their queries find them
+ *   hidden more often.
+ */
+
+#ifndef CULLING_H
+#define CULLING_H
+
+#include <algorithm>
+#include <vector>
+
+/**
+ * Test a sphere against the view volume.
+ * @param projection the projection matrix, column-major as in OpenGL
+ * @param modelview the modelview matrix of the object
+ * @param center the center of the sphere, in model units
+ * @param radius the radius of the sphere, in model units
+ * @return false if the sphere is entirely outside the view volume
+ */
+bool sphereInFrustum(const double projection[16], const double modelview[16],
+                     const float center[3], float radius);
+
+/**
+ * @param modelview the modelview matrix of an object
+ * @return the distance of its origin in front of the camera
+ */
+inline double viewDepth(const double modelview[16]) {
+    return -modelview[14];
+}
+
+/**
+ * Orders draws by their depth member, nearest first.
+ */
+struct NearestFirst {
+    template <class Draw> bool operator()(const Draw &a, const Draw &b) const { return a.depth < b.depth; }
+};
+
+/**
+ * Sort draws nearest first.
+ * @param first the first draw; each has a member depth, from viewDepth()
+ * @param last past the last draw
+ */
+template <class Iterator> void sortNearestFirst(Iterator first, Iterator last) {
+    std::sort(first, last, NearestFirst());
+}
+
+class OcclusionCuller {
+public:
+    OcclusionCuller();
+
+    /**
+     * Start an object.  If it was visible at the last answer, a query is
+     * started around drawing it; if not, its bounding box is drawn
+     * invisibly, in a query, instead.  Requires OpenGL 1.5.
+     * @param id a number for the object, the same every frame
+     * @param center the center of its bounding sphere, in model units
+     * @param radius the radius of its bounding sphere, in model units
+     * @return true if the object should be drawn, and then end() called
+     */
+    bool begin(int id, const float center[3], float radius);
+
+    /**
+     * Finish an object that begin() said to draw.
+     * @param id the number for the object
+     */
+    void end(int id);
+
+    /**
+     * Delete the queries.  Requires the context they were created in.
+     */
+    void release();
+
+    /**
+     * @return the number of objects skipped since the last call
+     */
+    int takeHiddenCount();
+
+private:
+    struct Object {
+        unsigned int query;     // OpenGL query name
+        bool pending;           // a query has been issued, and not yet read
+        bool active;            // a query is open around drawing the object
+        bool visible;           // what the last answer was
+    };
+    std::vector<Object> objects;
+    int hidden;
+};
+
+#endif // CULLING_H
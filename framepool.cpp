@@ -0,0 +1,115 @@
+/*
+ * Frame buffers for OpenCV with OpenGL
+ * See framepool.h for an overview.
+ */
+
+#include "framepool.h"
+#include <chrono>
+using namespace cv;
+using namespace std;
+
+// The buffer acquire() took for the Mat it is creating, on this thread;
+// allocate(), called by Mat::create(), puts it in the Mat
+static thread_local const FramePool *promisedBy = 0;
+static thread_local void *promised = 0;
+
+FramePool *FramePool::create(int count, Size size, int type) {
+    return new FramePool(count, size, type);
+}
+
+FramePool::FramePool(int count, Size size, int type)
+    : size(size), type(type), outstanding(0), retired(false) {
+    bufferBytes = (size_t) size.width * size.height * CV_ELEM_SIZE(type);
+    for (int i = 0; i < count; i++) freeBuffers.push_back(fastMalloc(bufferBytes));
+}
+
+FramePool::~FramePool() {
+    for (size_t i = 0; i < freeBuffers.size(); i++) fastFree(freeBuffers[i]);
+}
+
+bool FramePool::acquire(Mat &frame, double timeout) {
+    frame.release();
+    {
+        unique_lock<mutex> guard(lock);
+        if (timeout < 0.0) {
+            while (freeBuffers.empty()) returned.wait(guard);
+        } else {
+            chrono::duration<double> wait(timeout);
+            if (!returned.wait_for(guard, wait, [this] { return !freeBuffers.empty(); })) return false;
+        }
+        promised = freeBuffers.back();
+        freeBuffers.pop_back();
+        outstanding++;
+    }
+    promisedBy = this;
+    frame.allocator = this;
+    frame.create(size, type);
+    return true;
+}
+
+int FramePool::available() {
+    lock_guard<mutex> guard(lock);
+    return (int) freeBuffers.size();
+}
+
+void FramePool::retire() {
+    bool last;
+    {
+        lock_guard<mutex> guard(lock);
+        retired = true;
+        for (size_t i = 0; i < freeBuffers.size(); i++) fastFree(freeBuffers[i]);
+        freeBuffers.clear();
+        last = outstanding == 0;
+    }
+    if (last) delete this;
+}
+
+UMatData *FramePool::allocate(int dims, const int *sizes, int t, void *data0, size_t *step,
+                              int flags, UMatUsageFlags usageFlags) const {
+    // Anything but the buffer acquire() took (say, a frame of another size
+    // decoded into a pooled Mat) goes to OpenCV's own allocator, so that it
+    // never refers to the pool, which may be gone before it is released
+    void *data = promisedBy == this && !data0 ? promised : 0;
+    promisedBy = 0;
+    promised = 0;
+    if (!data) return Mat::getStdAllocator()->allocate(dims, sizes, t, data0, step, flags, usageFlags);
+
+    // The layout, as cv::Mat's standard allocator computes it
+    size_t total = CV_ELEM_SIZE(t);
+    for (int i = dims - 1; i >= 0; i--) {
+        if (step) step[i] = total;
+        total *= sizes[i];
+    }
+    CV_Assert(total <= bufferBytes);
+
+    UMatData *u = new UMatData(this);
+    u->data = u->origdata = static_cast<uchar *>(data);
+    u->size = total;
+    return u;
+}
+
+bool FramePool::allocate(UMatData *u, int /*accessFlags*/, UMatUsageFlags /*usageFlags*/) const {
+    return u != 0;
+}
+
+void FramePool::deallocate(UMatData *u) const {
+    if (!u) return;
+    CV_Assert(u->urefcount == 0 && u->refcount == 0);
+
+    // Only the pool's own buffers are allocated here
+    bool last = false;
+    if (u->origdata) {
+        lock_guard<mutex> guard(lock);
+        outstanding--;
+        if (retired) {
+            fastFree(u->origdata);
+            last = outstanding == 0;
+        } else {
+            freeBuffers.push_back(u->origdata);
+            returned.notify_one();
+        }
+        u->origdata = 0;
+    }
+    delete u;
+    if (last) delete this;
+}
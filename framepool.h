@@ -0,0 +1,74 @@
+/*
+ * Frame buffers for OpenCV with OpenGL
+ *
+ * A fixed number of image buffers, all the same size, handed out as
+ * cv::Mats.  A Mat is already a reference-counted handle, so a frame is
+ * passed from stage to stage (decoding, detection, texture upload) by
+ * assigning the Mat, never by copying the pixels; the pool is the Mat's
+ * allocator, so when the last stage lets go of the frame, its buffer goes
+ * back to the pool rather than to the heap.  A stage that needs a buffer
+ * while all of them are out waits for one to come back, which also keeps
+ * a fast producer from running too far ahead.
+ */
+
+#ifndef FRAMEPOOL_H
+#define FRAMEPOOL_H
+
+#include <opencv2/core/core.hpp>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+class FramePool : public cv::MatAllocator {
+public:
+    /**
+     * Allocate the buffers.  The pool lives until retire() is called and
+     * the last of its frames is released.
+     * @param count the number of buffers
+     * @param size the size of each image
+     * @param type the type of each image, e.g. CV_8UC3
+     */
+    static FramePool *create(int count, cv::Size size, int type);
+
+    /**
+     * Give a Mat a buffer from the pool.  The Mat's previous contents are
+     * released first, so a frame can be exchanged for a fresh one.
+     * @param frame receives the image; its pixels are undefined
+     * @param timeout the most seconds to wait for a buffer; negative to wait as long as it takes
+     * @return false if no buffer came back in time
+     */
+    bool acquire(cv::Mat &frame, double timeout = -1.0);
+
+    /**
+     * @return the number of buffers not in use
+     */
+    int available();
+
+    /**
+     * Give up the pool: its buffers are freed as they come back, and the
+     * pool itself with the last of them.  Do not use it afterwards.
+     */
+    void retire();
+
+    cv::UMatData *allocate(int dims, const int *sizes, int type, void *data, size_t *step,
+                           int flags, cv::UMatUsageFlags usageFlags) const;
+    bool allocate(cv::UMatData *u, int accessFlags, cv::UMatUsageFlags usageFlags) const;
+    void deallocate(cv::UMatData *u) const;
+
+private:
+    FramePool(int count, cv::Size size, int type);
+    ~FramePool();
+    FramePool(const FramePool &);
+    FramePool &operator=(const FramePool &);
+
+    cv::Size size;
+    int type;
+    size_t bufferBytes;
+    mutable std::vector<void *> freeBuffers;
+    mutable int outstanding;                // buffers in use
+    mutable bool retired;
+    mutable std::mutex lock;
+    mutable std::condition_variable returned;
+};
+
+#endif // FRAMEPOOL_H
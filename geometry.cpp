@@ -0,0 +1,261 @@
+/*
+ * Geometry for OpenCV with OpenGL
+ * See geometry.h for an overview.
+ */
+
+#include "geometry.h"
+#include <GL/gl.h>
+
+/**
+ * Give the gem's triangles to a sink, with normal() and vertex() calls in
+ * the order of glNormal3f() and glVertex3f(), so the same data can be
+ * drawn by OpenGL or collected into a mesh.
+ */
+template <class Sink> static void emitGem(Sink &out) {
+    out.normal(-0.22663, -0.84565, -0.48323);
+    out.vertex( 0.0,    0.0,    0.0 ); // ABC (triangles)
+    out.vertex( 0.0,   -1.0,    1.75);
+    out.vertex(-0.5,   -0.866,  1.75);
+    out.normal(-0.61907, -0.61907, -0.48323);
+    out.vertex( 0.0,    0.0,    0.0 ); // ACD
+    out.vertex(-0.5,   -0.866,  1.75);
+    out.vertex(-0.866, -0.5,    1.75);
+    out.normal(-0.84565, -0.22663, -0.48323);
+    out.vertex( 0.0,    0.0,    0.0 ); // ADE
+    out.vertex(-0.866, -0.5,    1.75);
+    out.vertex(-1.0,    0.0,    1.75);
+    out.normal(-0.84565, 0.22663, -0.48323);
+    out.vertex( 0.0,    0.0,    0.0 ); // AEF
+    out.vertex(-1.0,    0.0,    1.75);
+    out.vertex(-0.866,  0.5,    1.75);
+    out.normal(-0.61907, 0.61907, -0.48323);
+    out.vertex( 0.0,    0.0,    0.0 ); // AFG
+    out.vertex(-0.866,  0.5,    1.75);
+    out.vertex(-0.5,    0.866,  1.75);
+    out.normal(-0.22663, 0.84565, -0.48323);
+    out.vertex( 0.0,    0.0,    0.0 ); // AGH
+    out.vertex(-0.5,    0.866,  1.75);
+    out.vertex( 0.0,    1.0,    1.75);
+    out.normal(0.22663, 0.84565, -0.48323);
+    out.vertex( 0.0,    0.0,    0.0 ); // AHI
+    out.vertex( 0.0,    1.0,    1.75);
+    out.vertex( 0.5,    0.866,  1.75);
+    out.normal(0.61907, 0.61907, -0.48323);
+    out.vertex( 0.0,    0.0,    0.0 ); // AIJ
+    out.vertex( 0.5,    0.866,  1.75);
+    out.vertex( 0.866,  0.5,    1.75);
+    out.normal(0.84565, 0.22663, -0.48323);
+    out.vertex( 0.0,    0.0,    0.0 ); // AJK
+    out.vertex( 0.866,  0.5,    1.75);
+    out.vertex( 1.0,    0.0,    1.75);
+    out.normal(0.84565, -0.22663, -0.48323);
+    out.vertex( 0.0,    0.0,    0.0 ); // AKL
+    out.vertex( 1.0,    0.0,    1.75);
+    out.vertex( 0.866, -0.5,    1.75);
+    out.normal(0.61907, -0.61907, -0.48323);
+    out.vertex( 0.0,    0.0,    0.0 ); // ALM
+    out.vertex( 0.866, -0.5,    1.75);
+    out.vertex( 0.5,   -0.866,  1.75);
+    out.normal(0.22663, -0.84565, -0.48323);
+    out.vertex( 0.0,    0.0,    0.0 ); // AMB
+    out.vertex( 0.5,   -0.866,  1.75);
+    out.vertex( 0.0,   -1.0,    1.75);
+    out.normal(-0.18619, -0.69474, 0.69474);
+
+    out.vertex(-0.5,   -0.866,  1.75); // CBNO (quads, as triangles)
+    out.vertex( 0.0,   -1.0,    1.75);
+    out.vertex( 0.0,   -0.75,   2.0 );
+    out.vertex(-0.5,   -0.866,  1.75);
+    out.vertex( 0.0,   -0.75,   2.0 );
+    out.vertex(-0.375, -0.6495, 2.0 );
+    out.normal(-0.50589, -0.50589, 0.69474);
+    out.vertex(-0.866, -0.5,    1.75); // DCOP
+    out.vertex(-0.5,   -0.866,  1.75);
+    out.vertex(-0.375, -0.6495, 2.0 );
+    out.vertex(-0.866, -0.5,    1.75);
+    out.vertex(-0.375, -0.6495, 2.0 );
+    out.vertex(-0.6495, -0.375, 2.0 );
+    out.normal(-0.69474, -0.18619, 0.69474);
+    out.vertex(-1.0,    0.0,    1.75); // EDPQ
+    out.vertex(-0.866, -0.5,    1.75);
+    out.vertex(-0.6495, -0.375, 2.0 );
+    out.vertex(-1.0,    0.0,    1.75);
+    out.vertex(-0.6495, -0.375, 2.0 );
+    out.vertex(-0.75,   0.0,    2.0 );
+    out.normal(-0.69474, 0.18619, 0.69474);
+    out.vertex(-0.866,  0.5,    1.75); // FEQR
+    out.vertex(-1.0,    0.0,    1.75);
+    out.vertex(-0.75,   0.0,    2.0 );
+    out.vertex(-0.866,  0.5,    1.75);
+    out.vertex(-0.75,   0.0,    2.0 );
+    out.vertex(-0.6495, 0.375,  2.0 );
+    out.normal(-0.50589, 0.50589, 0.69474);
+    out.vertex(-0.5,    0.866,  1.75); // GFRS
+    out.vertex(-0.866,  0.5,    1.75);
+    out.vertex(-0.6495, 0.375,  2.0 );
+    out.vertex(-0.5,    0.866,  1.75);
+    out.vertex(-0.6495, 0.375,  2.0 );
+    out.vertex(-0.375,  0.6495, 2.0 );
+    out.normal(-0.18619, 0.69474, 0.69474);
+    out.vertex( 0.0,    1.0,    1.75); // HGST
+    out.vertex(-0.5,    0.866,  1.75);
+    out.vertex(-0.375,  0.6495, 2.0 );
+    out.vertex( 0.0,    1.0,    1.75);
+    out.vertex(-0.375,  0.6495, 2.0 );
+    out.vertex( 0.0,    0.75,   2.0 );
+    out.normal(0.18619, 0.69474, 0.69474);
+    out.vertex( 0.5,    0.866,  1.75); // IHTU
+    out.vertex( 0.0,    1.0,    1.75);
+    out.vertex( 0.0,    0.75,   2.0 );
+    out.vertex( 0.5,    0.866,  1.75);
+    out.vertex( 0.0,    0.75,   2.0 );
+    out.vertex( 0.375,  0.6495, 2.0 );
+    out.normal(0.50589, 0.50589, 0.69474);
+    out.vertex( 0.866,  0.5,    1.75); // JIUV
+    out.vertex( 0.5,    0.866,  1.75);
+    out.vertex( 0.375,  0.6495, 2.0 );
+    out.vertex( 0.866,  0.5,    1.75);
+    out.vertex( 0.375,  0.6495, 2.0 );
+    out.vertex( 0.6495, 0.375,  2.0 );
+    out.normal(0.69474, 0.18619, 0.69474);
+    out.vertex( 1.0,    0.0,    1.75); // KJVW
+    out.vertex( 0.866,  0.5,    1.75);
+    out.vertex( 0.6495, 0.375,  2.0 );
+    out.vertex( 1.0,    0.0,    1.75);
+    out.vertex( 0.6495, 0.375,  2.0 );
+    out.vertex( 0.75,   0.0,    2.0 );
+    out.normal(0.69474, -0.18619, 0.69474);
+    out.vertex( 0.866, -0.5,    1.75); // LKWX
+    out.vertex( 1.0,    0.0,    1.75);
+    out.vertex( 0.75,   0.0,    2.0 );
+    out.vertex( 0.866, -0.5,    1.75);
+    out.vertex( 0.75,   0.0,    2.0 );
+    out.vertex( 0.6495, -0.375, 2.0 );
+    out.normal(0.50589, -0.50589, 0.69474);
+    out.vertex( 0.5,   -0.866,  1.75); // MLXY
+    out.vertex( 0.866, -0.5,    1.75);
+    out.vertex( 0.6495, -0.375, 2.0 );
+    out.vertex( 0.5,   -0.866,  1.75);
+    out.vertex( 0.6495, -0.375, 2.0 );
+    out.vertex( 0.375, -0.6495, 2.0 );
+    out.normal(0.18619, -0.69474, 0.69474);
+    out.vertex( 0.0,   -1.0,    1.75); // BMYN
+    out.vertex( 0.5,   -0.866,  1.75);
+    out.vertex( 0.375, -0.6495, 2.0 );
+    out.vertex( 0.0,   -1.0,    1.75);
+    out.vertex( 0.375, -0.6495, 2.0 );
+    out.vertex( 0.0,   -0.75,   2.0 );
+
+    out.normal( 0.0,    0.0,    1.0 ); // polygon NOPQRSTUVWXY (as triangles)
+    out.vertex( 0.375, -0.65,   2.0 ); // YXW
+    out.vertex( 0.65,  -0.375,  2.0 );
+    out.vertex( 0.75,   0.0,    2.0 );
+    out.vertex( 0.375, -0.65,   2.0 ); // YWV
+    out.vertex( 0.75,   0.0,    2.0 );
+    out.vertex( 0.65,   0.375,  2.0 );
+    out.vertex( 0.375, -0.65,   2.0 ); // YVU
+    out.vertex( 0.65,   0.375,  2.0 );
+    out.vertex( 0.375,  0.65,   2.0 );
+    out.vertex( 0.375, -0.65,   2.0 ); // YUT
+    out.vertex( 0.375,  0.65,   2.0 );
+    out.vertex( 0.0,    0.75,   2.0 );
+    out.vertex( 0.375, -0.65,   2.0 ); // YTS
+    out.vertex( 0.0,    0.75,   2.0 );
+    out.vertex(-0.375,  0.65,   2.0 );
+    out.vertex( 0.375, -0.65,   2.0 ); // YSR
+    out.vertex(-0.375,  0.65,   2.0 );
+    out.vertex(-0.65,   0.375,  2.0 );
+    out.vertex( 0.375, -0.65,   2.0 ); // YRQ
+    out.vertex(-0.65,   0.375,  2.0 );
+    out.vertex(-0.75,   0.0,    2.0 );
+    out.vertex( 0.375, -0.65,   2.0 ); // YQP
+    out.vertex(-0.75,   0.0,    2.0 );
+    out.vertex(-0.65,  -0.375,  2.0 );
+    out.vertex( 0.375, -0.65,   2.0 ); // YPO
+    out.vertex(-0.65,  -0.375,  2.0 );
+    out.vertex(-0.375, -0.65,   2.0 );
+    out.vertex( 0.375, -0.65,   2.0 ); // YON
+    out.vertex(-0.375, -0.65,   2.0 );
+    out.vertex( 0.0,   -0.75,   2.0 );
+}
+
+/**
+ * Passes the gem to OpenGL, in immediate mode.
+ */
+struct GLSink {
+    void normal(GLfloat x, GLfloat y, GLfloat z) { glNormal3f(x, y, z); }
+    void vertex(GLfloat x, GLfloat y, GLfloat z) { glVertex3f(x, y, z); }
+};
+
+/**
+ * Collects the gem into a mesh, one vertex per corner of each triangle.
+ */
+struct MeshSink {
+    Mesh &mesh;
+    float n[3];
+
+    MeshSink(Mesh &mesh) : mesh(mesh) {}
+    void normal(float x, float y, float z) {
+        n[0] = x;
+        n[1] = y;
+        n[2] = z;
+    }
+    void vertex(float x, float y, float z) {
+        mesh.indices.push_back((uint32_t) mesh.vertexCount());
+        mesh.positions.push_back(x);
+        mesh.positions.push_back(y);
+        mesh.positions.push_back(z);
+        mesh.normals.insert(mesh.normals.end(), n, n + 3);
+    }
+};
+
+void drawGem() {
+    GLSink sink;
+    glBegin(GL_TRIANGLES);
+    emitGem(sink);
+    glEnd();
+}
+
+void gemMesh(Mesh &mesh) {
+    mesh.positions.clear();
+    mesh.normals.clear();
+    mesh.indices.clear();
+    MeshSink sink(mesh);
+    emitGem(sink);
+}
+
+void gemBounds(float c[3], float &r) {
+    // The gem is 2 units tall: its point at the origin, its widest ring
+    // (radius 1) at z = 1.75, and a narrower top at z = 2.  The smallest
+    // sphere through the point and the widest ring also holds the top.
+    c[0] = c[1] = 0.0f;
+    c[2] = 1.161f;
+    r = 1.162f;
+}
+
+void setupLighting() {
+    GLfloat mat_ambient[] = { 0.1, 0.1, 0.8, 1.0 };
+    GLfloat mat_specular[] = { 0.8, 0.8, 1.0, 1.0 };
+    GLfloat mat_shininess[] = { 50.0 };
+    GLfloat light_position[] = { 1.0, 1.0, 1.0, 0.0 };
+    GLfloat model_ambient[] = { 0.5, 0.5, 0.5, 1.0 };
+    glMaterialfv(GL_FRONT, GL_AMBIENT, mat_ambient);
+    glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
+    glMaterialfv(GL_FRONT, GL_SHININESS, mat_shininess);
+    glLightfv(GL_LIGHT0, GL_POSITION, light_position);
+    glLightModelfv(GL_LIGHT_MODEL_AMBIENT, model_ambient);
+    glEnable(GL_LIGHT0);
+}
+
+void drawBackground() {
+    glBegin(GL_QUADS);
+        glTexCoord2f(0.0, 0.0);
+        glVertex3f(-2.0, 2.0, 0.0);
+        glTexCoord2f(0.0, 1.0);
+        glVertex3f(-2.0, -2.0, 0.0);
+        glTexCoord2f(1.0, 1.0);
+        glVertex3f(2.0, -2.0, 0.0);
+        glTexCoord2f(1.0, 0.0);
+        glVertex3f(2.0, 2.0, 0.0);
+    glEnd();
+}
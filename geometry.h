@@ -0,0 +1,48 @@
+/*
+ * Geometry for OpenCV with OpenGL
+ *
+ * The primitives of the scene, in immediate mode, so they can be compiled
+ * into display lists by the program, and drawn by the benchmarks.  The gem
+ * is also available as a mesh, for the software renderer.
+ */
+
+#ifndef GEOMETRY_H
+#define GEOMETRY_H
+
+#include "mesh.h"
+
+/**
+ * Draw the gem: a cut stone with 12 facets around, 2 units across, with
+ * its point at the origin and its flat top at z = 2.
+ */
+void drawGem();
+
+/**
+ * Get the gem as a mesh: the same triangles as drawGem(), with a vertex
+ * for each corner, carrying the normal of its facet.
+ * @param mesh receives the gem
+ */
+void gemMesh(Mesh &mesh);
+
+/**
+ * Get a sphere around the gem, for culling.
+ * @param c set to the center
+ * @param r set to the radius
+ */
+void gemBounds(float c[3], float &r);
+
+/**
+ * Set up the gem's material and the light, as the window shows them: a
+ * blue, shiny material, with a directional light from the upper right
+ * front and a gray ambient light.  Enables the light, but not lighting.
+ */
+void setupLighting();
+
+/**
+ * Draw the rectangle for the background image: 4 units square, centered
+ * on the origin in the z = 0 plane, with texture coordinates that put the
+ * first row of the image at the top.
+ */
+void drawBackground();
+
+#endif // GEOMETRY_H
@@ -0,0 +1,92 @@
+/*
+ * OpenGL entry points for OpenCV with OpenGL
+ * See glprocs.h for an overview.
+ */
+
+#include "glprocs.h"
+#include <cstdint>
+
+#ifdef _WIN32
+
+PFNGLGENBUFFERSPROC glprocGenBuffers = 0;
+PFNGLBINDBUFFERPROC glprocBindBuffer = 0;
+PFNGLBUFFERDATAPROC glprocBufferData = 0;
+PFNGLDELETEBUFFERSPROC glprocDeleteBuffers = 0;
+PFNGLMAPBUFFERPROC glprocMapBuffer = 0;
+PFNGLUNMAPBUFFERPROC glprocUnmapBuffer = 0;
+PFNGLGENQUERIESPROC glprocGenQueries = 0;
+PFNGLDELETEQUERIESPROC glprocDeleteQueries = 0;
+PFNGLBEGINQUERYPROC glprocBeginQuery = 0;
+PFNGLENDQUERYPROC glprocEndQuery = 0;
+PFNGLGETQUERYIVPROC glprocGetQueryiv = 0;
+PFNGLGETQUERYOBJECTIVPROC glprocGetQueryObjectiv = 0;
+PFNGLGETQUERYOBJECTUIVPROC glprocGetQueryObjectuiv = 0;
+PFNGLFENCESYNCPROC glprocFenceSync = 0;
+PFNGLCLIENTWAITSYNCPROC glprocClientWaitSync = 0;
+PFNGLDELETESYNCPROC glprocDeleteSync = 0;
+PFNGLGETINTEGER64VPROC glprocGetInteger64v = 0;
+PFNGLQUERYCOUNTERPROC glprocQueryCounter = 0;
+PFNGLGETQUERYOBJECTUI64VPROC glprocGetQueryObjectui64v = 0;
+
+/**
+ * Looks up an entry point of the current context.
+ * @param name the function's name
+ * @param proc set to the function, or 0 if the context has none
+ * @return whether it was found
+ */
+template <typename T>
+static bool lookUp(const char *name, T &proc) {
+    // Some drivers answer 1, 2, 3 or -1, not 0, for a missing function
+    PROC found = wglGetProcAddress(name);
+    intptr_t value = (intptr_t) found;
+    if (value >= -1 && value <= 3) found = 0;
+    proc = (T) (void *) found;
+    return found != 0;
+}
+
+bool loadGLProcs() {
+    bool buffers = lookUp("glGenBuffers", glprocGenBuffers);
+    buffers = lookUp("glBindBuffer", glprocBindBuffer) && buffers;
+    buffers = lookUp("glBufferData", glprocBufferData) && buffers;
+    buffers = lookUp("glDeleteBuffers", glprocDeleteBuffers) && buffers;
+    buffers = lookUp("glMapBuffer", glprocMapBuffer) && buffers;
+    buffers = lookUp("glUnmapBuffer", glprocUnmapBuffer) && buffers;
+    buffers = lookUp("glGenQueries", glprocGenQueries) && buffers;
+    buffers = lookUp("glDeleteQueries", glprocDeleteQueries) && buffers;
+    buffers = lookUp("glBeginQuery", glprocBeginQuery) && buffers;
+    buffers = lookUp("glEndQuery", glprocEndQuery) && buffers;
+    buffers = lookUp("glGetQueryiv", glprocGetQueryiv) && buffers;
+    buffers = lookUp("glGetQueryObjectiv", glprocGetQueryObjectiv) && buffers;
+    buffers = lookUp("glGetQueryObjectuiv", glprocGetQueryObjectuiv) && buffers;
+    lookUp("glFenceSync", glprocFenceSync);
+    lookUp("glClientWaitSync", glprocClientWaitSync);
+    lookUp("glDeleteSync", glprocDeleteSync);
+    lookUp("glGetInteger64v", glprocGetInteger64v);
+    lookUp("glQueryCounter", glprocQueryCounter);
+    lookUp("glGetQueryObjectui64v", glprocGetQueryObjectui64v);
+    return buffers;
+}
+
+bool haveGLSync() {
+    return glprocFenceSync && glprocClientWaitSync && glprocDeleteSync && glprocGetInteger64v;
+}
+
+bool haveGLTimer() {
+    return haveGLSync() && glprocQueryCounter && glprocGetQueryObjectui64v;
+}
+
+#else
+
+bool loadGLProcs() {
+    return true;
+}
+
+bool haveGLSync() {
+    return true;
+}
+
+bool haveGLTimer() {
+    return true;
+}
+
+#endif
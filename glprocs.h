@@ -0,0 +1,91 @@
+/*
+ * OpenGL entry points for OpenCV with OpenGL
+ *
+ * Buffer objects and queries (OpenGL 1.5), sync objects (3.2) and
+ * timestamps (3.3) are past what Windows' opengl32 exports, which stops at
+ * OpenGL 1.1.  There, each is looked up at runtime once a context exists,
+ * and the names below stand for the pointers found; elsewhere the OpenGL
+ * library exports them, and this header only declares them.  Include it,
+ * in place of <GL/gl.h>, wherever they are called.
+ */
+
+#ifndef GLPROCS_H
+#define GLPROCS_H
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX                // keep std::min and std::max usable
+#endif
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#define GL_GLEXT_PROTOTYPES
+#endif
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+#ifdef _WIN32
+extern PFNGLGENBUFFERSPROC glprocGenBuffers;
+extern PFNGLBINDBUFFERPROC glprocBindBuffer;
+extern PFNGLBUFFERDATAPROC glprocBufferData;
+extern PFNGLDELETEBUFFERSPROC glprocDeleteBuffers;
+extern PFNGLMAPBUFFERPROC glprocMapBuffer;
+extern PFNGLUNMAPBUFFERPROC glprocUnmapBuffer;
+extern PFNGLGENQUERIESPROC glprocGenQueries;
+extern PFNGLDELETEQUERIESPROC glprocDeleteQueries;
+extern PFNGLBEGINQUERYPROC glprocBeginQuery;
+extern PFNGLENDQUERYPROC glprocEndQuery;
+extern PFNGLGETQUERYIVPROC glprocGetQueryiv;
+extern PFNGLGETQUERYOBJECTIVPROC glprocGetQueryObjectiv;
+extern PFNGLGETQUERYOBJECTUIVPROC glprocGetQueryObjectuiv;
+extern PFNGLFENCESYNCPROC glprocFenceSync;
+extern PFNGLCLIENTWAITSYNCPROC glprocClientWaitSync;
+extern PFNGLDELETESYNCPROC glprocDeleteSync;
+extern PFNGLGETINTEGER64VPROC glprocGetInteger64v;
+extern PFNGLQUERYCOUNTERPROC glprocQueryCounter;
+extern PFNGLGETQUERYOBJECTUI64VPROC glprocGetQueryObjectui64v;
+
+#define glGenBuffers glprocGenBuffers
+#define glBindBuffer glprocBindBuffer
+#define glBufferData glprocBufferData
+#define glDeleteBuffers glprocDeleteBuffers
+#define glMapBuffer glprocMapBuffer
+#define glUnmapBuffer glprocUnmapBuffer
+#define glGenQueries glprocGenQueries
+#define glDeleteQueries glprocDeleteQueries
+#define glBeginQuery glprocBeginQuery
+#define glEndQuery glprocEndQuery
+#define glGetQueryiv glprocGetQueryiv
+#define glGetQueryObjectiv glprocGetQueryObjectiv
+#define glGetQueryObjectuiv glprocGetQueryObjectuiv
+#define glFenceSync glprocFenceSync
+#define glClientWaitSync glprocClientWaitSync
+#define glDeleteSync glprocDeleteSync
+#define glGetInteger64v glprocGetInteger64v
+#define glQueryCounter glprocQueryCounter
+#define glGetQueryObjectui64v glprocGetQueryObjectui64v
+#endif
+
+/**
+ * Looks up the entry points, on Windows; elsewhere does nothing.  Call it
+ * with a context current, before any of them is used.
+ * @return whether the context has buffer objects and queries (OpenGL 1.5),
+ *         which the program needs
+ */
+bool loadGLProcs();
+
+/**
+ * @return whether sync objects (OpenGL 3.2) may be used; false only when
+ *         loadGLProcs() found them missing
+ */
+bool haveGLSync();
+
+/**
+ * @return whether timestamp queries (OpenGL 3.3) may be used; false only
+ *         when loadGLProcs() found them missing
+ */
+bool haveGLTimer();
+
+#endif
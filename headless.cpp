@@ -0,0 +1,121 @@
+/*
+ * Headless OpenGL context for OpenCV with OpenGL
+ * See headless.h for an overview.
+ */
+
+#include "headless.h"
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#include <cstring>
+
+/**
+ * Find a display that does not need a window system.  Prefer an EGL device
+ * (a GPU, or Mesa's software device), then Mesa's surfaceless platform,
+ * then whatever the default display is.
+ */
+static EGLDisplay headlessDisplay() {
+    const char *extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC) eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+    if (extensions && getPlatformDisplay) {
+        if (strstr(extensions, "EGL_EXT_platform_device")) {
+            PFNEGLQUERYDEVICESEXTPROC queryDevices =
+                (PFNEGLQUERYDEVICESEXTPROC) eglGetProcAddress("eglQueryDevicesEXT");
+            EGLDeviceEXT devices[8];
+            EGLint count = 0;
+            if (queryDevices && queryDevices(8, devices, &count)) {
+                for (EGLint i = 0; i < count; i++) {
+                    EGLDisplay d = getPlatformDisplay(EGL_PLATFORM_DEVICE_EXT, devices[i], 0);
+                    if (d != EGL_NO_DISPLAY && eglInitialize(d, 0, 0)) return d;
+                }
+            }
+        }
+        if (strstr(extensions, "EGL_MESA_platform_surfaceless")) {
+            EGLDisplay d = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, 0);
+            if (d != EGL_NO_DISPLAY && eglInitialize(d, 0, 0)) return d;
+        }
+    }
+
+    EGLDisplay d = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (d != EGL_NO_DISPLAY && eglInitialize(d, 0, 0)) return d;
+    return EGL_NO_DISPLAY;
+}
+
+HeadlessContext::HeadlessContext() : display(0), surface(0), context(0) {
+}
+
+HeadlessContext::~HeadlessContext() {
+    destroy();
+}
+
+bool HeadlessContext::create(int width, int height) {
+    destroy();
+
+    EGLDisplay d = headlessDisplay();
+    if (d == EGL_NO_DISPLAY) {
+        message = "No EGL display is available";
+        return false;
+    }
+    display = d;
+
+    const EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_RED_SIZE, 8, EGL_GREEN_SIZE, 8, EGL_BLUE_SIZE, 8, EGL_ALPHA_SIZE, 8,
+        EGL_DEPTH_SIZE, 24,
+        EGL_STENCIL_SIZE, 8,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint count = 0;
+    if (!eglChooseConfig(d, configAttribs, &config, 1, &count) || count == 0) {
+        message = "No EGL configuration supports desktop OpenGL with a pbuffer";
+        destroy();
+        return false;
+    }
+
+    const EGLint surfaceAttribs[] = { EGL_WIDTH, width, EGL_HEIGHT, height, EGL_NONE };
+    EGLSurface s = eglCreatePbufferSurface(d, config, surfaceAttribs);
+    if (s == EGL_NO_SURFACE) {
+        message = "Unable to create an EGL pbuffer surface";
+        destroy();
+        return false;
+    }
+    surface = s;
+
+    // The renderer uses the fixed-function pipeline, so ask for the
+    // default (compatibility) context
+    eglBindAPI(EGL_OPENGL_API);
+    EGLContext c = eglCreateContext(d, config, EGL_NO_CONTEXT, 0);
+    if (c == EGL_NO_CONTEXT) {
+        message = "Unable to create an EGL OpenGL context";
+        destroy();
+        return false;
+    }
+    context = c;
+    return makeCurrent();
+}
+
+bool HeadlessContext::makeCurrent() {
+    if (!context) return false;
+    eglBindAPI(EGL_OPENGL_API);
+    if (!eglMakeCurrent((EGLDisplay) display, (EGLSurface) surface, (EGLSurface) surface, (EGLContext) context)) {
+        message = "Unable to make the EGL context current";
+        return false;
+    }
+    return true;
+}
+
+void HeadlessContext::release() {
+    if (display) eglMakeCurrent((EGLDisplay) display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+}
+
+void HeadlessContext::destroy() {
+    if (!display) return;
+    release();
+    if (context) eglDestroyContext((EGLDisplay) display, (EGLContext) context);
+    if (surface) eglDestroySurface((EGLDisplay) display, (EGLSurface) surface);
+    // The display is shared by every context in the process, so it is not terminated
+    display = surface = context = 0;
+}
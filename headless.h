@@ -0,0 +1,63 @@
+/*
+ * Headless OpenGL context for OpenCV with OpenGL
+ *
+ * Creates an OpenGL context with an offscreen (pbuffer) surface through
+ * EGL, so the renderer can run without a window or a display server, for
+ * replays, benchmarks, tests and batch jobs.  With Mesa, this runs on the
+ * software rasterizer when there is no GPU.
+ */
+
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <string>
+
+class HeadlessContext {
+public:
+    HeadlessContext();
+    ~HeadlessContext();
+
+    /**
+     * Create the context and its offscreen surface, and make it current on
+     * the calling thread.  The surface has RGBA color, depth and stencil.
+     * @param width the width of the surface
+     * @param height the height of the surface
+     * @return false if no context could be created (see error())
+     */
+    bool create(int width, int height);
+
+    /**
+     * Make the context current on the calling thread.  A context can be
+     * current on only one thread at a time.
+     */
+    bool makeCurrent();
+
+    /**
+     * Detach the context from the calling thread.
+     */
+    void release();
+
+    /**
+     * Destroy the context and surface.
+     */
+    void destroy();
+
+    /**
+     * @return true if the context has been created
+     */
+    bool valid() const { return context != 0; }
+
+    /**
+     * @return a description of the last failure
+     */
+    const std::string &error() const { return message; }
+
+private:
+    HeadlessContext(const HeadlessContext &);
+    HeadlessContext &operator=(const HeadlessContext &);
+
+    void *display, *surface, *context;
+    std::string message;
+};
+
+#endif // HEADLESS_H
@@ -0,0 +1,142 @@
+/*
+ * Latency control for OpenCV with OpenGL
+ * See latency.h for an overview.
+ */
+
+#include "latency.h"
+#include "glprocs.h"
+#include <opencv2/core/core.hpp>
+#include <algorithm>
+using namespace std;
+
+static const double kBinWidth = 0.0005;     // seconds per histogram bin
+static const int kBins = 1000;              // up to half a second; the last bin holds the rest
+
+/**
+ * @return the current time, in seconds, on the same clock as main.cpp's now()
+ */
+static double currentTime() {
+    return (double) cv::getTickCount() / cv::getTickFrequency();
+}
+
+FrameFences::FrameFences()
+    : maxFrames(0), timerBits(-1), clockOffset(0.0), histogram(kBins, 0), measured(0), total(0.0), highest(0.0), latest(0.0), fresh(false) {
+}
+
+void FrameFences::setLimit(int frames) {
+    maxFrames = std::max(0, std::min(3, frames));
+}
+
+void FrameFences::endFrame(double captureTime) {
+    if (maxFrames == 0 || !haveGLSync()) {
+        // Without sync objects (Windows' OpenGL before 3.2), only flush
+        glFlush();
+        maxFrames = 0;
+        return;
+    }
+
+    // The timestamp and the fence follow the frame's commands, and are
+    // flushed with them
+    unsigned query = newQuery();
+    if (query) glQueryCounter(query, GL_TIMESTAMP);
+    GLsync fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    glFlush();
+    if (!fence) {
+        // No sync objects (OpenGL before 3.2): fall back to flushing
+        if (query) spare.push_back(query);
+        maxFrames = 0;
+        return;
+    }
+    Pending frame = { fence, query, captureTime };
+    pending.push_back(frame);
+
+    // Note the frames already done, then wait until there is room
+    while (!pending.empty() && retire(false)) {}
+    while ((int) pending.size() >= maxFrames && retire(true)) {}
+}
+
+bool FrameFences::retire(bool wait) {
+    Pending &frame = pending.front();
+    GLsync fence = (GLsync) frame.fence;
+    GLenum status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    while (wait && status == GL_TIMEOUT_EXPIRED) {
+        status = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 100000000);   // 100 ms at a time
+    }
+    if (status == GL_TIMEOUT_EXPIRED) return false;
+
+    // Done (or failed, in which case the time is meaningless)
+    if (status != GL_WAIT_FAILED && frame.captureTime >= 0.0) {
+        double seconds = finishTime(frame) - frame.captureTime;
+        int bin = std::min(kBins - 1, std::max(0, (int) (seconds / kBinWidth)));
+        histogram[bin]++;
+        measured++;
+        total += seconds;
+        highest = std::max(highest, seconds);
+        latest = seconds;
+        fresh = true;
+    }
+    glDeleteSync(fence);
+    if (frame.query) spare.push_back(frame.query);
+    pending.pop_front();
+    return true;
+}
+
+unsigned FrameFences::newQuery() {
+    if (timerBits < 0) {
+        // Before OpenGL 3.3 the query is an error, and the bits stay 0
+        GLint bits = 0;
+        if (haveGLTimer()) {
+            glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+            while (glGetError() != GL_NO_ERROR) {}
+        }
+        timerBits = bits;
+    }
+    if (timerBits == 0) return 0;
+
+    // Map the GPU's clock to the CPU's as the frame is sent; reading the
+    // GPU's time does not wait for its commands
+    GLint64 gpuTime = 0;
+    glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+    clockOffset = currentTime() - gpuTime * 1e-9;
+
+    if (!spare.empty()) {
+        unsigned query = spare.back();
+        spare.pop_back();
+        return query;
+    }
+    GLuint query = 0;
+    glGenQueries(1, &query);
+    return query;
+}
+
+double FrameFences::finishTime(const Pending &frame) {
+    if (!frame.query) return currentTime();
+
+    // The fence has signalled, so the timestamp before it is ready
+    GLuint64 gpuTime = 0;
+    glGetQueryObjectui64v(frame.query, GL_QUERY_RESULT, &gpuTime);
+    return gpuTime * 1e-9 + clockOffset;
+}
+
+bool FrameFences::takeLatest(double &seconds) {
+    if (!fresh) return false;
+    seconds = latest;
+    fresh = false;
+    return true;
+}
+
+double FrameFences::percentile(double fraction) const {
+    if (measured == 0) return 0.0;
+    long target = (long) (fraction * measured + 0.5), seen = 0;
+    for (int i = 0; i < kBins; i++) {
+        seen += histogram[i];
+        if (seen >= target && seen > 0) return std::min(highest, (i + 1) * kBinWidth);
+    }
+    return highest;
+}
+
+void FrameFences::release() {
+    while (!pending.empty()) retire(true);
+    if (!spare.empty()) glDeleteQueries((GLsizei) spare.size(), &spare[0]);
+    spare.clear();
+}
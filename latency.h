@@ -0,0 +1,128 @@
+/*
+ * Latency control for OpenCV with OpenGL
+ *
+ * glFlush() only sends the commands on their way: the program can run
+ * frames ahead of what the GPU has drawn, and with each frame queued, what
+ * is on screen falls further behind the camera.  FrameFences bounds the
+ * frames in flight instead.  After each frame it inserts a fence (an
+ * OpenGL 3.2 sync object) behind the frame's commands, and waits, if more
+ * than the limit are queued, for the oldest fence: one frame in flight is
+ * the least latency, with the CPU and GPU taking turns; two or three let
+ * them work at once, for more frames per second at the cost of a frame or
+ * two of latency.  Unlike glFinish(), the wait is only as long as needed.
+ *
+ * Beside each fence goes a timestamp query (OpenGL 3.3), which the GPU
+ * fills in when it has finished the frame's commands: in the single-
+ * buffered window, when the frame reaches the screen, give or take the
+ * monitor's own latency.  Mapped to the CPU's clock, that is when the
+ * frame finished, however late the program looks at the fence.  The time
+ * from capturing the video frame to then is kept, per frame, in a
+ * histogram, for its distribution.  Without timestamps, the time the fence
+ * is seen to have signalled stands in.
+ */
+
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <deque>
+#include <vector>
+
+class FrameFences {
+public:
+    FrameFences();
+
+    /**
+     * @param frames the most frames in flight, 1 to 3; 0 for no fences,
+     *        just glFlush()
+     */
+    void setLimit(int frames);
+
+    /**
+     * @return the most frames in flight, 0 if unbounded
+     */
+    int limit() const { return maxFrames; }
+
+    /**
+     * End a frame: flush it, fence it, and wait while too many frames are
+     * in flight.  Requires a current OpenGL context.
+     * @param captureTime when the frame's video was captured, in seconds
+     *        on now()'s clock; negative if it has none
+     */
+    void endFrame(double captureTime);
+
+    /**
+     * @param seconds set to the latency of the most recent frame known to
+     *        have finished, since the last call
+     * @return false if no frame has finished since the last call
+     */
+    bool takeLatest(double &seconds);
+
+    /**
+     * @return the frames sent but not yet known to have finished
+     */
+    int inFlight() const { return (int) pending.size(); }
+
+    /**
+     * @return the number of frames measured
+     */
+    long count() const { return measured; }
+
+    /**
+     * @param fraction between 0 and 1, e.g. 0.95
+     * @return the latency that fraction of the frames were within, in seconds
+     */
+    double percentile(double fraction) const;
+
+    /**
+     * @return the mean latency, in seconds
+     */
+    double mean() const { return measured ? total / measured : 0.0; }
+
+    /**
+     * @return the highest latency, in seconds
+     */
+    double worst() const { return highest; }
+
+    /**
+     * Wait for the frames in flight, and delete their fences.  Requires
+     * the context they were created in.
+     */
+    void release();
+
+private:
+    struct Pending {
+        void *fence;                // a GLsync
+        unsigned query;             // the timestamp query, or 0
+        double captureTime;
+    };
+
+    /**
+     * @return a timestamp query, reusing a spare one; 0 if the GPU has no
+     *         timestamps
+     */
+    unsigned newQuery();
+
+    /**
+     * @return when the frame finished, in seconds on now()'s clock
+     */
+    double finishTime(const Pending &frame);
+
+    /**
+     * Take the oldest frame off the queue, waiting for it if asked.
+     * @return false if it has not finished, and waiting was not asked for
+     */
+    bool retire(bool wait);
+
+    int maxFrames;
+    std::deque<Pending> pending;    // oldest first
+    std::vector<unsigned> spare;    // timestamp queries to reuse
+    int timerBits;                  // the bits of a GPU timestamp; 0 for none, -1 before checking
+    double clockOffset;             // the CPU's clock less the GPU's, in seconds
+
+    std::vector<long> histogram;    // frames per half millisecond of latency
+    long measured;
+    double total, highest, latest;
+    bool fresh;                     // latest is new since takeLatest()
+};
+
+#endif // LATENCY_H
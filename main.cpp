@@ -31,11 +31,41 @@
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/imgcodecs/imgcodecs.hpp>
 #include <opencv2/highgui/highgui.hpp>
+#include <opencv2/videoio/videoio.hpp>
 #include <opencv2/core/opengl.hpp>
 #include <GL/gl.h>
 #include <GL/glu.h>
 #include <GL/glut.h>
+#include <cctype>
+#include <algorithm>
+#include <cstdio>
 #include <iostream>
+#include <map>
+#include "arena.h"
+#include "batch.h"
+#include "calibration.h"
+#include "camera.h"
+#include "culling.h"
+#include "geometry.h"
+#include "glprocs.h"
+#include "latency.h"
+#include "meshbuffer.h"
+#include "meshcache.h"
+#include "meshopt.h"
+#include "metrics.h"
+#include "occlusion.h"
+#include "posefilter.h"
+#include "recorder.h"
+#include "scene.h"
+#include "sequence.h"
+#include "simplify.h"
+#include "synthetic.h"
+#include "trace.h"
+#include "tracking.h"
+#ifdef HAVE_EGL
+#include "headless.h"
+#include "regression.h"
+#endif
 using namespace cv;
 using namespace std;
 
@@ -44,24 +74,374 @@ int width, height;
 GLfloat zOffset = -5.0;
 GLfloat zDelta = -0.003125;
 GLuint texName, startList;
+bool headless = false;      // rendering offscreen, without GLUT
+
+// Models: the gem (a display list) and meshes loaded from files
+const unsigned int gemHandle = 1;
+String modelFile;           // the model for markers the scene does not list, and for the dolly
+unsigned int defaultHandle = gemHandle;
+vector<MeshBuffer> meshes;  // handle 2 is the first mesh
+map<String, unsigned int> meshHandles;
+double lodTolerance = 1.0;  // the largest simplification error to show, in pixels
+OcclusionCuller culler;     // skips objects hidden at the last frame, when enabled
+bool occlusionQueries = false;
+
+// Video input (used when the input file is not a still image)
+VideoCapture capture;
+ImageSequence sequence;     // image sequences, decoded ahead on several threads
+int decodeThreads = 0;      // 0 for one per core, up to 4
+Ptr<SyntheticVideo> synthetic;
+Mat frame;
+MarkerTracker tracker;
+int detectEvery = 1;        // run detection on every Nth frame
+int frameCount = 0;
+
+// Augmented reality: objects are placed on the markers found
+CameraModel camera;
+String cameraFile = "camera.yml";
+String sceneFile = "scene.yml";
+double markerLength = 1.0;  // side of a marker, in scene units
+SceneRegistry scene;
+Occluder occluder;          // hides objects behind real foreground
+String occlusionFile;
+double captureTime = 0.0;   // when the frame on screen was captured
+double latency = 0.0;       // smoothed time from capture to display
+double extraLatency = 0.0;  // display latency outside the program (e.g. the monitor)
+FrameFences fences;         // bounds the frames in flight, and measures when each is drawn
+
+// Memory for data that lasts one frame, reset at the start of display()
+FrameArena frameArena;
+
+// Recording of the rendered frames to a video file
+VideoRecorder recorder;
+String recordFile;
+double recordFps = 30.0;
+
+// Runtime metrics, served with --metrics
+MetricsRegistry metrics;
+MetricsServer metricsServer;
+String metricsAddress;
+struct {
+    int frames, inputDropped, recorderDropped;
+    int read, detect, upload, render, finish, toScreen;
+    int uploadBytes, decodeQueue, recordQueue, inFlight, culled;
+} metric;
+
+// The trace of the stages of each frame (always recorded), and when to write it out
+long frameNumber = 0;       // frames rendered
+int64_t frameStart = 0;     // when the current frame began, in trace ticks
+String tracePrefix = "trace";
+double traceSlow = 0.0;     // milliseconds; frames slower than this write the trace, if not 0
+double lastTraceDump = -1e9;
+int traceDumps = 0;
+
+/**
+ * @return the current time, in seconds, from OpenCV's tick counter
+ */
+double now() {
+    return (double) getTickCount() / getTickFrequency();
+}
+
+/**
+ * Open the input as a video: a camera index (e.g. "0"), a video file,
+ * or an image sequence pattern (e.g. "frames/%04d.jpg").
+ * @return true if the first frame was read into img
+ */
+bool openVideo(const String &name, Mat &img) {
+    bool isIndex = !name.empty();
+    for (size_t i = 0; i < name.size(); i++) {
+        if (!isdigit((unsigned char) name[i])) isIndex = false;
+    }
+    if (isIndex) {
+        capture.open(atoi(name.c_str()));
+    } else if (ImageSequence::isPattern(name) && sequence.open(name, decodeThreads)) {
+        return sequence.read(img);
+    } else {
+        capture.open(name);
+    }
+    return capture.isOpened() && capture.read(img) && !img.empty();
+}
+
+/**
+ * @return true if the input is a video, rather than a still image
+ */
+bool videoInput() {
+    return capture.isOpened() || sequence.isOpen() || synthetic.get() != 0;
+}
+
+/**
+ * Read the next frame of video.  A video file starts again from the
+ * beginning when it ends.
+ * @return true if a frame was read into img
+ */
+bool readFrame(Mat &img) {
+    if (synthetic.get() != 0) return synthetic->read(img);
+    if (sequence.isOpen()) return sequence.read(img);
+    if (capture.read(img) && !img.empty()) return true;
+    capture.set(CAP_PROP_POS_FRAMES, 0);
+    return capture.read(img) && !img.empty();
+}
+
+/**
+ * Find the markers in a frame, and update the poses of the objects on them.
+ */
+void updateScene(const Mat &img) {
+    scene.update(tracker.detect(img, captureTime), camera, captureTime);
+}
+
+/**
+ * Look up the handle for a model: "gem", or an OBJ, PLY or packed mesh
+ * file, which is loaded and uploaded the first time it is used.
+ * @return the handle, for drawModel(); the gem if the file cannot be read
+ */
+unsigned int modelHandle(const String &model) {
+    if (model == "gem") return gemHandle;
+    map<String, unsigned int>::iterator it = meshHandles.find(model);
+    if (it != meshHandles.end()) return it->second;
+
+    Mesh mesh;
+    string error;
+    int64 start = getTickCount();
+    unsigned int handle = gemHandle;
+    bool packed = model.size() > 6 && model.substr(model.size() - 6) == ".pmesh";
+    PackedMeshFile packedFile;
+    if (packed ? packedFile.open(model, error) : loadMesh(model, mesh, error)) {
+        meshes.push_back(MeshBuffer());
+        if (packed) {
+            // Optimized when it was converted
+            meshes.back().upload(packedFile.mesh());
+        } else {
+            optimizeMesh(mesh);
+            LodChain lods;
+            buildLodChain(mesh, lods);
+            for (size_t i = 0; i < lods.indices.size(); i++) optimizeVertexCache(lods.indices[i], mesh.vertexCount());
+            meshes.back().upload(mesh, &lods);
+        }
+        handle = (unsigned int) meshes.size() + 1;
+        cout << "Loaded " << model << ": " << meshes.back().triangleCount() << " triangles, "
+             << meshes.back().levelCount() << " levels of detail, in "
+             << (getTickCount() - start) * 1000.0 / getTickFrequency() << " ms" << endl;
+    } else {
+        cout << error << "; using the gem" << endl;
+    }
+    meshHandles[model] = handle;
+    return handle;
+}
+
+/**
+ * Draw a model, with the current material and transformation.  Meshes are
+ * drawn at the level of detail that suits their size on screen.
+ * @param handle the handle from modelHandle()
+ */
+void drawModel(unsigned int handle) {
+    if (handle >= 2 && handle - 2 < meshes.size()) {
+        const MeshBuffer &mesh = meshes[handle - 2];
+        mesh.draw(mesh.selectLevel(lodTolerance));
+    } else {
+        glCallList(startList);
+    }
+}
+
+/**
+ * Get a sphere around a model, for culling.
+ * @param handle the handle from modelHandle()
+ * @param c set to the center, in model units
+ * @param r set to the radius, in model units
+ */
+void modelBounds(unsigned int handle, float c[3], float &r) {
+    if (handle >= 2 && handle - 2 < meshes.size()) {
+        meshes[handle - 2].boundingSphere(c, r);
+    } else {
+        gemBounds(c, r);
+    }
+}
+
+/**
+ * Draw a model at a node of the scene graph, unless it is out of view or
+ * (with occlusion queries) was hidden at the last frame.
+ * @param world the node's world matrix
+ * @param scale model units to scene units
+ * @param handle the handle from modelHandle()
+ * @param node the index of the node, which identifies it to the culler
+ * @param projection the projection matrix
+ */
+void drawNode(const double world[16], double scale, unsigned int handle, int node, const double projection[16]) {
+    double m[16];
+    for (int k = 0; k < 16; k++) m[k] = k < 12 ? world[k] * scale : world[k];
+    float center[3], radius;
+    modelBounds(handle, center, radius);
+    if (!sphereInFrustum(projection, m, center, radius)) return;
+    glLoadMatrixd(m);
+    if (occlusionQueries && !culler.begin(node, center, radius)) return;
+    drawModel(handle);
+    if (occlusionQueries) culler.end(node);
+}
+
+/**
+ * Register the metrics the frame loop updates, and serve them if asked.
+ */
+void startMetrics() {
+    const char *stageHelp = "Time spent in each stage of a frame, in seconds";
+    // No frame rate gauge: one set as frames are rendered would keep its
+    // last value while rendering stalls; rate(ocvgl_frames_total[1m]) drops
+    metric.frames = metrics.counter("ocvgl_frames_total", "Frames rendered");
+    metric.inputDropped = metrics.counter("ocvgl_dropped_frames_total", "Frames lost", "reason=\"input\"");
+    metric.recorderDropped = metrics.counter("ocvgl_dropped_frames_total", "Frames lost", "reason=\"recorder\"");
+    metric.read = metrics.histogram("ocvgl_stage_seconds", stageHelp, "stage=\"read\"");
+    metric.detect = metrics.histogram("ocvgl_stage_seconds", stageHelp, "stage=\"detect\"");
+    metric.upload = metrics.histogram("ocvgl_stage_seconds", stageHelp, "stage=\"upload\"");
+    metric.render = metrics.histogram("ocvgl_stage_seconds", stageHelp, "stage=\"render\"");
+    metric.finish = metrics.histogram("ocvgl_stage_seconds", stageHelp, "stage=\"finish\"");
+    metric.toScreen = metrics.histogram("ocvgl_capture_to_screen_seconds",
+                                        "Time from capturing a video frame to showing it, in seconds");
+    metric.uploadBytes = metrics.counter("ocvgl_texture_upload_bytes_total", "Bytes of video uploaded to textures");
+    metric.decodeQueue = metrics.gauge("ocvgl_queue_depth", "Frames waiting in a queue", "queue=\"decode\"");
+    metric.recordQueue = metrics.gauge("ocvgl_queue_depth", "Frames waiting in a queue", "queue=\"record\"");
+    metric.inFlight = metrics.gauge("ocvgl_queue_depth", "Frames waiting in a queue", "queue=\"gpu\"");
+    metric.culled = metrics.counter("ocvgl_culled_objects_total",
+                                    "Objects not drawn because an occlusion query found them hidden");
+
+    if (metricsAddress.empty()) return;
+    if (metricsServer.start(metricsAddress, metrics)) {
+        cout << "Serving metrics on " << metricsAddress << endl;
+    } else {
+        cout << metricsServer.error() << endl;
+    }
+}
+
+/**
+ * Count a frame, and sample the queues, for the metrics.
+ */
+void updateMetrics() {
+    metrics.add(metric.frames);
+    int hidden = culler.takeHiddenCount();
+    if (hidden) metrics.add(metric.culled, hidden);
+    if (!metricsServer.isRunning()) return;
+    metrics.set(metric.decodeQueue, sequence.isOpen() ? sequence.ready() : 0);
+    metrics.set(metric.recordQueue, recorder.isOpen() ? recorder.queueDepth() : 0);
+    metrics.set(metric.inFlight, fences.inFlight());
+    if (recorder.isOpen()) metrics.set(metric.recorderDropped, (double) recorder.droppedFrames());
+}
+
+/**
+ * Record a stage of the current frame, in the trace and the metrics.
+ * @param stage a TraceStage
+ * @param id the stage's metric
+ * @param start when the stage began, from FrameTrace::ticks()
+ * @return when it ended
+ */
+int64_t endStage(int stage, int id, int64_t start) {
+    int64_t end = FrameTrace::ticks();
+    FrameTrace::instance().record(stage, frameNumber, start, end);
+    metrics.observe(id, (end - start) / getTickFrequency());
+    return end;
+}
+
+/**
+ * Record the frame in the trace, and write the trace out if the frame was
+ * slow, or a dump was asked for with SIGUSR1.  Slow frames write at most
+ * one trace every ten seconds, so a slow stretch does not fill the disk.
+ */
+void traceFrame() {
+    int64_t end = FrameTrace::ticks();
+    FrameTrace::instance().record(TRACE_FRAME, frameNumber, frameStart, end);
+    double ms = (end - frameStart) * 1000.0 / getTickFrequency();
+    bool slow = traceSlow > 0.0 && ms > traceSlow && now() - lastTraceDump >= 10.0;
+    bool asked = FrameTrace::takeDumpRequest();
+    if (!slow && !asked) return;
+
+    lastTraceDump = now();
+    char suffix[32];
+    snprintf(suffix, sizeof(suffix), "-%04d.trace", ++traceDumps);
+    String file = tracePrefix + suffix;
+    if (slow) cout << "Frame " << frameNumber << " took " << ms << " ms; ";
+    if (FrameTrace::instance().dump(file)) {
+        cout << "wrote the trace to " << file << endl;
+    } else {
+        cout << "unable to write the trace to " << file << endl;
+    }
+}
+
+/**
+ * Read the next video frame, find the markers in it, and replace the
+ * contents of the background texture.  The texture is updated in place,
+ * since every frame has the same size.
+ */
+void nextFrame() {
+    int64_t start = FrameTrace::ticks();
+    if (!readFrame(frame) || frame.cols != width || frame.rows != height) {
+        metrics.add(metric.inputDropped);
+        return;
+    }
+    captureTime = now();
+    endStage(TRACE_READ, metric.read, start);
+    occluder.next(frame.size());
+
+    // Between detections, the pose filter predicts the motion
+    if (frameCount++ % detectEvery == 0) {
+        start = FrameTrace::ticks();
+        updateScene(frame);
+        endStage(TRACE_DETECT, metric.detect, start);
+    }
+
+    // The time is for handing the pixels to OpenGL; the copy to the GPU
+    // may finish later
+    start = FrameTrace::ticks();
+    glBindTexture(GL_TEXTURE_2D, texName);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, frame.ptr());
+    endStage(TRACE_UPLOAD, metric.upload, start);
+    metrics.add(metric.uploadBytes, (double) frame.total() * frame.elemSize());
+}
 
 /**
  * Perform initial setup for the application:
- * 1. Load an image from OpenCV.
+ * 1. Load an image (or the first frame of a video) from OpenCV, and find the markers in it.
  * 2. Create an OpenGL texture from the image.
  * 3. Assign material properties and set up lighting
  * 3. Prepare display lists with all primitives needed for rendering.
  */
 void init() {
+    if (!loadGLProcs()) {
+        cout << "OpenGL 1.5 or later is needed: " << glGetString(GL_VERSION) << endl;
+        exit(-1);
+    }
+    startMetrics();
+    FrameTrace::nameThread("render");
+    FrameTrace::dumpOnSignal();
+
     // Load an image, using OpenCV
     Mat img = imread(imageFile, CV_LOAD_IMAGE_COLOR);
-    if (img.empty()) {
+    if (img.empty() && !openVideo(imageFile, img)) {
         cout << "Unable to read image: " << imageFile << endl;
         exit(-1);
     }
     width = img.cols;
     height = img.rows;
 
+    // Load the camera calibration, or make a guess
+    if (cameraFile.empty()) {
+        camera = CameraModel::guess(img.size());
+    } else if (!camera.load(cameraFile)) {
+        cout << "No camera calibration in " << cameraFile << "; guessing" << endl;
+        camera = CameraModel::guess(img.size());
+    }
+    camera = camera.scaledTo(img.size());
+
+    // Open the occlusion mask or depth input
+    if (!occlusionFile.empty()) {
+        if (!occluder.open(occlusionFile)) {
+            cout << "Unable to read occlusion input: " << occlusionFile << endl;
+            exit(-1);
+        }
+        occluder.next(img.size());
+    }
+
+    // Read the scene, or put a gem on every marker
+    scene = SceneRegistry(markerLength);
+    if (sceneFile.empty() || !scene.load(sceneFile, tracker.getDictionary())) scene.setAutoModel(modelFile.empty() ? "gem" : modelFile);
+    captureTime = now();
+    updateScene(img);
+
     // Create an OpenGL texture, using the data from the OpenCV image
     glEnable(GL_TEXTURE_2D);
     glGenTextures(1, &texName);
@@ -74,27 +454,11 @@ void init() {
     glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_DECAL);
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, img.ptr());
 
-    // Material properties for the gem
-    GLfloat mat_ambient[] = { 0.1, 0.1, 0.8, 1.0 };
-    GLfloat mat_specular[] = { 0.8, 0.8, 1.0, 1.0 };
-    GLfloat mat_shininess[] = { 50.0 };
-
-    // Lighting properties
-    GLfloat light_position[] = { 1.0, 1.0, 1.0, 0.0 };
-    GLfloat model_ambient[] = { 0.5, 0.5, 0.5, 1.0 };
-
     glClearColor(0.0, 0.0, 0.0, 0.0);
 
-    // Assign the material properties
-    glMaterialfv(GL_FRONT, GL_AMBIENT, mat_ambient);
-    glMaterialfv(GL_FRONT, GL_SPECULAR, mat_specular);
-    glMaterialfv(GL_FRONT, GL_SHININESS, mat_shininess);
-
-    // Assign the lighting properties, and enable lighting
-    glLightfv(GL_LIGHT0, GL_POSITION, light_position);
-    glLightModelfv(GL_LIGHT_MODEL_AMBIENT, model_ambient);
+    // The gem's material and the light, and enable lighting
+    setupLighting();
     glEnable(GL_LIGHTING);
-    glEnable(GL_LIGHT0);
 
     // Tell OpenGL to check for occlusions
     glEnable(GL_DEPTH_TEST);
@@ -104,188 +468,23 @@ void init() {
 
     // List #1: Gem
     glNewList(startList, GL_COMPILE);
-        glBegin(GL_TRIANGLES);
-            glNormal3f(-0.22663, -0.84565, -0.48323);
-            glVertex3f( 0.0,    0.0,    0.0 ); // ABC (triangles)
-            glVertex3f( 0.0,   -1.0,    1.75);
-            glVertex3f(-0.5,   -0.866,  1.75);
-            glNormal3f(-0.61907, -0.61907, -0.48323);
-            glVertex3f( 0.0,    0.0,    0.0 ); // ACD
-            glVertex3f(-0.5,   -0.866,  1.75);
-            glVertex3f(-0.866, -0.5,    1.75);
-            glNormal3f(-0.84565, -0.22663, -0.48323);
-            glVertex3f( 0.0,    0.0,    0.0 ); // ADE
-            glVertex3f(-0.866, -0.5,    1.75);
-            glVertex3f(-1.0,    0.0,    1.75);
-            glNormal3f(-0.84565, 0.22663, -0.48323);
-            glVertex3f( 0.0,    0.0,    0.0 ); // AEF
-            glVertex3f(-1.0,    0.0,    1.75);
-            glVertex3f(-0.866,  0.5,    1.75);
-            glNormal3f(-0.61907, 0.61907, -0.48323);
-            glVertex3f( 0.0,    0.0,    0.0 ); // AFG
-            glVertex3f(-0.866,  0.5,    1.75);
-            glVertex3f(-0.5,    0.866,  1.75);
-            glNormal3f(-0.22663, 0.84565, -0.48323);
-            glVertex3f( 0.0,    0.0,    0.0 ); // AGH
-            glVertex3f(-0.5,    0.866,  1.75);
-            glVertex3f( 0.0,    1.0,    1.75);
-            glNormal3f(0.22663, 0.84565, -0.48323);
-            glVertex3f( 0.0,    0.0,    0.0 ); // AHI
-            glVertex3f( 0.0,    1.0,    1.75);
-            glVertex3f( 0.5,    0.866,  1.75);
-            glNormal3f(0.61907, 0.61907, -0.48323);
-            glVertex3f( 0.0,    0.0,    0.0 ); // AIJ
-            glVertex3f( 0.5,    0.866,  1.75);
-            glVertex3f( 0.866,  0.5,    1.75);
-            glNormal3f(0.84565, 0.22663, -0.48323);
-            glVertex3f( 0.0,    0.0,    0.0 ); // AJK
-            glVertex3f( 0.866,  0.5,    1.75);
-            glVertex3f( 1.0,    0.0,    1.75);
-            glNormal3f(0.84565, -0.22663, -0.48323);
-            glVertex3f( 0.0,    0.0,    0.0 ); // AKL
-            glVertex3f( 1.0,    0.0,    1.75);
-            glVertex3f( 0.866, -0.5,    1.75);
-            glNormal3f(0.61907, -0.61907, -0.48323);
-            glVertex3f( 0.0,    0.0,    0.0 ); // ALM
-            glVertex3f( 0.866, -0.5,    1.75);
-            glVertex3f( 0.5,   -0.866,  1.75);
-            glNormal3f(0.22663, -0.84565, -0.48323);
-            glVertex3f( 0.0,    0.0,    0.0 ); // AMB
-            glVertex3f( 0.5,   -0.866,  1.75);
-            glVertex3f( 0.0,   -1.0,    1.75);
-            glNormal3f(-0.18619, -0.69474, 0.69474);
-
-            glVertex3f(-0.5,   -0.866,  1.75); // CBNO (quads, as triangles)
-            glVertex3f( 0.0,   -1.0,    1.75);
-            glVertex3f( 0.0,   -0.75,   2.0 );
-            glVertex3f(-0.5,   -0.866,  1.75);
-            glVertex3f( 0.0,   -0.75,   2.0 );
-            glVertex3f(-0.375, -0.6495, 2.0 );
-            glNormal3f(-0.50589, -0.50589, 0.69474);
-            glVertex3f(-0.866, -0.5,    1.75); // DCOP
-            glVertex3f(-0.5,   -0.866,  1.75);
-            glVertex3f(-0.375, -0.6495, 2.0 );
-            glVertex3f(-0.866, -0.5,    1.75);
-            glVertex3f(-0.375, -0.6495, 2.0 );
-            glVertex3f(-0.6495, -0.375, 2.0 );
-            glNormal3f(-0.69474, -0.18619, 0.69474);
-            glVertex3f(-1.0,    0.0,    1.75); // EDPQ
-            glVertex3f(-0.866, -0.5,    1.75);
-            glVertex3f(-0.6495, -0.375, 2.0 );
-            glVertex3f(-1.0,    0.0,    1.75);
-            glVertex3f(-0.6495, -0.375, 2.0 );
-            glVertex3f(-0.75,   0.0,    2.0 );
-            glNormal3f(-0.69474, 0.18619, 0.69474);
-            glVertex3f(-0.866,  0.5,    1.75); // FEQR
-            glVertex3f(-1.0,    0.0,    1.75);
-            glVertex3f(-0.75,   0.0,    2.0 );
-            glVertex3f(-0.866,  0.5,    1.75);
-            glVertex3f(-0.75,   0.0,    2.0 );
-            glVertex3f(-0.6495, 0.375,  2.0 );
-            glNormal3f(-0.50589, 0.50589, 0.69474);
-            glVertex3f(-0.5,    0.866,  1.75); // GFRS
-            glVertex3f(-0.866,  0.5,    1.75);
-            glVertex3f(-0.6495, 0.375,  2.0 );
-            glVertex3f(-0.5,    0.866,  1.75);
-            glVertex3f(-0.6495, 0.375,  2.0 );
-            glVertex3f(-0.375,  0.6495, 2.0 );
-            glNormal3f(-0.18619, 0.69474, 0.69474);
-            glVertex3f( 0.0,    1.0,    1.75); // HGST
-            glVertex3f(-0.5,    0.866,  1.75);
-            glVertex3f(-0.375,  0.6495, 2.0 );
-            glVertex3f( 0.0,    1.0,    1.75);
-            glVertex3f(-0.375,  0.6495, 2.0 );
-            glVertex3f( 0.0,    0.75,   2.0 );
-            glNormal3f(0.18619, 0.69474, 0.69474);
-            glVertex3f( 0.5,    0.866,  1.75); // IHTU
-            glVertex3f( 0.0,    1.0,    1.75);
-            glVertex3f( 0.0,    0.75,   2.0 );
-            glVertex3f( 0.5,    0.866,  1.75);
-            glVertex3f( 0.0,    0.75,   2.0 );
-            glVertex3f( 0.375,  0.6495, 2.0 );
-            glNormal3f(0.50589, 0.50589, 0.69474);
-            glVertex3f( 0.866,  0.5,    1.75); // JIUV
-            glVertex3f( 0.5,    0.866,  1.75);
-            glVertex3f( 0.375,  0.6495, 2.0 );
-            glVertex3f( 0.866,  0.5,    1.75);
-            glVertex3f( 0.375,  0.6495, 2.0 );
-            glVertex3f( 0.6495, 0.375,  2.0 );
-            glNormal3f(0.69474, 0.18619, 0.69474);
-            glVertex3f( 1.0,    0.0,    1.75); // KJVW
-            glVertex3f( 0.866,  0.5,    1.75);
-            glVertex3f( 0.6495, 0.375,  2.0 );
-            glVertex3f( 1.0,    0.0,    1.75);
-            glVertex3f( 0.6495, 0.375,  2.0 );
-            glVertex3f( 0.75,   0.0,    2.0 );
-            glNormal3f(0.69474, -0.18619, 0.69474);
-            glVertex3f( 0.866, -0.5,    1.75); // LKWX
-            glVertex3f( 1.0,    0.0,    1.75);
-            glVertex3f( 0.75,   0.0,    2.0 );
-            glVertex3f( 0.866, -0.5,    1.75);
-            glVertex3f( 0.75,   0.0,    2.0 );
-            glVertex3f( 0.6495, -0.375, 2.0 );
-            glNormal3f(0.50589, -0.50589, 0.69474);
-            glVertex3f( 0.5,   -0.866,  1.75); // MLXY
-            glVertex3f( 0.866, -0.5,    1.75);
-            glVertex3f( 0.6495, -0.375, 2.0 );
-            glVertex3f( 0.5,   -0.866,  1.75);
-            glVertex3f( 0.6495, -0.375, 2.0 );
-            glVertex3f( 0.375, -0.6495, 2.0 );
-            glNormal3f(0.18619, -0.69474, 0.69474);
-            glVertex3f( 0.0,   -1.0,    1.75); // BMYN
-            glVertex3f( 0.5,   -0.866,  1.75);
-            glVertex3f( 0.375, -0.6495, 2.0 );
-            glVertex3f( 0.0,   -1.0,    1.75);
-            glVertex3f( 0.375, -0.6495, 2.0 );
-            glVertex3f( 0.0,   -0.75,   2.0 );
-
-            glNormal3f( 0.0,    0.0,    1.0 ); // polygon NOPQRSTUVWXY (as triangles)
-            glVertex3f( 0.375, -0.65,   2.0 ); // YXW
-            glVertex3f( 0.65,  -0.375,  2.0 );
-            glVertex3f( 0.75,   0.0,    2.0 );
-            glVertex3f( 0.375, -0.65,   2.0 ); // YWV
-            glVertex3f( 0.75,   0.0,    2.0 );
-            glVertex3f( 0.65,   0.375,  2.0 );
-            glVertex3f( 0.375, -0.65,   2.0 ); // YVU
-            glVertex3f( 0.65,   0.375,  2.0 );
-            glVertex3f( 0.375,  0.65,   2.0 );
-            glVertex3f( 0.375, -0.65,   2.0 ); // YUT
-            glVertex3f( 0.375,  0.65,   2.0 );
-            glVertex3f( 0.0,    0.75,   2.0 );
-            glVertex3f( 0.375, -0.65,   2.0 ); // YTS
-            glVertex3f( 0.0,    0.75,   2.0 );
-            glVertex3f(-0.375,  0.65,   2.0 );
-            glVertex3f( 0.375, -0.65,   2.0 ); // YSR
-            glVertex3f(-0.375,  0.65,   2.0 );
-            glVertex3f(-0.65,   0.375,  2.0 );
-            glVertex3f( 0.375, -0.65,   2.0 ); // YRQ
-            glVertex3f(-0.65,   0.375,  2.0 );
-            glVertex3f(-0.75,   0.0,    2.0 );
-            glVertex3f( 0.375, -0.65,   2.0 ); // YQP
-            glVertex3f(-0.75,   0.0,    2.0 );
-            glVertex3f(-0.65,  -0.375,  2.0 );
-            glVertex3f( 0.375, -0.65,   2.0 ); // YPO
-            glVertex3f(-0.65,  -0.375,  2.0 );
-            glVertex3f(-0.375, -0.65,   2.0 );
-            glVertex3f( 0.375, -0.65,   2.0 ); // YON
-            glVertex3f(-0.375, -0.65,   2.0 );
-            glVertex3f( 0.0,   -0.75,   2.0 );
-        glEnd();
+        drawGem();
     glEndList();
 
     // List #2: Rectangle with texture
     glNewList(startList + 1, GL_COMPILE);
-        glBegin(GL_QUADS);
-            glTexCoord2f(0.0, 0.0);
-            glVertex3f(-2.0, 2.0, 0.0);
-            glTexCoord2f(0.0, 1.0);
-            glVertex3f(-2.0, -2.0, 0.0);
-            glTexCoord2f(1.0, 1.0);
-            glVertex3f(2.0, -2.0, 0.0);
-            glTexCoord2f(1.0, 0.0);
-            glVertex3f(2.0, 2.0, 0.0);
-        glEnd();
+        drawBackground();
     glEndList();
+
+    // Load the model for the dolly, and for markers not in the scene
+    if (!modelFile.empty()) defaultHandle = modelHandle(modelFile);
+
+    // Offscreen, every frame is recorded; live, frames the encoder cannot
+    // keep up with are dropped, rather than slowing the display
+    if (!recordFile.empty()) {
+        recorder.setBlocking(headless);
+        recorder.open(recordFile, recordFps);
+    }
 }
 
 /**
@@ -307,12 +506,150 @@ void reshape(int w, int h) {
     glLoadIdentity();
 }
 
+/**
+ * Complete a frame, and measure how long it took from capture to display.
+ * @param renderStart when drawing the frame began, from FrameTrace::ticks()
+ */
+void finishFrame(int64_t renderStart) {
+    int64_t start = endStage(TRACE_RENDER, metric.render, renderStart);
+    if (recorder.isOpen()) {
+        GLint vp[4];
+        glGetIntegerv(GL_VIEWPORT, vp);
+        recorder.capture(vp[0], vp[1], vp[2], vp[3]);
+    }
+
+    // Send the frame, and wait if too many are in flight
+    fences.endFrame(videoInput() ? captureTime : -1.0);
+
+    // The time to the screen, as the fences measure it, or else (with no
+    // fences) the time the frame was sent
+    if (videoInput()) {
+        double seconds = now() - captureTime;
+        if (fences.limit() == 0 || fences.takeLatest(seconds)) {
+            double shown = seconds + extraLatency;
+            latency = latency == 0.0 ? shown : 0.9 * latency + 0.1 * shown;
+            metrics.observe(metric.toScreen, shown);
+        }
+    }
+    endStage(TRACE_FINISH, metric.finish, start);
+    traceFrame();
+    updateMetrics();
+    if (!headless) glutPostRedisplay();
+}
+
+/**
+ * A model to draw at a node of the scene graph, this frame.
+ */
+struct Instance {
+    const double *world;
+    double scale;
+    unsigned int handle;
+    int node;
+    double depth;           // from viewDepth(), for sortNearestFirst()
+};
+
+/**
+ * Render the image filling the window (keeping its aspect ratio), with an
+ * object on each marker in view, as seen through the calibrated camera.
+ * The poses are predicted forward to the time the frame will be seen.
+ */
+void displayAugmented() {
+    glPushAttrib(GL_VIEWPORT_BIT | GL_ENABLE_BIT);
+
+    // Fit the image to the window
+    GLint vp[4];
+    glGetIntegerv(GL_VIEWPORT, vp);
+    double s = min((double) vp[2] / width, (double) vp[3] / height);
+    int w = (int) (width * s), h = (int) (height * s);
+    glViewport(vp[0] + (vp[2] - w) / 2, vp[1] + (vp[3] - h) / 2, w, h);
+
+    // Draw the rectangle flat on the screen, without writing depth
+    glMatrixMode(GL_PROJECTION);
+    glPushMatrix();
+    glLoadIdentity();
+    glOrtho(-2.0, 2.0, -2.0, 2.0, -1.0, 1.0);
+    glMatrixMode(GL_MODELVIEW);
+    glLoadIdentity();
+    glDisable(GL_LIGHTING);
+    glEnable(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, texName);
+    glDepthMask(GL_FALSE);
+    glCallList(startList + 1);
+    glDepthMask(GL_TRUE);
+
+    // Mark where real things hide the objects
+    double zNear = 0.01 * markerLength, zFar = 1000.0 * markerLength;
+    occluder.apply(startList + 1, zNear, zFar);
+
+    // Place each object on its marker
+    double p[16], m[16];
+    glMatrixMode(GL_PROJECTION);
+    camera.glProjection(zNear, zFar, p);
+    glLoadMatrixd(p);
+    glMatrixMode(GL_MODELVIEW);
+
+    glDisable(GL_TEXTURE_2D);
+    glEnable(GL_LIGHTING);
+    glEnable(GL_NORMALIZE);
+    double displayTime = captureTime + latency;
+    const vector<int> &visible = scene.visible();
+    SceneGraph &graph = scene.graph();
+    for (size_t i = 0; i < visible.size(); i++) {
+        SceneObject &obj = scene[visible[i]];
+        obj.pose.predict(displayTime).glModelview(m);
+        graph.setLocal(obj.node, m);
+    }
+    graph.update();
+
+    // Draw the objects in view, and their parts, nearest first (see culling.h)
+    FrameVector<Instance> instances((ArenaAllocator<Instance>(frameArena)));
+    for (size_t i = 0; i < visible.size(); i++) {
+        SceneObject &obj = scene[visible[i]];
+        if (obj.handle == 0) obj.handle = modelHandle(obj.model);
+        const double *world = graph.world(obj.node);
+        Instance instance = { world, obj.scale, obj.handle, obj.node, viewDepth(world) };
+        instances.push_back(instance);
+        for (size_t j = 0; j < obj.parts.size(); j++) {
+            ScenePart &part = scene.part(obj.parts[j]);
+            if (part.handle == 0) part.handle = modelHandle(part.model);
+            world = graph.world(part.node);
+            Instance piece = { world, part.scale, part.handle, part.node, viewDepth(world) };
+            instances.push_back(piece);
+        }
+    }
+    sortNearestFirst(instances.begin(), instances.end());
+    for (size_t i = 0; i < instances.size(); i++) {
+        const Instance &instance = instances[i];
+        drawNode(instance.world, instance.scale, instance.handle, instance.node, p);
+    }
+    occluder.finish();
+
+    glMatrixMode(GL_PROJECTION);
+    glPopMatrix();
+    glMatrixMode(GL_MODELVIEW);
+    glPopAttrib();
+}
+
 /**
  * Render the 3D scene.  This function is called repeatedly by OpenGL.
  */
 void display() {
+    frameStart = FrameTrace::ticks();
+    frameNumber++;
+    frameArena.reset();
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
+    // Bring in the next frame, if the input is a video
+    if (videoInput()) nextFrame();
+    int64_t renderStart = FrameTrace::ticks();
+
+    // With a video, or a marker in view, render the augmented scene
+    if (videoInput() || !scene.visible().empty()) {
+        displayAugmented();
+        finishFrame(renderStart);
+        return;
+    }
+
     // Set the camera position
     glMatrixMode(GL_MODELVIEW);
     glLoadIdentity();
@@ -329,14 +666,32 @@ void display() {
     glBindTexture(GL_TEXTURE_2D, texName);
     glCallList(startList + 1);
 
-    // Disable textures and enable lighting, then render the gem
+    // Disable textures and enable lighting, then render the gem (or model)
     glDisable(GL_TEXTURE_2D);
     glEnable(GL_LIGHTING);
-    glCallList(startList);
+    double p[16], m[16];
+    float center[3], radius;
+    glGetDoublev(GL_PROJECTION_MATRIX, p);
+    glGetDoublev(GL_MODELVIEW_MATRIX, m);
+    modelBounds(defaultHandle, center, radius);
+    if (sphereInFrustum(p, m, center, radius)) drawModel(defaultHandle);
 
-    // Tell OpenGL that the window should be repainted
-    glFlush();
-    glutPostRedisplay();
+    finishFrame(renderStart);
+}
+
+/**
+ * Wait for the frames in flight, and print the distribution of the
+ * latency from capture to screen, if it was measured.
+ */
+void finishLatency() {
+    fences.release();
+    if (fences.count() == 0) return;
+    cout << "Capture to screen, over " << fences.count() << " frames (" << fences.limit()
+         << " in flight): mean " << 1000.0 * (fences.mean() + extraLatency)
+         << " ms, median " << 1000.0 * (fences.percentile(0.5) + extraLatency)
+         << " ms, 95% " << 1000.0 * (fences.percentile(0.95) + extraLatency)
+         << " ms, 99% " << 1000.0 * (fences.percentile(0.99) + extraLatency)
+         << " ms, worst " << 1000.0 * (fences.worst() + extraLatency) << " ms" << endl;
 }
 
 /**
@@ -346,6 +701,11 @@ void display() {
 void keyboard(unsigned char key, int x, int y) {
     switch (key) {
     case 27:
+        recorder.close();
+        sequence.close();
+        culler.release();
+        finishLatency();
+        metricsServer.stop();
         exit(0);
         break;
     default:
@@ -353,17 +713,330 @@ void keyboard(unsigned char key, int x, int y) {
     }
 }
 
+/**
+ * Parse one of the rendering options, shared by the window and the
+ * offscreen subcommands.  The first argument that is not an option is
+ * taken as the image file name.
+ * @param argc the number of arguments
+ * @param argv the arguments
+ * @param i the index of the option; advanced past its value, if it has one
+ * @return false if the argument was not recognized
+ */
+bool parseOption(int argc, char *argv[], int &i) {
+    String arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (arg == "--camera" && hasValue) {
+        cameraFile = argv[++i];
+    } else if (arg == "--scene" && hasValue) {
+        sceneFile = argv[++i];
+    } else if (arg == "--model" && hasValue) {
+        modelFile = argv[++i];
+    } else if (arg == "--lod-tolerance" && hasValue) {
+        lodTolerance = atof(argv[++i]);
+    } else if (arg == "--occlusion-queries") {
+        occlusionQueries = true;
+    } else if (arg == "--occlusion" && hasValue) {
+        occlusionFile = argv[++i];
+    } else if (arg == "--depth-scale" && hasValue) {
+        occluder.setDepthScale(atof(argv[++i]));
+    } else if (arg == "--marker-length" && hasValue) {
+        markerLength = atof(argv[++i]);
+    } else if (arg == "--detect-every" && hasValue) {
+        detectEvery = max(1, atoi(argv[++i]));
+    } else if (arg == "--detect-scale" && hasValue) {
+        tracker.setScale(atof(argv[++i]));
+    } else if (arg == "--latency" && hasValue) {
+        extraLatency = atof(argv[++i]) / 1000.0;
+    } else if (arg == "--record" && hasValue) {
+        recordFile = argv[++i];
+    } else if (arg == "--record-fps" && hasValue) {
+        recordFps = atof(argv[++i]);
+    } else if (arg == "--frames-in-flight" && hasValue) {
+        fences.setLimit(atoi(argv[++i]));
+    } else if (arg == "--metrics" && hasValue) {
+        metricsAddress = argv[++i];
+    } else if (arg == "--trace" && hasValue) {
+        tracePrefix = argv[++i];
+    } else if (arg == "--trace-slow" && hasValue) {
+        traceSlow = atof(argv[++i]);
+    } else if (arg == "--decode-threads" && hasValue) {
+        decodeThreads = max(0, atoi(argv[++i]));
+    } else if (arg[0] != '-' && imageFile.empty()) {
+        imageFile = arg;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Print the rendering options recognized by parseOption().
+ */
+void printOptions() {
+    cout << "Options:" << endl;
+    cout << "  --camera FILE         camera calibration (default camera.yml)" << endl;
+    cout << "  --scene FILE          objects to place on markers (default scene.yml)" << endl;
+    cout << "  --model FILE          OBJ, PLY or packed mesh to show instead of the gem" << endl;
+    cout << "  --lod-tolerance PX    simplification error allowed on screen, in pixels (default 1; 0 for full detail)" << endl;
+    cout << "  --occlusion FILE      mask (8-bit) or depth map (16-bit) of real foreground" << endl;
+    cout << "  --occlusion-queries   skip objects hidden at the last frame (needs OpenGL 1.5)" << endl;
+    cout << "  --depth-scale S       scene units per depth map unit (default 0.001)" << endl;
+    cout << "  --marker-length L     side of a marker, in scene units (default 1)" << endl;
+    cout << "  --detect-every N      detect markers in every Nth frame (default 1)" << endl;
+    cout << "  --detect-scale S      detect markers at S times full resolution (default 1)" << endl;
+    cout << "  --latency MS          display latency not measured by the program (default 0)" << endl;
+    cout << "  --frames-in-flight N  most frames queued for the GPU, 1 to 3, fewer for less latency" << endl;
+    cout << "                        (needs OpenGL 3.2; default no limit)" << endl;
+    cout << "  --record FILE         record the rendered frames to a video (.avi or .mp4)" << endl;
+    cout << "  --record-fps N        frame rate of the recording (default 30)" << endl;
+    cout << "  --decode-threads N    threads decoding an image sequence ahead (default one per core, up to 4)" << endl;
+    cout << "  --metrics ADDRESS     serve Prometheus metrics over HTTP: PORT or HOST:PORT (loopback by" << endl;
+    cout << "                        default), or unix:PATH for a Unix socket" << endl;
+    cout << "  --trace PREFIX        where to write the frame trace, as PREFIX-0001.trace, ... (default trace)" << endl;
+    cout << "  --trace-slow MS       write the trace when a frame takes longer (default 0: only on SIGUSR1)" << endl;
+}
+
+#ifdef HAVE_EGL
+/**
+ * Run the replay subcommand: render a fixed number of frames offscreen, as
+ * fast as possible, and report the frame rate.  This is the workload used
+ * to collect profiles for profile-guided optimization, so it should cover
+ * the paths that matter in production.
+ * @param argc the number of arguments after "replay"
+ * @param argv the arguments after "replay"
+ * @return the program exit code
+ */
+int replayCommand(int argc, char *argv[]) {
+    int frames = 3200;      // one full cycle of the dolly animation
+    Size size(400, 400);
+    bool useSynthetic = false;
+    for (int i = 0; i < argc; i++) {
+        String arg = argv[i];
+        if (arg == "--frames" && i + 1 < argc) {
+            frames = max(1, atoi(argv[++i]));
+        } else if (arg == "--size" && i + 1 < argc) {
+            sscanf(argv[++i], "%dx%d", &size.width, &size.height);
+        } else if (arg == "--synthetic") {
+            useSynthetic = true;
+        } else {
+            parseOption(argc, argv, i);
+        }
+    }
+    if (imageFile.empty() || size.width <= 0 || size.height <= 0) {
+        cout << "Usage: OpenCVWithOpenGL replay IMAGE [--frames N] [--size WxH] [--synthetic] [options]" << endl;
+        cout << "  --frames N            number of frames to render (default 3200)" << endl;
+        cout << "  --size WxH            size of the offscreen surface (default 400x400)" << endl;
+        cout << "  --synthetic           move a marker over the image, as a video" << endl;
+        printOptions();
+        return -1;
+    }
+
+    HeadlessContext context;
+    if (!context.create(size.width, size.height)) {
+        cout << context.error() << endl;
+        return -1;
+    }
+    headless = true;
+    init();
+    if (useSynthetic) {
+        Mat background = imread(imageFile, CV_LOAD_IMAGE_COLOR);
+        if (background.empty()) {
+            cout << "--synthetic needs a still image: " << imageFile << endl;
+            return -1;
+        }
+        synthetic = makePtr<SyntheticVideo>(background);
+    }
+    reshape(size.width, size.height);
+
+    double start = now();
+    for (int i = 0; i < frames; i++) display();
+    glFinish();
+    double seconds = now() - start;
+    cout << frames << " frames in " << seconds << " s (" << frames / seconds << " fps)" << endl;
+    recorder.close();
+    sequence.close();
+    culler.release();
+    finishLatency();
+    metricsServer.stop();
+    return 0;
+}
+
+/**
+ * A frame rendered by the regress subcommand: a fixed point in the dolly
+ * animation, and how long it may take to render.
+ */
+struct RegressionScene {
+    const char *name;
+    GLfloat zOffset;
+    double budget;          // milliseconds per frame, median of the repeats
+};
+
+// The budgets are for Mesa's llvmpipe at 400x400, with headroom for a busy
+// build machine; scale them with --budget-scale on slower hardware
+const RegressionScene regressionScenes[] = {
+    { "dolly-near", -5.0f, 20.0 },
+    { "dolly-mid", -7.5f, 20.0 },
+    { "dolly-far", -10.0f, 20.0 },
+};
+
+/**
+ * Run the regress subcommand: render fixed frames of the dolly animation
+ * offscreen, compare them against golden images, and check that each
+ * renders within its time budget.
+ * @param argc the number of arguments after "regress"
+ * @param argv the arguments after "regress"
+ * @return 0 if every frame matches and is within budget
+ */
+int regressCommand(int argc, char *argv[]) {
+    String goldenDir, outputDir = ".";
+    bool update = false;
+    int threshold = 16, repeat = 30;
+    double maxBad = 0.002, budgetScale = 1.0;
+    for (int i = 0; i < argc; i++) {
+        String arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--golden" && hasValue) {
+            goldenDir = argv[++i];
+        } else if (arg == "--output" && hasValue) {
+            outputDir = argv[++i];
+        } else if (arg == "--update") {
+            update = true;
+        } else if (arg == "--threshold" && hasValue) {
+            threshold = atoi(argv[++i]);
+        } else if (arg == "--max-bad" && hasValue) {
+            maxBad = atof(argv[++i]);
+        } else if (arg == "--repeat" && hasValue) {
+            repeat = max(1, atoi(argv[++i]));
+        } else if (arg == "--budget-scale" && hasValue) {
+            budgetScale = atof(argv[++i]);
+        } else {
+            parseOption(argc, argv, i);
+        }
+    }
+    if (imageFile.empty() || goldenDir.empty()) {
+        cout << "Usage: OpenCVWithOpenGL regress IMAGE --golden DIR [options]" << endl;
+        cout << "  --golden DIR          directory of golden images" << endl;
+        cout << "  --update              write the golden images, instead of checking them" << endl;
+        cout << "  --output DIR          where to write the images that do not match (default .)" << endl;
+        cout << "  --threshold N         channel difference that still matches (default 16)" << endl;
+        cout << "  --max-bad F           fraction of pixels allowed to differ (default 0.002)" << endl;
+        cout << "  --repeat N            renders per frame, for timing (default 30)" << endl;
+        cout << "  --budget-scale S      multiply the time budgets by S (0 disables them; default 1)" << endl;
+        return -1;
+    }
+
+    recordFile.clear();     // recording would count against the time budgets
+    cameraFile.clear();     // the golden images are for the guessed camera
+    sceneFile.clear();      // and a gem on every marker, whatever is in the
+                            // current directory
+    const int size = 400;   // the default window size
+    HeadlessContext context;
+    if (!context.create(size, size)) {
+        cout << context.error() << endl;
+        return -1;
+    }
+    headless = true;
+    init();
+    reshape(size, size);
+
+    int failures = 0;
+    for (size_t i = 0; i < sizeof(regressionScenes) / sizeof(regressionScenes[0]); i++) {
+        const RegressionScene &rs = regressionScenes[i];
+
+        // Render the frame repeatedly; keep the last image and the median time
+        vector<double> times;
+        for (int r = 0; r < repeat; r++) {
+            zOffset = rs.zOffset;
+            double start = now();
+            display();
+            glFinish();
+            times.push_back((now() - start) * 1000.0);
+        }
+        nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+        double ms = times[times.size() / 2];
+        Mat actual = readFramebuffer(size, size);
+
+        String golden = goldenDir + "/" + rs.name + ".png";
+        if (update) {
+            bool ok = imwrite(golden, actual);
+            cout << rs.name << ": " << (ok ? "wrote " : "unable to write ") << golden << endl;
+            if (!ok) failures++;
+            continue;
+        }
+
+        Mat expected = imread(golden, CV_LOAD_IMAGE_COLOR), diff;
+        ImageDifference d = compareImages(actual, expected, threshold, diff);
+        bool match = !expected.empty() && d.badFraction <= maxBad;
+        bool fast = budgetScale <= 0.0 || ms <= rs.budget * budgetScale;
+        cout << rs.name << ": " << ms << " ms (budget " << rs.budget * budgetScale << "), "
+             << d.badFraction * 100.0 << "% of pixels differ, max " << d.maxError
+             << (match && fast ? "  OK" : "  FAILED") << endl;
+        if (expected.empty()) cout << "  missing golden image " << golden << endl;
+        if (!match) {
+            imwrite(outputDir + "/" + rs.name + "-actual.png", actual);
+            if (!diff.empty()) imwrite(outputDir + "/" + rs.name + "-diff.png", diff);
+        }
+        if (!match || !fast) failures++;
+    }
+    return failures == 0 ? 0 : 1;
+}
+#endif
+
 int main(int argc, char *argv[]) {
-    // Get the image file name from the command line
-    if (argc < 2) {
+    // Images freed in one frame are reused in the next, rather than
+    // returned to the heap
+    Mat::setDefaultAllocator(PooledMatAllocator::instance());
+
+    // Subcommands, which do not open a window
+    if (argc > 1 && String(argv[1]) == "calibrate") {
+        return calibrateCommand(argc - 2, argv + 2);
+    }
+    if (argc > 1 && String(argv[1]) == "convert") {
+        return convertCommand(argc - 2, argv + 2);
+    }
+#ifdef HAVE_EGL
+    if (argc > 1 && String(argv[1]) == "replay") {
+        return replayCommand(argc - 2, argv + 2);
+    }
+    if (argc > 1 && String(argv[1]) == "regress") {
+        return regressCommand(argc - 2, argv + 2);
+    }
+#endif
+    if (argc > 1 && String(argv[1]) == "batch") {
+        return batchCommand(argc - 2, argv + 2);
+    }
+    if (argc > 1 && String(argv[1]) == "trace") {
+        return traceCommand(argc - 2, argv + 2);
+    }
+
+    // Get the options and the image file name from the command line
+    for (int i = 1; i < argc; i++) {
+        parseOption(argc, argv, i);
+    }
+    if (imageFile.empty()) {
         cout << "Please specify the image file name as the first program argument" << endl;
+        cout << "(a video file, image sequence pattern, or camera index also works)" << endl;
+        printOptions();
+        cout << "To calibrate the camera from a folder of images, run:" << endl;
+        cout << "  " << argv[0] << " calibrate FOLDER [options]" << endl;
+        cout << "To convert a mesh to the packed form, which loads much faster, run:" << endl;
+        cout << "  " << argv[0] << " convert MESH [--output FILE]" << endl;
+#ifdef HAVE_EGL
+        cout << "To render offscreen and measure the frame rate, run:" << endl;
+        cout << "  " << argv[0] << " replay IMAGE [options]" << endl;
+        cout << "To check rendering against golden images, run:" << endl;
+        cout << "  " << argv[0] << " regress IMAGE --golden DIR [options]" << endl;
+#endif
+        cout << "To composite objects onto a folder of images, in parallel, run:" << endl;
+        cout << "  " << argv[0] << " batch FOLDER --output DIR [options]" << endl;
+        cout << "To convert a frame trace for ui.perfetto.dev or chrome://tracing, run:" << endl;
+        cout << "  " << argv[0] << " trace FILE [--output FILE]" << endl;
         return -1;
     }
-    imageFile = argv[1];
 
     // Initialize OpenGL, and create a context
     glutInit(&argc, argv);
-    glutInitDisplayMode(GLUT_SINGLE | GLUT_RGB | GLUT_DEPTH);
+    glutInitDisplayMode(GLUT_SINGLE | GLUT_RGB | GLUT_DEPTH | GLUT_STENCIL);
     glutInitWindowSize(400, 400);
     glutInitWindowPosition(100, 100);
     glutCreateWindow("OpenCV with OpenGL");
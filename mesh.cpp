@@ -0,0 +1,773 @@
+/*
+ * Triangle meshes for OpenCV with OpenGL
+ * See mesh.h for an overview.
+ */
+
+#include "mesh.h"
+#include "meshcache.h"
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <sstream>
+using namespace std;
+
+/**
+ * Reads a file through a buffer that is refilled as it is consumed, so
+ * the whole file is never in memory at once.
+ */
+class ChunkReader {
+public:
+    ChunkReader() : file(0), begin(0), end(0), eof(false), buffer(1 << 20), fileSize(0), fileRead(0) {}
+    ~ChunkReader() { if (file) fclose(file); }
+
+    bool open(const string &name) {
+        file = fopen(name.c_str(), "rb");
+        if (!file) return false;
+        fseek(file, 0, SEEK_END);
+        long size = ftell(file);
+        fseek(file, 0, SEEK_SET);
+        fileSize = size > 0 ? (size_t) size : 0;
+        return true;
+    }
+
+    /**
+     * @return the bytes of the file not yet taken, for checking the sizes
+     *         a header claims before allocating for them
+     */
+    size_t remaining() const {
+        return (end - begin) + (fileSize > fileRead ? fileSize - fileRead : 0);
+    }
+
+    /**
+     * Get the next line, without its line ending.
+     * @param line receives a pointer to the first character
+     * @param length receives the number of characters
+     * @return false at the end of the file
+     */
+    bool readLine(const char *&line, size_t &length) {
+        while (true) {
+            const char *p = &buffer[0] + begin;
+            const char *nl = (const char *) memchr(p, '\n', end - begin);
+            if (nl || (eof && begin < end)) {
+                size_t n = nl ? nl - p : end - begin;
+                begin += nl ? n + 1 : n;
+                if (n > 0 && p[n - 1] == '\r') n--;
+                line = p;
+                length = n;
+                return true;
+            }
+            if (eof) return false;
+            refill(end - begin + 1);
+        }
+    }
+
+    /**
+     * Get the next bytes of the file.
+     * @param n the number of bytes
+     * @return a pointer to them, valid until the next call, or 0 if the file is shorter
+     */
+    const char *take(size_t n) {
+        if (end - begin < n) {
+            refill(n);
+            if (end - begin < n) return 0;
+        }
+        const char *p = &buffer[0] + begin;
+        begin += n;
+        return p;
+    }
+
+private:
+    FILE *file;
+    size_t begin, end;      // the unread part of the buffer
+    bool eof;
+    vector<char> buffer;
+    size_t fileSize, fileRead;  // the bytes in the file, and read from it so far
+
+    /**
+     * Move the unread bytes to the front of the buffer, and read more
+     * after them, growing the buffer if it cannot hold want bytes.
+     */
+    void refill(size_t want) {
+        size_t left = end - begin;
+        if (left > 0 && begin > 0) memmove(&buffer[0], &buffer[0] + begin, left);
+        begin = 0;
+        end = left;
+        if (want > buffer.size()) buffer.resize(max(want, 2 * buffer.size()));
+        while (!eof && end < buffer.size()) {
+            size_t n = fread(&buffer[0] + end, 1, buffer.size() - end, file);
+            if (n == 0) eof = true;
+            end += n;
+            fileRead += n;
+            if (end >= want) break;
+        }
+    }
+};
+
+/**
+ * Skip spaces and tabs.
+ */
+static inline void skipBlanks(const char *&p, const char *end) {
+    while (p < end && (*p == ' ' || *p == '\t')) p++;
+}
+
+/**
+ * Parse a decimal number, such as "-1.25e-3", in place.  This is several
+ * times faster than strtod, which has to handle locales, hexadecimal and
+ * exact rounding, none of which matter for mesh coordinates.
+ * @param p the first character; advanced past the number
+ * @param end the end of the text
+ * @param value receives the number
+ * @return false if there is no number at p
+ */
+static bool parseFloat(const char *&p, const char *end, float &value) {
+    skipBlanks(p, end);
+    const char *start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+
+    double mantissa = 0.0;
+    int exponent = 0, digits = 0;
+    while (p < end && *p >= '0' && *p <= '9') {
+        mantissa = mantissa * 10.0 + (*p++ - '0');
+        digits++;
+    }
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && *p >= '0' && *p <= '9') {
+            mantissa = mantissa * 10.0 + (*p++ - '0');
+            exponent--;
+            digits++;
+        }
+    }
+    if (digits == 0) {
+        p = start;
+        return false;
+    }
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char *e = p++;
+        bool negativeExp = false;
+        if (p < end && (*p == '-' || *p == '+')) negativeExp = *p++ == '-';
+        if (p < end && *p >= '0' && *p <= '9') {
+            int n = 0;
+            while (p < end && *p >= '0' && *p <= '9') n = min(n * 10 + (*p++ - '0'), 1000);
+            exponent += negativeExp ? -n : n;
+        } else {
+            p = e;
+        }
+    }
+
+    static const double powers[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9,
+                                     1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16 };
+    if (exponent < 0 && exponent >= -16) {
+        mantissa /= powers[-exponent];
+    } else if (exponent > 0 && exponent <= 16) {
+        mantissa *= powers[exponent];
+    } else if (exponent != 0) {
+        mantissa *= pow(10.0, exponent);
+    }
+    value = (float) (negative ? -mantissa : mantissa);
+    return true;
+}
+
+/**
+ * Parse a decimal integer in place.
+ * @param p the first character; advanced past the number
+ * @param end the end of the text
+ * @param value receives the number
+ * @return false if there is no number at p
+ */
+static bool parseInt(const char *&p, const char *end, long &value) {
+    const char *start = p;
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) negative = *p++ == '-';
+    long n = 0;
+    const char *digits = p;
+    while (p < end && *p >= '0' && *p <= '9') n = n * 10 + (*p++ - '0');
+    if (p == digits) {
+        p = start;
+        return false;
+    }
+    value = negative ? -n : n;
+    return true;
+}
+
+/**
+ * @return a description of a problem on a line of a file
+ */
+static string lineError(const string &file, size_t line, const char *problem) {
+    ostringstream s;
+    s << file << ":" << line << ": " << problem;
+    return s.str();
+}
+
+/**
+ * Hash a (position, normal) index pair.
+ */
+static inline size_t hashPair(uint64_t key) {
+    return (size_t) ((key * 0x9E3779B97F4A7C15ULL) >> 24);
+}
+
+bool loadObj(const string &file, Mesh &mesh, string &error) {
+    mesh.clear();
+    ChunkReader reader;
+    if (!reader.open(file)) {
+        error = "Unable to open " + file;
+        return false;
+    }
+
+    // The positions and normals as listed in the file; a vertex of the mesh
+    // is a pair of them, as referenced by the faces
+    vector<float> filePositions, fileNormals;
+    bool unnormaled = false;            // whether any corner has no normal
+
+    // Corners without a normal are merged by position, through a direct
+    // lookup; the others by (position, normal) pair, through an open
+    // addressing hash table that is kept at most half full
+    vector<uint32_t> byPosition;
+    vector<uint64_t> pairKeys;          // key in each slot, or 0 if empty
+    vector<uint32_t> pairVertices;      // vertex in each slot
+    size_t pairCount = 0;
+
+    const char *line;
+    size_t length, lineNumber = 0;
+    vector<uint32_t> polygon;
+    while (reader.readLine(line, length)) {
+        lineNumber++;
+        const char *p = line, *end = line + length;
+        skipBlanks(p, end);
+        if (end - p < 2) continue;
+
+        if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+            p += 2;
+            float v[3];
+            for (int k = 0; k < 3; k++) {
+                if (!parseFloat(p, end, v[k])) {
+                    error = lineError(file, lineNumber, "expected 3 coordinates");
+                    return false;
+                }
+            }
+            filePositions.insert(filePositions.end(), v, v + 3);
+        } else if (p[0] == 'v' && p[1] == 'n' && end - p > 2 && (p[2] == ' ' || p[2] == '\t')) {
+            p += 3;
+            float n[3];
+            for (int k = 0; k < 3; k++) {
+                if (!parseFloat(p, end, n[k])) {
+                    error = lineError(file, lineNumber, "expected 3 normal components");
+                    return false;
+                }
+            }
+            fileNormals.insert(fileNormals.end(), n, n + 3);
+        } else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+            p += 2;
+            polygon.clear();
+            long positionCount = (long) filePositions.size() / 3;
+            long normalCount = (long) fileNormals.size() / 3;
+            while (true) {
+                skipBlanks(p, end);
+                if (p >= end) break;
+
+                // v, v/vt, v//vn or v/vt/vn; negative indices count back from the end
+                long v, t = 0, n = 0;
+                if (!parseInt(p, end, v)) {
+                    error = lineError(file, lineNumber, "expected a vertex index");
+                    return false;
+                }
+                if (p < end && *p == '/') {
+                    p++;
+                    parseInt(p, end, t);
+                    if (p < end && *p == '/') {
+                        p++;
+                        parseInt(p, end, n);
+                    }
+                }
+                if (v < 0) v += positionCount + 1;
+                if (n < 0) n += normalCount + 1;
+                if (v < 1 || v > positionCount || n > normalCount || n < 0) {
+                    error = lineError(file, lineNumber, "vertex index out of range");
+                    return false;
+                }
+
+                // Find or add the vertex
+                uint32_t index;
+                if (n == 0) {
+                    if (byPosition.size() < (size_t) positionCount) byPosition.resize(positionCount, UINT32_MAX);
+                    uint32_t &slot = byPosition[v - 1];
+                    if (slot == UINT32_MAX) {
+                        slot = (uint32_t) mesh.vertexCount();
+                        unnormaled = true;
+                        mesh.positions.insert(mesh.positions.end(), &filePositions[3 * (v - 1)], &filePositions[3 * (v - 1)] + 3);
+                        mesh.normals.insert(mesh.normals.end(), 3, 0.0f);
+                    }
+                    index = slot;
+                } else {
+                    if (2 * (pairCount + 1) > pairKeys.size()) {
+                        // Grow the table, and put the pairs back
+                        size_t size = max((size_t) 1024, 2 * pairKeys.size());
+                        vector<uint64_t> keys(size, 0);
+                        vector<uint32_t> vertices(size);
+                        for (size_t s = 0; s < pairKeys.size(); s++) {
+                            if (pairKeys[s] == 0) continue;
+                            size_t h = hashPair(pairKeys[s]) & (size - 1);
+                            while (keys[h] != 0) h = (h + 1) & (size - 1);
+                            keys[h] = pairKeys[s];
+                            vertices[h] = pairVertices[s];
+                        }
+                        pairKeys.swap(keys);
+                        pairVertices.swap(vertices);
+                    }
+                    uint64_t key = (uint64_t) v << 32 | (uint64_t) n;
+                    size_t mask = pairKeys.size() - 1;
+                    size_t h = hashPair(key) & mask;
+                    while (pairKeys[h] != 0 && pairKeys[h] != key) h = (h + 1) & mask;
+                    if (pairKeys[h] == 0) {
+                        pairKeys[h] = key;
+                        pairVertices[h] = (uint32_t) mesh.vertexCount();
+                        pairCount++;
+                        mesh.positions.insert(mesh.positions.end(), &filePositions[3 * (v - 1)], &filePositions[3 * (v - 1)] + 3);
+                        mesh.normals.insert(mesh.normals.end(), &fileNormals[3 * (n - 1)], &fileNormals[3 * (n - 1)] + 3);
+                    }
+                    index = pairVertices[h];
+                }
+                polygon.push_back(index);
+
+                // Skip anything else attached to this corner
+                while (p < end && *p != ' ' && *p != '\t') p++;
+            }
+
+            // Split the polygon into a fan of triangles
+            for (size_t k = 2; k < polygon.size(); k++) {
+                mesh.indices.push_back(polygon[0]);
+                mesh.indices.push_back(polygon[k - 1]);
+                mesh.indices.push_back(polygon[k]);
+            }
+        }
+    }
+
+    // Corners are merged above only by their (v, vn) pair; exports that
+    // repeat each "v" line for every face still have a vertex per corner,
+    // so merge identical vertices too.  Those without a normal still have
+    // a zero one, so they merge by position alone.
+    mesh.deduplicate();
+    if (mesh.indices.empty()) {
+        error = file + " has no faces";
+        return false;
+    }
+
+    // Compute normals for the corners the file gave none, keeping the
+    // file's for the rest (exports often mix "f v//n" and "f v" faces)
+    if (unnormaled) {
+        vector<float> given = mesh.normals;
+        mesh.computeNormals();
+        for (size_t k = 0; k < given.size(); k += 3) {
+            if (given[k] != 0.0f || given[k + 1] != 0.0f || given[k + 2] != 0.0f) {
+                copy(&given[k], &given[k] + 3, &mesh.normals[k]);
+            }
+        }
+    }
+    return true;
+}
+
+// PLY property types
+enum PlyType { PLY_NONE, PLY_INT8, PLY_UINT8, PLY_INT16, PLY_UINT16, PLY_INT32, PLY_UINT32, PLY_FLOAT32, PLY_FLOAT64 };
+
+/**
+ * @return the type for a PLY type name, or PLY_NONE
+ */
+static PlyType plyType(const string &name) {
+    if (name == "char" || name == "int8") return PLY_INT8;
+    if (name == "uchar" || name == "uint8") return PLY_UINT8;
+    if (name == "short" || name == "int16") return PLY_INT16;
+    if (name == "ushort" || name == "uint16") return PLY_UINT16;
+    if (name == "int" || name == "int32") return PLY_INT32;
+    if (name == "uint" || name == "uint32") return PLY_UINT32;
+    if (name == "float" || name == "float32") return PLY_FLOAT32;
+    if (name == "double" || name == "float64") return PLY_FLOAT64;
+    return PLY_NONE;
+}
+
+/**
+ * @return the size of a value of a PLY type, in bytes
+ */
+static size_t plySize(PlyType type) {
+    static const size_t sizes[] = { 0, 1, 1, 2, 2, 4, 4, 4, 8 };
+    return sizes[type];
+}
+
+/**
+ * Convert a binary PLY value to a double.
+ * @param p the bytes of the value
+ * @param type the type of the value
+ * @param swap true if the file's byte order is not the machine's
+ */
+static double plyValue(const char *p, PlyType type, bool swap) {
+    char b[8];
+    size_t n = plySize(type);
+    if (swap) {
+        for (size_t k = 0; k < n; k++) b[k] = p[n - 1 - k];
+    } else {
+        memcpy(b, p, n);
+    }
+    switch (type) {
+    case PLY_INT8: { int8_t v; memcpy(&v, b, 1); return v; }
+    case PLY_UINT8: { uint8_t v; memcpy(&v, b, 1); return v; }
+    case PLY_INT16: { int16_t v; memcpy(&v, b, 2); return v; }
+    case PLY_UINT16: { uint16_t v; memcpy(&v, b, 2); return v; }
+    case PLY_INT32: { int32_t v; memcpy(&v, b, 4); return v; }
+    case PLY_UINT32: { uint32_t v; memcpy(&v, b, 4); return v; }
+    case PLY_FLOAT32: { float v; memcpy(&v, b, 4); return v; }
+    case PLY_FLOAT64: { double v; memcpy(&v, b, 8); return v; }
+    default: return 0.0;
+    }
+}
+
+struct PlyProperty {
+    string name;
+    PlyType type;           // the type of the value, or of the list items
+    PlyType countType;      // the type of the list length, or PLY_NONE if not a list
+};
+
+// The most vertices a face may list; more means a corrupt file
+static const size_t kMaxPlyList = 1 << 16;
+
+struct PlyElement {
+    string name;
+    size_t count;
+    vector<PlyProperty> properties;
+};
+
+bool loadPly(const string &file, Mesh &mesh, string &error) {
+    mesh.clear();
+    ChunkReader reader;
+    if (!reader.open(file)) {
+        error = "Unable to open " + file;
+        return false;
+    }
+
+    // Read the header, up to "end_header"
+    const char *line;
+    size_t length, lineNumber = 0;
+    bool bigEndian = false, formatSeen = false;
+    vector<PlyElement> elements;
+    while (true) {
+        if (!reader.readLine(line, length)) {
+            error = file + " has no end_header";
+            return false;
+        }
+        lineNumber++;
+        istringstream s(string(line, length));
+        string keyword;
+        s >> keyword;
+        if (lineNumber == 1) {
+            if (keyword != "ply") {
+                error = file + " is not a PLY file";
+                return false;
+            }
+        } else if (keyword == "format") {
+            string format;
+            s >> format;
+            if (format == "binary_big_endian") {
+                bigEndian = true;
+            } else if (format != "binary_little_endian") {
+                error = file + ": only binary PLY files are supported, not " + format;
+                return false;
+            }
+            formatSeen = true;
+        } else if (keyword == "element") {
+            PlyElement element;
+            s >> element.name >> element.count;
+            elements.push_back(element);
+        } else if (keyword == "property") {
+            if (elements.empty()) {
+                error = lineError(file, lineNumber, "property before any element");
+                return false;
+            }
+            PlyProperty property;
+            string type;
+            s >> type;
+            property.countType = PLY_NONE;
+            if (type == "list") {
+                string countType;
+                s >> countType >> type;
+                property.countType = plyType(countType);
+                if (property.countType == PLY_NONE) {
+                    error = lineError(file, lineNumber, "unknown type");
+                    return false;
+                }
+            }
+            property.type = plyType(type);
+            s >> property.name;
+            if (property.type == PLY_NONE) {
+                error = lineError(file, lineNumber, "unknown type");
+                return false;
+            }
+            elements.back().properties.push_back(property);
+        } else if (keyword == "end_header") {
+            break;
+        }
+    }
+    if (!formatSeen) {
+        error = file + " has no format";
+        return false;
+    }
+
+    uint16_t one = 1;
+    bool swap = bigEndian == (*(const char *) &one == 1);
+
+    bool hasNormals = false;
+    vector<uint32_t> polygon;
+    for (size_t e = 0; e < elements.size(); e++) {
+        const PlyElement &element = elements[e];
+        bool isVertex = element.name == "vertex", isFace = element.name == "face";
+
+        // Where each property goes: 0-2 position, 3-5 normal, 6 face indices, -1 skipped
+        vector<int> slot(element.properties.size(), -1);
+        for (size_t k = 0; k < element.properties.size(); k++) {
+            const string &name = element.properties[k].name;
+            bool isList = element.properties[k].countType != PLY_NONE;
+            if (isVertex && !isList) {
+                static const char *names[] = { "x", "y", "z", "nx", "ny", "nz" };
+                for (int c = 0; c < 6; c++) {
+                    if (name == names[c]) slot[k] = c;
+                }
+            } else if (isFace && isList && (name == "vertex_indices" || name == "vertex_index")) {
+                slot[k] = 6;
+            }
+        }
+
+        // Each record takes at least its scalars and list lengths, so a
+        // count the rest of the file cannot hold is corrupt; check before
+        // allocating for it
+        size_t recordSize = 0;
+        for (size_t k = 0; k < element.properties.size(); k++) {
+            const PlyProperty &property = element.properties[k];
+            recordSize += plySize(property.countType == PLY_NONE ? property.type : property.countType);
+        }
+        if (recordSize == 0) continue;
+        if (element.count > reader.remaining() / recordSize) {
+            error = file + ": more " + element.name + " records than the file holds";
+            return false;
+        }
+
+        if (isVertex) {
+            hasNormals = find(slot.begin(), slot.end(), 3) != slot.end();
+            mesh.positions.assign(3 * element.count, 0.0f);
+            mesh.normals.assign(3 * element.count, 0.0f);
+        }
+        if (isFace) mesh.indices.reserve(3 * element.count);
+
+        for (size_t i = 0; i < element.count; i++) {
+            for (size_t k = 0; k < element.properties.size(); k++) {
+                const PlyProperty &property = element.properties[k];
+                size_t size = plySize(property.type);
+                if (property.countType == PLY_NONE) {
+                    const char *p = reader.take(size);
+                    if (!p) {
+                        error = file + " is truncated";
+                        return false;
+                    }
+                    if (slot[k] >= 0) {
+                        float v = (float) plyValue(p, property.type, swap);
+                        if (slot[k] < 3) {
+                            mesh.positions[3 * i + slot[k]] = v;
+                        } else {
+                            mesh.normals[3 * i + slot[k] - 3] = v;
+                        }
+                    }
+                    continue;
+                }
+
+                const char *p = reader.take(plySize(property.countType));
+                if (!p) {
+                    error = file + " is truncated";
+                    return false;
+                }
+                double listed = plyValue(p, property.countType, swap);
+                if (listed < 0 || listed > kMaxPlyList) {
+                    error = file + ": bad list length";
+                    return false;
+                }
+                size_t count = (size_t) listed;
+                p = count * size <= reader.remaining() ? reader.take(count * size) : 0;
+                if (!p) {
+                    error = file + " is truncated";
+                    return false;
+                }
+                if (slot[k] != 6) continue;
+
+                // Split the polygon into a fan of triangles.  The faces may
+                // come before the vertices, so the indices are checked
+                // against the vertex count once every element is read.
+                polygon.clear();
+                for (size_t c = 0; c < count; c++) {
+                    double index = plyValue(p + c * size, property.type, swap);
+                    if (index < 0 || index > 4294967295.0) {
+                        error = file + ": vertex index out of range";
+                        return false;
+                    }
+                    polygon.push_back((uint32_t) index);
+                }
+                for (size_t c = 2; c < polygon.size(); c++) {
+                    mesh.indices.push_back(polygon[0]);
+                    mesh.indices.push_back(polygon[c - 1]);
+                    mesh.indices.push_back(polygon[c]);
+                }
+            }
+        }
+    }
+
+    if (mesh.indices.empty()) {
+        error = file + " has no faces";
+        return false;
+    }
+    size_t vertices = mesh.vertexCount();
+    for (size_t i = 0; i < mesh.indices.size(); i++) {
+        if (mesh.indices[i] >= vertices) {
+            error = file + ": vertex index out of range";
+            return false;
+        }
+    }
+
+    // Files converted from STL repeat each vertex for every triangle, so
+    // merge them before computing smooth normals
+    if (!hasNormals) {
+        mesh.normals.assign(mesh.positions.size(), 0.0f);
+        mesh.deduplicate();
+        mesh.computeNormals();
+    } else {
+        mesh.deduplicate();
+    }
+    return true;
+}
+
+bool loadMesh(const string &file, Mesh &mesh, string &error) {
+    size_t dot = file.rfind('.');
+    string ext = dot == string::npos ? "" : file.substr(dot + 1);
+    for (size_t i = 0; i < ext.size(); i++) ext[i] = (char) tolower((unsigned char) ext[i]);
+    if (ext == "obj") return loadObj(file, mesh, error);
+    if (ext == "ply") return loadPly(file, mesh, error);
+    if (ext == "pmesh") {
+        PackedMeshFile packed;
+        if (!packed.open(file, error)) return false;
+        unpackMesh(packed.mesh(), mesh);
+        return true;
+    }
+    error = "Unknown mesh format: " + file;
+    return false;
+}
+
+void Mesh::computeNormals() {
+    normals.assign(positions.size(), 0.0f);
+
+    // The cross product of two edges is twice the area of the triangle, so
+    // summing them weights each face by its area
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        const float *a = &positions[3 * indices[i]];
+        const float *b = &positions[3 * indices[i + 1]];
+        const float *c = &positions[3 * indices[i + 2]];
+        float u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+        float v[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+        float n[3] = { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0] };
+        for (int k = 0; k < 3; k++) {
+            float *m = &normals[3 * indices[i + k]];
+            m[0] += n[0];
+            m[1] += n[1];
+            m[2] += n[2];
+        }
+    }
+
+    for (size_t i = 0; i < normals.size(); i += 3) {
+        float *n = &normals[i];
+        float len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        if (len > 0.0f) {
+            n[0] /= len;
+            n[1] /= len;
+            n[2] /= len;
+        } else {
+            n[0] = 0.0f;
+            n[1] = 0.0f;
+            n[2] = 1.0f;
+        }
+    }
+}
+
+/**
+ * Hash the bits of a vertex.
+ */
+static inline uint32_t hashVertex(const float *p, const float *n) {
+    uint32_t bits[6];
+    memcpy(bits, p, 12);
+    memcpy(bits + 3, n, 12);
+    uint32_t h = 2166136261u;
+    for (int k = 0; k < 6; k++) h = (h ^ bits[k]) * 16777619u;
+    return h ^ (h >> 15);
+}
+
+void Mesh::deduplicate() {
+    size_t count = vertexCount();
+    if (normals.size() != positions.size()) normals.assign(positions.size(), 0.0f);
+
+    // Open addressing table of the new vertices, at most half full
+    size_t size = 1;
+    while (size < 2 * count) size *= 2;
+    vector<uint32_t> table(size, UINT32_MAX);
+    vector<uint32_t> remap(count, UINT32_MAX);
+    vector<float> newPositions, newNormals;
+    newPositions.reserve(positions.size());
+    newNormals.reserve(normals.size());
+
+    // Vertices are numbered in the order the triangles first use them
+    for (size_t i = 0; i < indices.size(); i++) {
+        uint32_t v = indices[i];
+        if (remap[v] == UINT32_MAX) {
+            const float *p = &positions[3 * v], *n = &normals[3 * v];
+            size_t h = hashVertex(p, n) & (size - 1);
+            while (table[h] != UINT32_MAX) {
+                uint32_t w = table[h];
+                if (memcmp(&newPositions[3 * w], p, 12) == 0 && memcmp(&newNormals[3 * w], n, 12) == 0) break;
+                h = (h + 1) & (size - 1);
+            }
+            if (table[h] == UINT32_MAX) {
+                table[h] = (uint32_t) (newPositions.size() / 3);
+                newPositions.insert(newPositions.end(), p, p + 3);
+                newNormals.insert(newNormals.end(), n, n + 3);
+            }
+            remap[v] = table[h];
+        }
+        indices[i] = remap[v];
+    }
+
+    // Drop triangles that merging has collapsed
+    size_t kept = 0;
+    for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+        uint32_t a = indices[i], b = indices[i + 1], c = indices[i + 2];
+        if (a == b || b == c || c == a) continue;
+        indices[kept++] = a;
+        indices[kept++] = b;
+        indices[kept++] = c;
+    }
+    indices.resize(kept);
+
+    positions.swap(newPositions);
+    normals.swap(newNormals);
+}
+
+void Mesh::bounds(float lo[3], float hi[3]) const {
+    for (int k = 0; k < 3; k++) {
+        lo[k] = positions.empty() ? 0.0f : positions[k];
+        hi[k] = lo[k];
+    }
+    for (size_t i = 0; i < positions.size(); i += 3) {
+        for (int k = 0; k < 3; k++) {
+            lo[k] = min(lo[k], positions[i + k]);
+            hi[k] = max(hi[k], positions[i + k]);
+        }
+    }
+}
+
+void Mesh::clear() {
+    positions.clear();
+    normals.clear();
+    indices.clear();
+}
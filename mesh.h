@@ -0,0 +1,91 @@
+/*
+ * Triangle meshes for OpenCV with OpenGL
+ *
+ * An indexed triangle mesh with per-vertex positions and normals, and
+ * loaders for Wavefront OBJ and binary PLY files.  The loaders read the
+ * file in fixed-size chunks and parse numbers in place, without building
+ * a string per line or per token, so large CAD exports load quickly.
+ * Identical vertices are merged, and normals are computed if the file has
+ * none.
+ */
+
+#ifndef MESH_H
+#define MESH_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+struct Mesh {
+    std::vector<float> positions;   // x, y, z per vertex
+    std::vector<float> normals;     // x, y, z per vertex (unit length)
+    std::vector<uint32_t> indices;  // 3 per triangle, counter-clockwise
+
+    size_t vertexCount() const { return positions.size() / 3; }
+    size_t triangleCount() const { return indices.size() / 3; }
+
+    /**
+     * Compute smooth normals: each vertex gets the area-weighted average of
+     * the normals of the triangles around it.
+     */
+    void computeNormals();
+
+    /**
+     * Merge vertices with identical positions and normals, and remove the
+     * vertices no triangle uses.  Triangles are not changed.
+     */
+    void deduplicate();
+
+    /**
+     * Compute the axis-aligned bounding box.
+     * @param lo receives the minimum corner
+     * @param hi receives the maximum corner
+     */
+    void bounds(float lo[3], float hi[3]) const;
+
+    /**
+     * Remove all vertices and triangles.
+     */
+    void clear();
+};
+
+/**
+ * Coarser versions of a mesh, for drawing it when it is small on screen.
+ * They use the mesh's own vertices, so they share its vertex buffer.
+ */
+struct LodChain {
+    std::vector<std::vector<uint32_t> > indices;   // the triangles of each level, coarsest last
+    std::vector<float> errors;                      // how far each level strays from the mesh, in model units
+};
+
+/**
+ * Load a Wavefront OBJ file.  Only the geometry ("v", "vn" and "f") is
+ * used; polygons are split into triangle fans.
+ * @param file the file name
+ * @param mesh receives the mesh
+ * @param error receives a description of the problem, on failure
+ * @return false if the file could not be read
+ */
+bool loadObj(const std::string &file, Mesh &mesh, std::string &error);
+
+/**
+ * Load a binary PLY file (little or big endian).  Uses the x, y, z and
+ * (if present) nx, ny, nz properties of the "vertex" element, and the
+ * "vertex_indices" (or "vertex_index") list of the "face" element.
+ * @param file the file name
+ * @param mesh receives the mesh
+ * @param error receives a description of the problem, on failure
+ * @return false if the file could not be read
+ */
+bool loadPly(const std::string &file, Mesh &mesh, std::string &error);
+
+/**
+ * Load a mesh, choosing the loader from the file extension.
+ * @param file the file name (.obj, .ply, or a packed mesh, .pmesh)
+ * @param mesh receives the mesh
+ * @param error receives a description of the problem, on failure
+ * @return false if the file could not be read
+ */
+bool loadMesh(const std::string &file, Mesh &mesh, std::string &error);
+
+#endif // MESH_H
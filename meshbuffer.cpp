@@ -0,0 +1,205 @@
+/*
+ * Mesh buffers for OpenCV with OpenGL
+ * See meshbuffer.h for an overview.
+ */
+
+#include "meshbuffer.h"
+#include "glprocs.h"
+#include "simplify.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+using namespace std;
+
+MeshBuffer::MeshBuffer() : vertexBuffer(0), normalBuffer(0), indexBuffer(0), indexType(GL_UNSIGNED_INT),
+    vertexType(GL_FLOAT), normalType(GL_FLOAT), vertexStride(0), normalStride(0), normalOffset(0), scale(1.0f),
+    boundsRadius(0.0f) {
+    center[0] = center[1] = center[2] = 0.0f;
+    boundsCenter[0] = boundsCenter[1] = boundsCenter[2] = 0.0f;
+}
+
+bool MeshBuffer::upload(const Mesh &mesh, const LodChain *lods) {
+    release();
+    if (mesh.indices.empty()) return false;
+
+    // Interleave the attributes, so each vertex is fetched from one place
+    size_t n = mesh.vertexCount();
+    bool hasNormals = mesh.normals.size() == mesh.positions.size();
+    vector<float> vertices(6 * n);
+    for (size_t i = 0; i < n; i++) {
+        for (int k = 0; k < 3; k++) {
+            vertices[6 * i + k] = mesh.positions[3 * i + k];
+            vertices[6 * i + 3 + k] = hasNormals ? mesh.normals[3 * i + k] : (k == 2 ? 1.0f : 0.0f);
+        }
+    }
+
+    glGenBuffers(1, &vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(float), &vertices[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    normalBuffer = vertexBuffer;
+    vertexType = GL_FLOAT;
+    normalType = GL_FLOAT;
+    vertexStride = 6 * sizeof(float);
+    normalStride = 6 * sizeof(float);
+    normalOffset = 3 * sizeof(float);
+    center[0] = center[1] = center[2] = 0.0f;
+    scale = 1.0f;
+
+    float lo[3], hi[3], radius = 0.0f;
+    mesh.bounds(lo, hi);
+    for (int k = 0; k < 3; k++) {
+        boundsCenter[k] = 0.5f * (lo[k] + hi[k]);
+        radius += 0.25f * (hi[k] - lo[k]) * (hi[k] - lo[k]);
+    }
+    boundsRadius = sqrt(radius);
+
+    // The levels of detail follow the mesh in one index buffer
+    Level level;
+    level.first = 0;
+    level.count = mesh.indices.size();
+    level.error = 0.0f;
+    levels.push_back(level);
+    vector<uint32_t> indices(mesh.indices);
+    for (size_t i = 0; lods && i < lods->indices.size(); i++) {
+        level.first = indices.size();
+        level.count = lods->indices[i].size();
+        level.error = lods->errors[i];
+        levels.push_back(level);
+        indices.insert(indices.end(), lods->indices[i].begin(), lods->indices[i].end());
+    }
+
+    for (size_t i = 1; i < levels.size(); i++) errors.push_back(levels[i].error);
+
+    // Half the index data, when the indices fit in 16 bits
+    if (n <= 65536) {
+        vector<GLushort> shortIndices(indices.begin(), indices.end());
+        uploadIndices(&shortIndices[0], shortIndices.size(), false);
+    } else {
+        uploadIndices(&indices[0], indices.size(), true);
+    }
+    return true;
+}
+
+bool MeshBuffer::upload(const PackedMesh &mesh) {
+    release();
+    const PackedMeshHeader &header = *mesh.header;
+    if (header.indexCount == 0) return false;
+    size_t n = header.vertexCount;
+
+    // The positions go straight from the mapped file to OpenGL
+    glGenBuffers(1, &vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, 4 * n * sizeof(int16_t), mesh.positions, GL_STATIC_DRAW);
+
+    // Normals are expanded from octahedral form to 16-bit vectors, which
+    // OpenGL scales to [-1, 1]
+    vector<GLshort> normals(4 * n);
+    float v[3];
+    for (size_t i = 0; i < n; i++) {
+        decodeOctahedral(&mesh.normals[2 * i], v);
+        for (int k = 0; k < 3; k++) normals[4 * i + k] = (GLshort) floor(v[k] * 32767.0f + 0.5f);
+        normals[4 * i + 3] = 0;
+    }
+    glGenBuffers(1, &normalBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
+    glBufferData(GL_ARRAY_BUFFER, normals.size() * sizeof(GLshort), normals.empty() ? 0 : &normals[0], GL_STATIC_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    vertexType = GL_SHORT;
+    normalType = GL_SHORT;
+    vertexStride = 4 * sizeof(GLshort);
+    normalStride = 4 * sizeof(GLshort);
+    normalOffset = 0;
+    for (int k = 0; k < 3; k++) {
+        center[k] = header.center[k];
+        boundsCenter[k] = header.center[k];
+    }
+    scale = header.scale;
+    boundsRadius = sqrt(3.0f) * 32767.0f * header.scale;
+
+    Level level;
+    for (uint32_t i = 0; i < header.levelCount; i++) {
+        level.first = mesh.levels[i].first;
+        level.count = mesh.levels[i].count;
+        level.error = mesh.levels[i].error;
+        levels.push_back(level);
+    }
+    if (levels.empty()) {
+        level.first = 0;
+        level.count = header.indexCount;
+        level.error = 0.0f;
+        levels.push_back(level);
+    }
+
+    for (size_t i = 1; i < levels.size(); i++) errors.push_back(levels[i].error);
+    uploadIndices(mesh.indices, header.indexCount, mesh.wideIndices());
+    return true;
+}
+
+void MeshBuffer::uploadIndices(const void *indices, size_t n, bool wide) {
+    glGenBuffers(1, &indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, n * (wide ? 4 : 2), indices, GL_STATIC_DRAW);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    indexType = wide ? GL_UNSIGNED_INT : GL_UNSIGNED_SHORT;
+}
+
+int MeshBuffer::selectLevel(double tolerance) const {
+    if (levels.size() < 2 || tolerance <= 0.0) return 0;
+
+    double m[16], p[16];
+    GLint viewport[4];
+    glGetDoublev(GL_MODELVIEW_MATRIX, m);
+    glGetDoublev(GL_PROJECTION_MATRIX, p);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    return ::selectLevel(&errors[0], (int) errors.size(), boundsCenter, boundsRadius, m, p, viewport[3], tolerance);
+}
+
+void MeshBuffer::draw(int level) const {
+    if (levels.empty()) return;
+    const Level &range = levels[max(0, min(level, (int) levels.size() - 1))];
+
+    // Packed positions are scaled back by the modelview matrix, which also
+    // scales the normals, so they need normalizing
+    bool packed = vertexType != GL_FLOAT;
+    if (packed) {
+        glPushAttrib(GL_ENABLE_BIT | GL_TRANSFORM_BIT);
+        glEnable(GL_NORMALIZE);
+        glMatrixMode(GL_MODELVIEW);
+        glPushMatrix();
+        glTranslatef(center[0], center[1], center[2]);
+        glScalef(scale, scale, scale);
+    }
+
+    glPushClientAttrib(GL_CLIENT_VERTEX_ARRAY_BIT);
+    glEnableClientState(GL_VERTEX_ARRAY);
+    glEnableClientState(GL_NORMAL_ARRAY);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glVertexPointer(3, vertexType, vertexStride, (const GLvoid *) 0);
+    glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
+    glNormalPointer(normalType, normalStride, (const GLvoid *) (size_t) normalOffset);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    size_t indexSize = indexType == GL_UNSIGNED_INT ? 4 : 2;
+    glDrawElements(GL_TRIANGLES, (GLsizei) range.count, indexType, (const GLvoid *) (range.first * indexSize));
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glPopClientAttrib();
+
+    if (packed) {
+        glMatrixMode(GL_MODELVIEW);
+        glPopMatrix();
+        glPopAttrib();
+    }
+}
+
+void MeshBuffer::release() {
+    if (normalBuffer && normalBuffer != vertexBuffer) glDeleteBuffers(1, &normalBuffer);
+    if (vertexBuffer) glDeleteBuffers(1, &vertexBuffer);
+    if (indexBuffer) glDeleteBuffers(1, &indexBuffer);
+    vertexBuffer = 0;
+    normalBuffer = 0;
+    indexBuffer = 0;
+    levels.clear();
+    errors.clear();
+}
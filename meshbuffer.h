@@ -0,0 +1,115 @@
+/*
+ * Mesh buffers for OpenCV with OpenGL
+ *
+ * A Mesh uploaded to OpenGL vertex and index buffers, and drawn with
+ * glDrawElements.  Unlike a display list of immediate mode calls, the
+ * vertices shared by several triangles are sent and transformed once, and
+ * a mesh of a million triangles is drawn with a single call.  Requires
+ * OpenGL 1.5.
+ *
+ * A packed mesh is uploaded as it lies in the file: positions as 16-bit
+ * integers, scaled back by the modelview matrix when drawn; only the
+ * normals, which OpenGL cannot decode, are expanded first.
+ *
+ * Coarser levels of detail share the vertex buffer, and their indices
+ * follow the mesh's in the index buffer.  Each frame, the coarsest level
+ * whose error would not show at the mesh's distance is drawn.
+ */
+
+#ifndef MESHBUFFER_H
+#define MESHBUFFER_H
+
+#include "mesh.h"
+#include "meshcache.h"
+#include <vector>
+
+class MeshBuffer {
+public:
+    MeshBuffer();
+
+    /**
+     * Copy a mesh to new buffers, replacing any previous ones.  Positions
+     * and normals are interleaved; indices are 16-bit when the mesh has few
+     * enough vertices.  Requires a current OpenGL context.
+     * @param mesh the mesh
+     * @param lods coarser levels of detail, if any
+     * @return false if the mesh is empty
+     */
+    bool upload(const Mesh &mesh, const LodChain *lods = 0);
+
+    /**
+     * Copy a packed mesh, with its levels of detail, to new buffers,
+     * replacing any previous ones.  Requires a current OpenGL context.
+     * @param mesh the packed mesh
+     * @return false if the mesh is empty
+     */
+    bool upload(const PackedMesh &mesh);
+
+    /**
+     * Choose the level of detail for the current transformation: the
+     * coarsest one whose error, projected to the screen, is within the
+     * tolerance.
+     * @param tolerance the largest error allowed, in pixels
+     * @return the level, 0 for full detail
+     */
+    int selectLevel(double tolerance) const;
+
+    /**
+     * Draw the mesh, with the current material and transformation.
+     * @param level the level of detail
+     */
+    void draw(int level = 0) const;
+
+    /**
+     * Delete the buffers.  Requires the context they were created in.
+     */
+    void release();
+
+    /**
+     * @return true if the buffers hold a mesh
+     */
+    bool valid() const { return !levels.empty(); }
+
+    /**
+     * @return the number of levels of detail, including full detail
+     */
+    int levelCount() const { return (int) levels.size(); }
+
+    /**
+     * @param level the level of detail
+     * @return the number of triangles at that level
+     */
+    size_t triangleCount(int level = 0) const { return levels.empty() ? 0 : levels[level].count / 3; }
+
+    /**
+     * Get a sphere around the mesh, for culling.
+     * @param c set to the center, in model units
+     * @param r set to the radius, in model units
+     */
+    void boundingSphere(float c[3], float &r) const {
+        for (int k = 0; k < 3; k++) c[k] = boundsCenter[k];
+        r = boundsRadius;
+    }
+
+private:
+    unsigned int vertexBuffer, normalBuffer, indexBuffer;   // OpenGL buffer names; the normals may share the vertex buffer
+    unsigned int indexType;                     // GL_UNSIGNED_SHORT or GL_UNSIGNED_INT
+    unsigned int vertexType, normalType;        // GL_FLOAT, or GL_SHORT when packed
+    int vertexStride, normalStride, normalOffset;
+    float center[3], scale;                     // maps packed positions back to model units
+    float boundsCenter[3], boundsRadius;        // a sphere around the mesh, in model units
+
+    struct Level {
+        size_t first, count;                    // the range of indices
+        float error;                            // how far it strays from full detail, in model units
+    };
+    std::vector<Level> levels;
+    std::vector<float> errors;                  // the errors of the coarser levels, for selectLevel()
+
+    /**
+     * Upload the indices of all the levels.
+     */
+    void uploadIndices(const void *indices, size_t n, bool wide);
+};
+
+#endif // MESHBUFFER_H
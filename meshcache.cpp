@@ -0,0 +1,367 @@
+/*
+ * Packed mesh files for OpenCV with OpenGL
+ * See meshcache.h for an overview.
+ */
+
+#include "meshcache.h"
+#include "meshopt.h"
+#include "simplify.h"
+#include <opencv2/core/core.hpp>
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+using namespace cv;
+using namespace std;
+
+static const char packedMagic[8] = { 'O', 'C', 'V', 'G', 'L', 'P', 'M', 0 };
+
+/**
+ * @return the number of bytes, rounded up to a multiple of 4
+ */
+static size_t align4(size_t n) {
+    return (n + 3) & ~(size_t) 3;
+}
+
+/**
+ * @return true if every index is below the vertex count
+ */
+template <class Index>
+static bool indicesInRange(const Index *indices, size_t count, uint32_t vertexCount) {
+    Index highest = 0;
+    for (size_t i = 0; i < count; i++) highest = max(highest, indices[i]);
+    return count == 0 || highest < vertexCount;
+}
+
+PackedMeshFile::PackedMeshFile() : data(0), size(0) {
+    memset(&packed, 0, sizeof(packed));
+}
+
+PackedMeshFile::~PackedMeshFile() {
+    close();
+}
+
+bool PackedMeshFile::open(const string &file, string &error) {
+    close();
+#ifndef _WIN32
+    int fd = ::open(file.c_str(), O_RDONLY);
+    if (fd < 0) {
+        error = "Unable to open " + file;
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        size = (size_t) st.st_size;
+        data = mmap(0, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data == MAP_FAILED) data = 0;
+    }
+    ::close(fd);
+    if (!data) {
+        size = 0;
+        error = "Unable to map " + file;
+        return false;
+    }
+#else
+    FILE *f = fopen(file.c_str(), "rb");
+    if (!f) {
+        error = "Unable to open " + file;
+        return false;
+    }
+    fseek(f, 0, SEEK_END);
+    copy.resize((size_t) max(0L, ftell(f)));
+    fseek(f, 0, SEEK_SET);
+    size = copy.empty() ? 0 : fread(&copy[0], 1, copy.size(), f);
+    fclose(f);
+    data = copy.empty() ? 0 : &copy[0];
+#endif
+
+    // Check the header, and that the sections fit in the file
+    const PackedMeshHeader *header = (const PackedMeshHeader *) data;
+    uint16_t one = 1;
+    if (size < sizeof(PackedMeshHeader) || memcmp(header->magic, packedMagic, 8) != 0) {
+        error = file + " is not a packed mesh";
+    } else if (header->version != 1) {
+        error = file + " is a packed mesh of an unknown version";
+    } else if (*(const char *) &one != 1) {
+        error = "Packed meshes are little endian, and this machine is not";
+    } else {
+        size_t indexSize = (header->flags & PACKED_WIDE_INDICES) ? 4 : 2;
+        size_t indexBytes = align4(indexSize * header->indexCount);
+        size_t needed = sizeof(PackedMeshHeader) + 12 * (size_t) header->vertexCount + indexBytes
+                      + sizeof(PackedMeshLevel) * header->levelCount;
+        if (size < needed) {
+            error = file + " is truncated";
+        } else {
+            const char *p = (const char *) data + sizeof(PackedMeshHeader);
+            packed.header = header;
+            packed.positions = (const int16_t *) p;
+            packed.normals = (const int16_t *) (p + 8 * (size_t) header->vertexCount);
+            packed.indices = p + 12 * (size_t) header->vertexCount;
+            packed.levels = (const PackedMeshLevel *) ((const char *) packed.indices + indexBytes);
+            bool valid = true;
+            for (uint32_t i = 0; i < header->levelCount; i++) {
+                const PackedMeshLevel &level = packed.levels[i];
+                if (level.first > header->indexCount || level.count > header->indexCount - level.first) valid = false;
+            }
+
+            // Every index is used to read vertices, by OpenGL and by the
+            // software rasterizer, so one out of range is fatal later
+            bool inRange = packed.wideIndices()
+                ? indicesInRange((const uint32_t *) packed.indices, header->indexCount, header->vertexCount)
+                : indicesInRange((const uint16_t *) packed.indices, header->indexCount, header->vertexCount);
+            if (valid && inRange) return true;
+            error = file + (valid ? " has a vertex index out of range" : " has an invalid level of detail");
+        }
+    }
+    close();
+    return false;
+}
+
+void PackedMeshFile::close() {
+#ifndef _WIN32
+    if (data) munmap(data, size);
+#endif
+    copy.clear();
+    data = 0;
+    size = 0;
+    memset(&packed, 0, sizeof(packed));
+}
+
+/**
+ * @return -1 for negative numbers, otherwise 1
+ */
+static inline float signNotZero(float v) {
+    return v < 0.0f ? -1.0f : 1.0f;
+}
+
+void encodeOctahedral(const float n[3], int16_t e[2]) {
+    // Project onto the octahedron |x| + |y| + |z| = 1, and fold the lower
+    // half over the upper one
+    float l1 = fabs(n[0]) + fabs(n[1]) + fabs(n[2]);
+    float x = l1 > 0.0f ? n[0] / l1 : 0.0f;
+    float y = l1 > 0.0f ? n[1] / l1 : 0.0f;
+    if (l1 > 0.0f && n[2] < 0.0f) {
+        float fx = (1.0f - fabs(y)) * signNotZero(x);
+        float fy = (1.0f - fabs(x)) * signNotZero(y);
+        x = fx;
+        y = fy;
+    }
+    e[0] = (int16_t) floor(x * 32767.0f + 0.5f);
+    e[1] = (int16_t) floor(y * 32767.0f + 0.5f);
+}
+
+void decodeOctahedral(const int16_t e[2], float n[3]) {
+    float x = max(e[0] / 32767.0f, -1.0f);
+    float y = max(e[1] / 32767.0f, -1.0f);
+    float z = 1.0f - fabs(x) - fabs(y);
+    if (z < 0.0f) {
+        float fx = (1.0f - fabs(y)) * signNotZero(x);
+        float fy = (1.0f - fabs(x)) * signNotZero(y);
+        x = fx;
+        y = fy;
+    }
+    float len = sqrt(x * x + y * y + z * z);
+    n[0] = x / len;
+    n[1] = y / len;
+    n[2] = z / len;
+}
+
+bool writePackedMesh(const string &file, const Mesh &mesh, string &error, const LodChain *lods) {
+    size_t vertexCount = mesh.vertexCount();
+
+    // All the levels' indices go in one section
+    vector<uint32_t> indices(mesh.indices);
+    vector<PackedMeshLevel> levels(1);
+    levels[0].first = 0;
+    levels[0].count = (uint32_t) indices.size();
+    levels[0].error = 0.0f;
+    for (size_t i = 0; lods && i < lods->indices.size(); i++) {
+        PackedMeshLevel level;
+        level.first = (uint32_t) indices.size();
+        level.count = (uint32_t) lods->indices[i].size();
+        level.error = lods->errors[i];
+        indices.insert(indices.end(), lods->indices[i].begin(), lods->indices[i].end());
+        levels.push_back(level);
+    }
+
+    if (mesh.normals.size() != mesh.positions.size()) {
+        error = "The mesh has no normals";
+        return false;
+    }
+    if (vertexCount > 0xFFFFFFFFu || indices.size() > 0xFFFFFFFFu) {
+        error = "The mesh is too large";
+        return false;
+    }
+
+    // Quantize to a cube, so the scale is the same along every axis and
+    // the normals need no correction
+    float lo[3], hi[3];
+    mesh.bounds(lo, hi);
+    PackedMeshHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, packedMagic, 8);
+    header.version = 1;
+    header.vertexCount = (uint32_t) vertexCount;
+    header.indexCount = (uint32_t) indices.size();
+    header.levelCount = (uint32_t) levels.size();
+    float extent = 0.0f;
+    for (int k = 0; k < 3; k++) {
+        header.center[k] = 0.5f * (lo[k] + hi[k]);
+        extent = max(extent, 0.5f * (hi[k] - lo[k]));
+    }
+    header.scale = extent > 0.0f ? extent / 32767.0f : 1.0f;
+    bool wide = vertexCount > 65536;
+    if (wide) header.flags |= PACKED_WIDE_INDICES;
+
+    vector<int16_t> positions(4 * vertexCount), normals(2 * vertexCount);
+    for (size_t i = 0; i < vertexCount; i++) {
+        for (int k = 0; k < 3; k++) {
+            float q = (mesh.positions[3 * i + k] - header.center[k]) / header.scale;
+            positions[4 * i + k] = (int16_t) max(-32767.0f, min(32767.0f, floor(q + 0.5f)));
+        }
+        positions[4 * i + 3] = 0;
+        encodeOctahedral(&mesh.normals[3 * i], &normals[2 * i]);
+    }
+
+    FILE *f = fopen(file.c_str(), "wb");
+    if (!f) {
+        error = "Unable to write " + file;
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+    if (vertexCount > 0) {
+        ok = ok && fwrite(&positions[0], 2, positions.size(), f) == positions.size();
+        ok = ok && fwrite(&normals[0], 2, normals.size(), f) == normals.size();
+    }
+    if (wide && !indices.empty()) {
+        ok = ok && fwrite(&indices[0], 4, indices.size(), f) == indices.size();
+    } else if (!indices.empty()) {
+        vector<uint16_t> shortIndices(indices.begin(), indices.end());
+        if (shortIndices.size() % 2) shortIndices.push_back(0);
+        ok = ok && fwrite(&shortIndices[0], 2, shortIndices.size(), f) == shortIndices.size();
+    }
+    ok = ok && fwrite(&levels[0], sizeof(PackedMeshLevel), levels.size(), f) == levels.size();
+    ok = fclose(f) == 0 && ok;
+    if (!ok) {
+        error = "Unable to write " + file;
+        remove(file.c_str());
+    }
+    return ok;
+}
+
+/**
+ * Copy a range of a packed mesh's indices.
+ */
+static void unpackIndices(const PackedMesh &packed, size_t first, size_t count, vector<uint32_t> &indices) {
+    indices.resize(count);
+    if (packed.wideIndices()) {
+        const uint32_t *p = (const uint32_t *) packed.indices + first;
+        copy(p, p + count, indices.begin());
+    } else {
+        const uint16_t *p = (const uint16_t *) packed.indices + first;
+        copy(p, p + count, indices.begin());
+    }
+}
+
+void unpackMesh(const PackedMesh &packed, Mesh &mesh, LodChain *lods) {
+    const PackedMeshHeader &header = *packed.header;
+    size_t n = header.vertexCount;
+    mesh.positions.resize(3 * n);
+    mesh.normals.resize(3 * n);
+    for (size_t i = 0; i < n; i++) {
+        for (int k = 0; k < 3; k++) {
+            mesh.positions[3 * i + k] = header.center[k] + header.scale * packed.positions[4 * i + k];
+        }
+        decodeOctahedral(&packed.normals[2 * i], &mesh.normals[3 * i]);
+    }
+    if (header.levelCount == 0) {
+        unpackIndices(packed, 0, header.indexCount, mesh.indices);
+    } else {
+        unpackIndices(packed, packed.levels[0].first, packed.levels[0].count, mesh.indices);
+    }
+
+    if (!lods) return;
+    lods->indices.clear();
+    lods->errors.clear();
+    for (uint32_t i = 1; i < header.levelCount; i++) {
+        lods->indices.push_back(vector<uint32_t>());
+        unpackIndices(packed, packed.levels[i].first, packed.levels[i].count, lods->indices.back());
+        lods->errors.push_back(packed.levels[i].error);
+    }
+}
+
+int convertCommand(int argc, char *argv[]) {
+    String input, output;
+    for (int i = 0; i < argc; i++) {
+        String arg = argv[i];
+        if (arg == "--output" && i + 1 < argc) {
+            output = argv[++i];
+        } else if (arg[0] != '-' && input.empty()) {
+            input = arg;
+        }
+    }
+    if (input.empty()) {
+        cout << "Usage: OpenCVWithOpenGL convert MESH [options]" << endl;
+        cout << "Converts an OBJ or PLY file to a packed mesh, which loads much faster" << endl;
+        cout << "Options:" << endl;
+        cout << "  --output FILE         where to write the packed mesh (default MESH with extension .pmesh)" << endl;
+        return -1;
+    }
+    if (output.empty()) {
+        size_t dot = input.rfind('.');
+        output = (dot == String::npos ? input : input.substr(0, dot)) + ".pmesh";
+    }
+
+    Mesh mesh;
+    string error;
+    int64 start = getTickCount();
+    if (!loadMesh(input, mesh, error)) {
+        cout << error << endl;
+        return -1;
+    }
+    double parsed = (getTickCount() - start) * 1000.0 / getTickFrequency();
+    cout << "Read " << input << ": " << mesh.vertexCount() << " vertices, "
+         << mesh.triangleCount() << " triangles in " << parsed << " ms" << endl;
+
+    // Optimize once here, so loading the packed mesh does not have to
+    double before = vertexCacheMissRatio(mesh);
+    start = getTickCount();
+    int clusters = optimizeMesh(mesh);
+    cout << "Optimized in " << (getTickCount() - start) * 1000.0 / getTickFrequency() << " ms; "
+         << "vertices transformed per triangle: " << before << " -> " << vertexCacheMissRatio(mesh)
+         << "; " << clusters << " clusters reordered for overdraw" << endl;
+
+    start = getTickCount();
+    LodChain lods;
+    buildLodChain(mesh, lods);
+    for (size_t i = 0; i < lods.indices.size(); i++) optimizeVertexCache(lods.indices[i], mesh.vertexCount());
+    cout << "Built " << lods.indices.size() << " levels of detail in "
+         << (getTickCount() - start) * 1000.0 / getTickFrequency() << " ms" << endl;
+
+    if (!writePackedMesh(output, mesh, error, &lods)) {
+        cout << error << endl;
+        return -1;
+    }
+
+    // Time what the program does with the file: map it and check it; the
+    // vertex and index data is uploaded straight from the mapping.  The
+    // file was just written, so it is in the page cache; from a cold cache,
+    // reading the pages as the upload touches them adds to this.
+    start = getTickCount();
+    PackedMeshFile packed;
+    if (!packed.open(output, error)) {
+        cout << error << endl;
+        return -1;
+    }
+    double opened = (getTickCount() - start) * 1000.0 / getTickFrequency();
+    cout << "Wrote " << output << " (" << packed.bytes() << " bytes); mapping and checking it takes "
+         << opened << " ms" << endl;
+    return 0;
+}
@@ -0,0 +1,145 @@
+/*
+ * Packed mesh files for OpenCV with OpenGL
+ *
+ * A compact binary form of a Mesh, made once from an OBJ or PLY file with
+ * the convert subcommand, and then mapped into memory and handed to OpenGL
+ * with no parsing at all.
+ *
+ * Layout (little endian, every section 4-byte aligned):
+ * - a 64-byte header: PackedMeshHeader
+ * - positions: 4 int16 per vertex (x, y, z, unused), quantized to a cube
+ *   around the mesh; position = center + scale * (x, y, z)
+ * - normals: 2 int16 per vertex, octahedral encoding
+ * - indices: uint16, or uint32 if the mesh has more than 65536 vertices;
+ *   the triangles of every level of detail, one after the other
+ * - levels: a PackedMeshLevel for each level of detail, finest first
+ *
+ * Positions keep 16 bits over the largest extent of the mesh, about
+ * 0.003% of its size, and normals are within about 0.01 degrees, in
+ * half the space of floats.
+ */
+
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "mesh.h"
+
+struct PackedMeshHeader {
+    char magic[8];              // "OCVGLPM\0"
+    uint32_t version;           // 1
+    uint32_t flags;             // PACKED_WIDE_INDICES
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    float center[3];            // center of the quantization cube
+    float scale;                // size of one position step
+    uint32_t levelCount;        // levels of detail; 0 means all the indices are one level
+    uint32_t reserved[5];
+};
+
+struct PackedMeshLevel {
+    uint32_t first, count;      // the range of indices
+    float error;                // how far it strays from the finest level, in model units
+};
+
+enum { PACKED_WIDE_INDICES = 1 };
+
+/**
+ * A packed mesh, as it lies in memory.
+ */
+struct PackedMesh {
+    const PackedMeshHeader *header;
+    const int16_t *positions;   // 4 per vertex
+    const int16_t *normals;     // 2 per vertex
+    const void *indices;        // uint16 or uint32, per the header flags
+    const PackedMeshLevel *levels;
+
+    bool wideIndices() const { return (header->flags & PACKED_WIDE_INDICES) != 0; }
+};
+
+/**
+ * A packed mesh file, mapped into memory.  The data is only read from the
+ * file as it is touched, and stays in the page cache between runs.
+ */
+class PackedMeshFile {
+public:
+    PackedMeshFile();
+    ~PackedMeshFile();
+
+    /**
+     * Map a file, and check its header and size.
+     * @param file the file name
+     * @param error receives a description of the problem, on failure
+     * @return false if the file is missing or not a valid packed mesh
+     */
+    bool open(const std::string &file, std::string &error);
+
+    /**
+     * Unmap the file.
+     */
+    void close();
+
+    /**
+     * @return the mesh; valid until the file is closed
+     */
+    const PackedMesh &mesh() const { return packed; }
+
+    /**
+     * @return the size of the file, in bytes
+     */
+    size_t bytes() const { return size; }
+
+private:
+    void *data;
+    size_t size;
+    std::vector<char> copy;     // the contents, where mapping is not available
+    PackedMesh packed;
+
+    // The mapping cannot be shared
+    PackedMeshFile(const PackedMeshFile &);
+    PackedMeshFile &operator=(const PackedMeshFile &);
+};
+
+/**
+ * Encode a unit vector in octahedral form.
+ * @param n the vector
+ * @param e receives the two components, scaled to int16
+ */
+void encodeOctahedral(const float n[3], int16_t e[2]);
+
+/**
+ * Decode a vector in octahedral form.
+ * @param e the two components
+ * @param n receives the unit vector
+ */
+void decodeOctahedral(const int16_t e[2], float n[3]);
+
+/**
+ * Write a mesh as a packed mesh file.
+ * @param file the file name
+ * @param mesh the mesh; its normals must be set
+ * @param error receives a description of the problem, on failure
+ * @param lods coarser levels of detail to store with it, if any
+ * @return false if the file could not be written
+ */
+bool writePackedMesh(const std::string &file, const Mesh &mesh, std::string &error, const LodChain *lods = 0);
+
+/**
+ * Expand a packed mesh back to floats, for use on the CPU.
+ * @param packed the packed mesh
+ * @param mesh receives the finest level
+ * @param lods receives the coarser levels, if not null
+ */
+void unpackMesh(const PackedMesh &packed, Mesh &mesh, LodChain *lods = 0);
+
+/**
+ * Run the convert subcommand: convert an OBJ or PLY file to a packed mesh.
+ * @param argc the number of arguments after "convert"
+ * @param argv the arguments after "convert"
+ * @return the program exit code
+ */
+int convertCommand(int argc, char *argv[]);
+
+#endif // MESHCACHE_H
@@ -0,0 +1,290 @@
+/*
+ * Mesh optimization for OpenCV with OpenGL
+ * See meshopt.h for an overview.
+ */
+
+#include "meshopt.h"
+#include <algorithm>
+#include <cmath>
+using namespace std;
+
+// The cache modeled by optimizeVertexCache(), which works well for real
+// caches of any size up to this
+static const int kCacheSize = 32;
+
+double vertexCacheMissRatio(const Mesh &mesh, int cacheSize) {
+    if (mesh.indices.empty()) return 0.0;
+
+    // The cache is a ring of vertex indices, in the order they entered it
+    vector<uint32_t> fifo(cacheSize, UINT32_MAX);
+    vector<int> inCache(mesh.vertexCount(), 0);     // 1 if the vertex is in the cache
+    size_t head = 0, misses = 0;
+    for (size_t i = 0; i < mesh.indices.size(); i++) {
+        uint32_t v = mesh.indices[i];
+        if (inCache[v]) continue;
+        misses++;
+        if (fifo[head] != UINT32_MAX) inCache[fifo[head]] = 0;
+        fifo[head] = v;
+        inCache[v] = 1;
+        head = (head + 1) % cacheSize;
+    }
+    return (double) misses / mesh.triangleCount();
+}
+
+/**
+ * The score of a vertex, in Forsyth's algorithm: vertices recently used
+ * (and so still in the cache) score higher, except the last three, which
+ * the triangle just drawn has used; so do vertices with few triangles
+ * left, so that they are finished off rather than left stranded.
+ * @param cachePosition the position in the cache, or -1 if not in the cache
+ * @param remaining the number of triangles left to draw that use the vertex
+ */
+static float vertexScore(int cachePosition, unsigned int remaining) {
+    // The scores are tabulated, since they are needed for every vertex in
+    // the cache after every triangle.  The table is built the first time,
+    // once, even if several threads optimize meshes at once.
+    struct Scores {
+        float cache[kCacheSize], valence[64];
+        Scores() {
+            for (int i = 0; i < kCacheSize; i++) {
+                cache[i] = i < 3 ? 0.75f : pow(1.0f - (float) (i - 3) / (kCacheSize - 3), 1.5f);
+            }
+            valence[0] = 0.0f;
+            for (int i = 1; i < 64; i++) valence[i] = 2.0f / sqrt((float) i);
+        }
+    };
+    static const Scores scores;
+
+    if (remaining == 0) return -1.0f;
+    float score = cachePosition >= 0 ? scores.cache[cachePosition] : 0.0f;
+    return score + (remaining < 64 ? scores.valence[remaining] : 2.0f / sqrt((float) remaining));
+}
+
+void optimizeVertexCache(Mesh &mesh) {
+    optimizeVertexCache(mesh.indices, mesh.vertexCount());
+}
+
+void optimizeVertexCache(vector<uint32_t> &triangles, size_t vertexCount) {
+    size_t triangleCount = triangles.size() / 3;
+    if (triangleCount == 0) return;
+    const vector<uint32_t> &indices = triangles;
+
+    // The triangles of each vertex, in one array; the live ones come first
+    vector<uint32_t> offsets(vertexCount + 1, 0), remaining(vertexCount, 0);
+    for (size_t i = 0; i < indices.size(); i++) remaining[indices[i]]++;
+    for (size_t v = 0; v < vertexCount; v++) offsets[v + 1] = offsets[v] + remaining[v];
+    vector<uint32_t> adjacency(indices.size()), fill(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++) adjacency[fill[indices[i]]++] = (uint32_t) (i / 3);
+
+    vector<int> cachePosition(vertexCount, -1);
+    vector<float> score(vertexCount);
+    for (size_t v = 0; v < vertexCount; v++) score[v] = vertexScore(-1, remaining[v]);
+    vector<char> emitted(triangleCount, 0);
+    int best = -1;
+    float bestScore = -1.0f;
+    for (size_t t = 0; t < triangleCount; t++) {
+        float s = score[indices[3 * t]] + score[indices[3 * t + 1]] + score[indices[3 * t + 2]];
+        if (s > bestScore) {
+            bestScore = s;
+            best = (int) t;
+        }
+    }
+
+    vector<uint32_t> output;
+    output.reserve(indices.size());
+    uint32_t cache[kCacheSize + 3], newCache[kCacheSize + 3];
+    int cacheCount = 0;
+    size_t cursor = 0;          // triangles before this are all drawn
+
+    while (output.size() < indices.size()) {
+        // With nothing in the cache to continue from, take the next triangle
+        if (best < 0) {
+            while (emitted[cursor]) cursor++;
+            best = (int) cursor;
+        }
+
+        // Draw the triangle, and take it off its vertices' lists
+        const uint32_t *tri = &indices[3 * best];
+        emitted[best] = 1;
+        for (int k = 0; k < 3; k++) {
+            uint32_t v = tri[k];
+            output.push_back(v);
+            uint32_t *list = &adjacency[offsets[v]];
+            for (uint32_t j = 0; j < remaining[v]; j++) {
+                if (list[j] == (uint32_t) best) {
+                    swap(list[j], list[remaining[v] - 1]);
+                    break;
+                }
+            }
+            remaining[v]--;
+        }
+
+        // Its vertices go to the front of the cache
+        int newCount = 0;
+        for (int k = 0; k < 3; k++) newCache[newCount++] = tri[k];
+        for (int j = 0; j < cacheCount; j++) {
+            uint32_t v = cache[j];
+            if (v != tri[0] && v != tri[1] && v != tri[2]) newCache[newCount++] = v;
+        }
+
+        // Rescore the vertices that moved, including the ones that fell out,
+        // and then their triangles
+        for (int j = 0; j < newCount; j++) {
+            uint32_t v = newCache[j];
+            cachePosition[v] = j < kCacheSize ? j : -1;
+            score[v] = vertexScore(cachePosition[v], remaining[v]);
+        }
+        best = -1;
+        bestScore = -1.0f;
+        for (int j = 0; j < newCount; j++) {
+            uint32_t v = newCache[j];
+            const uint32_t *list = &adjacency[offsets[v]];
+            for (uint32_t a = 0; a < remaining[v]; a++) {
+                uint32_t t = list[a];
+                float s = score[indices[3 * t]] + score[indices[3 * t + 1]] + score[indices[3 * t + 2]];
+                if (s > bestScore) {
+                    bestScore = s;
+                    best = (int) t;
+                }
+            }
+        }
+
+        cacheCount = min(newCount, kCacheSize);
+        copy(newCache, newCache + cacheCount, cache);
+    }
+
+    triangles.swap(output);
+}
+
+int optimizeOverdraw(Mesh &mesh, double threshold) {
+    size_t triangleCount = mesh.triangleCount();
+    if (triangleCount == 0) return 0;
+    const vector<uint32_t> &indices = mesh.indices;
+    const vector<float> &p = mesh.positions;
+
+    // Split the triangles into clusters, as Sander et al. do.  A cluster
+    // ends where the cache starts over (at a triangle none of whose
+    // vertices are in it), and also as soon as its own cache miss ratio,
+    // counted from an empty cache, is within half the threshold of the
+    // whole mesh's (the other half is for the seams between clusters once
+    // they are reordered): then it can be drawn in any order with little
+    // loss.  The cache is emptied for the next cluster, which is measured
+    // the same way.
+    double target = (1.0 + 0.5 * (threshold - 1.0)) * vertexCacheMissRatio(mesh, kCacheSize);
+    vector<size_t> clusters(1, 0);
+    vector<uint32_t> fifo(kCacheSize, UINT32_MAX);
+    vector<int> inCache(mesh.vertexCount(), 0);
+    size_t head = 0, clusterMisses = 0;
+    for (size_t t = 0; t < triangleCount; t++) {
+        int misses = 0;
+        for (int k = 0; k < 3; k++) {
+            uint32_t v = indices[3 * t + k];
+            if (inCache[v]) continue;
+            misses++;
+            if (fifo[head] != UINT32_MAX) inCache[fifo[head]] = 0;
+            fifo[head] = v;
+            inCache[v] = 1;
+            head = (head + 1) % kCacheSize;
+        }
+        if (misses == 3 && t > clusters.back()) {
+            clusters.push_back(t);
+            clusterMisses = 0;
+        }
+        clusterMisses += misses;
+        if (t + 1 < triangleCount && clusterMisses <= target * (t + 1 - clusters.back())) {
+            clusters.push_back(t + 1);
+            clusterMisses = 0;
+            for (int j = 0; j < kCacheSize; j++) {
+                if (fifo[j] != UINT32_MAX) inCache[fifo[j]] = 0;
+                fifo[j] = UINT32_MAX;
+            }
+        }
+    }
+    // The last cluster ends with the mesh, not with a low ratio; as a
+    // cluster of its own, it would cost what the others saved
+    if (clusters.size() > 1 && clusterMisses > target * (triangleCount - clusters.back())) clusters.pop_back();
+    if (clusters.size() < 2) return 0;
+    clusters.push_back(triangleCount);
+
+    // Each cluster's area-weighted center and normal
+    size_t clusterCount = clusters.size() - 1;
+    vector<float> centers(3 * clusterCount, 0.0f), normals(3 * clusterCount, 0.0f);
+    double meshCenter[3] = { 0.0, 0.0, 0.0 }, meshArea = 0.0;
+    for (size_t c = 0; c < clusterCount; c++) {
+        float area = 0.0f;
+        for (size_t t = clusters[c]; t < clusters[c + 1]; t++) {
+            const float *a = &p[3 * indices[3 * t]], *b = &p[3 * indices[3 * t + 1]], *d = &p[3 * indices[3 * t + 2]];
+            float u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+            float v[3] = { d[0] - a[0], d[1] - a[1], d[2] - a[2] };
+            float n[3] = { u[1] * v[2] - u[2] * v[1], u[2] * v[0] - u[0] * v[2], u[0] * v[1] - u[1] * v[0] };
+            float twiceArea = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            for (int k = 0; k < 3; k++) {
+                centers[3 * c + k] += twiceArea * (a[k] + b[k] + d[k]) / 3.0f;
+                normals[3 * c + k] += n[k];
+            }
+            area += twiceArea;
+        }
+        for (int k = 0; k < 3; k++) meshCenter[k] += centers[3 * c + k];
+        meshArea += area;
+        if (area > 0.0f) {
+            for (int k = 0; k < 3; k++) centers[3 * c + k] /= area;
+        }
+    }
+    if (meshArea <= 0.0) return 0;
+    for (int k = 0; k < 3; k++) meshCenter[k] /= meshArea;
+
+    // Clusters on the outside, facing out, are likely to be in front of
+    // the others from most viewpoints, so they go first
+    vector<pair<float, size_t> > order(clusterCount);
+    for (size_t c = 0; c < clusterCount; c++) {
+        const float *n = &normals[3 * c];
+        float len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+        float dot = 0.0f;
+        for (int k = 0; k < 3; k++) dot += (float) (centers[3 * c + k] - meshCenter[k]) * n[k];
+        order[c] = make_pair(len > 0.0f ? -dot / len : 0.0f, c);
+    }
+    stable_sort(order.begin(), order.end());
+
+    vector<uint32_t> output;
+    output.reserve(indices.size());
+    for (size_t i = 0; i < clusterCount; i++) {
+        size_t c = order[i].second;
+        output.insert(output.end(), indices.begin() + 3 * clusters[c], indices.begin() + 3 * clusters[c + 1]);
+    }
+
+    // Keep the new order only if the cache still works about as well
+    double before = vertexCacheMissRatio(mesh);
+    mesh.indices.swap(output);
+    if (vertexCacheMissRatio(mesh) > threshold * before) {
+        mesh.indices.swap(output);
+        return 0;
+    }
+    return (int) clusterCount;
+}
+
+void optimizeVertexFetch(Mesh &mesh) {
+    size_t vertexCount = mesh.vertexCount();
+    bool hasNormals = mesh.normals.size() == mesh.positions.size();
+    vector<uint32_t> remap(vertexCount, UINT32_MAX);
+    vector<float> positions, normals;
+    positions.reserve(mesh.positions.size());
+    if (hasNormals) normals.reserve(mesh.normals.size());
+    for (size_t i = 0; i < mesh.indices.size(); i++) {
+        uint32_t v = mesh.indices[i];
+        if (remap[v] == UINT32_MAX) {
+            remap[v] = (uint32_t) (positions.size() / 3);
+            positions.insert(positions.end(), &mesh.positions[3 * v], &mesh.positions[3 * v] + 3);
+            if (hasNormals) normals.insert(normals.end(), &mesh.normals[3 * v], &mesh.normals[3 * v] + 3);
+        }
+        mesh.indices[i] = remap[v];
+    }
+    mesh.positions.swap(positions);
+    if (hasNormals) mesh.normals.swap(normals);
+}
+
+int optimizeMesh(Mesh &mesh) {
+    optimizeVertexCache(mesh);
+    int clusters = optimizeOverdraw(mesh);
+    optimizeVertexFetch(mesh);
+    return clusters;
+}
@@ -0,0 +1,273 @@
+/*
+ * Runtime metrics for OpenCV with OpenGL
+ * See metrics.h for an overview.
+ */
+
+#include "metrics.h"
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#ifndef _WIN32
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+using namespace std;
+
+// The upper bounds of the histogram buckets, in seconds; the last bucket
+// (+Inf) holds the rest
+static const double kBounds[] = { 0.00005, 0.0001, 0.0002, 0.0005, 0.001, 0.002, 0.005, 0.01, 0.02, 0.05, 0.1, 0.2, 0.5, 1.0 };
+static const int kBuckets = sizeof(kBounds) / sizeof(kBounds[0]) + 1;
+
+/**
+ * @return a number as Prometheus writes it
+ */
+static string number(double value) {
+    char text[32];
+    snprintf(text, sizeof(text), "%.9g", value);
+    return text;
+}
+
+/**
+ * @return a sample line: the name, the labels (with an extra one, if
+ *         given), and the value
+ */
+static string sample(const string &name, const string &labels, const string &extra, const string &value) {
+    string line = name;
+    if (!labels.empty() || !extra.empty()) {
+        line += "{" + labels;
+        if (!labels.empty() && !extra.empty()) line += ",";
+        line += extra + "}";
+    }
+    return line + " " + value + "\n";
+}
+
+int MetricsRegistry::counter(const string &name, const string &help, const string &labels) {
+    return define(name, help, labels, COUNTER);
+}
+
+int MetricsRegistry::gauge(const string &name, const string &help, const string &labels) {
+    return define(name, help, labels, GAUGE);
+}
+
+int MetricsRegistry::histogram(const string &name, const string &help, const string &labels) {
+    return define(name, help, labels, HISTOGRAM);
+}
+
+int MetricsRegistry::define(const string &name, const string &help, const string &labels, Type type) {
+    lock_guard<mutex> guard(lock);
+    Metric metric;
+    metric.name = name;
+    metric.help = help;
+    metric.labels = labels;
+    metric.type = type;
+    metric.value = 0.0;
+    if (type == HISTOGRAM) metric.buckets.assign(kBuckets, 0);
+    metric.count = 0;
+    metrics.push_back(metric);
+    return (int) metrics.size() - 1;
+}
+
+void MetricsRegistry::add(int id, double amount) {
+    lock_guard<mutex> guard(lock);
+    if (id >= 0 && id < (int) metrics.size()) metrics[id].value += amount;
+}
+
+void MetricsRegistry::set(int id, double value) {
+    lock_guard<mutex> guard(lock);
+    if (id >= 0 && id < (int) metrics.size()) metrics[id].value = value;
+}
+
+void MetricsRegistry::observe(int id, double seconds) {
+    int bucket = 0;
+    while (bucket < kBuckets - 1 && seconds > kBounds[bucket]) bucket++;
+    lock_guard<mutex> guard(lock);
+    if (id < 0 || id >= (int) metrics.size() || metrics[id].type != HISTOGRAM) return;
+    Metric &metric = metrics[id];
+    metric.buckets[bucket]++;
+    metric.value += seconds;
+    metric.count++;
+}
+
+string MetricsRegistry::exposition() const {
+    static const char *typeNames[] = { "counter", "gauge", "histogram" };
+    lock_guard<mutex> guard(lock);
+    string text;
+    vector<bool> written(metrics.size(), false);
+    for (size_t i = 0; i < metrics.size(); i++) {
+        if (written[i]) continue;
+
+        // Each name once, with all its label sets
+        const Metric &first = metrics[i];
+        text += "# HELP " + first.name + " " + first.help + "\n";
+        text += "# TYPE " + first.name + " " + typeNames[first.type] + "\n";
+        for (size_t j = i; j < metrics.size(); j++) {
+            const Metric &metric = metrics[j];
+            if (metric.name != first.name) continue;
+            written[j] = true;
+            if (metric.type != HISTOGRAM) {
+                text += sample(metric.name, metric.labels, "", number(metric.value));
+                continue;
+            }
+            long cumulative = 0;
+            for (int b = 0; b < kBuckets; b++) {
+                cumulative += metric.buckets[b];
+                string le = b < kBuckets - 1 ? number(kBounds[b]) : "+Inf";
+                text += sample(metric.name + "_bucket", metric.labels, "le=\"" + le + "\"", number((double) cumulative));
+            }
+            text += sample(metric.name + "_sum", metric.labels, "", number(metric.value));
+            text += sample(metric.name + "_count", metric.labels, "", number((double) metric.count));
+        }
+    }
+    return text;
+}
+
+MetricsServer::MetricsServer() : registry(0), listener(-1), stopping(false) {
+}
+
+MetricsServer::~MetricsServer() {
+    stop();
+}
+
+#ifdef _WIN32
+
+bool MetricsServer::start(const string &, const MetricsRegistry &) {
+    message = "The metrics server is not available on Windows";
+    return false;
+}
+
+void MetricsServer::stop() {
+}
+
+void MetricsServer::serve() {
+}
+
+void MetricsServer::answer(int) {
+}
+
+#else
+
+bool MetricsServer::start(const string &address, const MetricsRegistry &metrics) {
+    stop();
+    message.clear();
+    registry = &metrics;
+
+    int fd;
+    if (address.compare(0, 5, "unix:") == 0) {
+        // A Unix socket, replacing one left by an earlier run
+        string path = address.substr(5);
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+            message = "Bad metrics socket path: " + path;
+            return false;
+        }
+        strcpy(addr.sun_path, path.c_str());
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        unlink(path.c_str());
+        if (fd < 0 || bind(fd, (sockaddr *) &addr, sizeof(addr)) < 0) {
+            message = "Unable to open the metrics socket " + path + ": " + strerror(errno);
+            if (fd >= 0) close(fd);
+            return false;
+        }
+        socketPath = path;
+    } else {
+        // TCP, on the loopback interface unless a host is given
+        string host = "127.0.0.1", port = address;
+        size_t colon = address.rfind(':');
+        if (colon != string::npos) {
+            host = address.substr(0, colon);
+            port = address.substr(colon + 1);
+        }
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((unsigned short) atoi(port.c_str()));
+        if (atoi(port.c_str()) <= 0 || inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1) {
+            message = "Bad metrics address: " + address;
+            return false;
+        }
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        int reuse = 1;
+        if (fd >= 0) setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (fd < 0 || bind(fd, (sockaddr *) &addr, sizeof(addr)) < 0) {
+            message = "Unable to open the metrics port " + address + ": " + strerror(errno);
+            if (fd >= 0) close(fd);
+            return false;
+        }
+    }
+    if (listen(fd, 8) < 0) {
+        message = string("Unable to listen for metrics requests: ") + strerror(errno);
+        close(fd);
+        return false;
+    }
+
+    listener = fd;
+    stopping = false;
+    server = thread(&MetricsServer::serve, this);
+    return true;
+}
+
+void MetricsServer::stop() {
+    if (listener < 0) return;
+    stopping = true;
+    server.join();
+    close(listener);
+    listener = -1;
+    if (!socketPath.empty()) unlink(socketPath.c_str());
+    socketPath.clear();
+}
+
+void MetricsServer::serve() {
+    // Wake up now and then to see whether to stop
+    while (!stopping) {
+        pollfd waiting = { listener, POLLIN, 0 };
+        if (poll(&waiting, 1, 200) <= 0) continue;
+        int connection = accept(listener, 0, 0);
+        if (connection < 0) continue;
+        answer(connection);
+        close(connection);
+    }
+}
+
+void MetricsServer::answer(int connection) {
+    // Read the request line and headers; a client that sends nothing for
+    // a second is dropped, so it cannot hold up the others
+    timeval timeout = { 1, 0 };
+    setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    string request;
+    char buffer[1024];
+    while (request.find("\r\n\r\n") == string::npos && request.size() < 8192) {
+        ssize_t n = recv(connection, buffer, sizeof(buffer), 0);
+        if (n <= 0) return;
+        request.append(buffer, n);
+    }
+
+    // GET /metrics (or /); anything else is not found
+    string status = "200 OK", body;
+    string path = request.substr(4, request.find(' ', 4) - 4);
+    if (request.compare(0, 4, "GET ") != 0) {
+        status = "405 Method Not Allowed";
+    } else if (path == "/metrics" || path == "/") {
+        body = registry->exposition();
+    } else {
+        status = "404 Not Found";
+    }
+    string response = "HTTP/1.1 " + status + "\r\n"
+                      "Content-Type: text/plain; version=0.0.4\r\n"
+                      "Content-Length: " + to_string(body.size()) + "\r\n"
+                      "Connection: close\r\n\r\n" + body;
+    size_t sent = 0;
+    while (sent < response.size()) {
+        ssize_t n = send(connection, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0) return;
+        sent += n;
+    }
+}
+
+#endif
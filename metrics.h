@@ -0,0 +1,136 @@
+/*
+ * Runtime metrics for OpenCV with OpenGL
+ *
+ * The running program keeps counters, gauges and histograms of how it is
+ * doing (frame rate, time spent in each stage, dropped frames, queue
+ * depths), and serves them in the Prometheus text format, so that a
+ * monitoring system can scrape many installations and alert when one
+ * slows down, without a profiler or a look at the window.
+ *
+ * MetricsRegistry holds the values.  Each metric is registered once, up
+ * front, and then updated through the number it was given, which costs a
+ * short lock, not a lookup by name.  MetricsServer answers HTTP requests
+ * for /metrics on a thread of its own, on a TCP port of the loopback
+ * interface or on a Unix socket (curl --unix-socket PATH http://x/metrics).
+ */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class MetricsRegistry {
+public:
+    /**
+     * Register a metric.  Metrics of the same name (with different labels)
+     * share its help text and type.
+     * @param name the metric name, e.g. "ocvgl_frames_total"
+     * @param help a line describing it
+     * @param labels labels in Prometheus form, e.g. "stage=\"detect\"", or empty
+     * @return the metric's number, for the updates
+     */
+    int counter(const std::string &name, const std::string &help, const std::string &labels = "");
+    int gauge(const std::string &name, const std::string &help, const std::string &labels = "");
+
+    /**
+     * Register a histogram of durations, in seconds, with buckets from
+     * 50 us (a texture upload or a quick detection) to 1 s.
+     */
+    int histogram(const std::string &name, const std::string &help, const std::string &labels = "");
+
+    /**
+     * Add to a counter (or a gauge).  Unknown numbers are ignored, so
+     * updates before registration do nothing.
+     */
+    void add(int id, double amount = 1.0);
+
+    /**
+     * Set a gauge, or a counter kept elsewhere.
+     */
+    void set(int id, double value);
+
+    /**
+     * Count a duration in a histogram.
+     * @param seconds the duration
+     */
+    void observe(int id, double seconds);
+
+    /**
+     * @return all the metrics, in the Prometheus text format
+     */
+    std::string exposition() const;
+
+private:
+    enum Type { COUNTER, GAUGE, HISTOGRAM };
+
+    struct Metric {
+        std::string name, help, labels;
+        Type type;
+        double value;               // the counter or gauge; the histogram's sum
+        std::vector<long> buckets;  // observations per bucket, not cumulative
+        long count;
+    };
+
+    int define(const std::string &name, const std::string &help, const std::string &labels, Type type);
+
+    mutable std::mutex lock;
+    std::vector<Metric> metrics;
+};
+
+class MetricsServer {
+public:
+    MetricsServer();
+    ~MetricsServer();
+
+    /**
+     * Start serving.
+     * @param address a port (e.g. "9100") or "HOST:PORT" for HTTP over TCP,
+     *        on 127.0.0.1 unless another host is given; or "unix:PATH" for a
+     *        Unix socket
+     * @param registry the metrics to serve; must outlive the server
+     * @return false if the address could not be opened (see error())
+     */
+    bool start(const std::string &address, const MetricsRegistry &registry);
+
+    /**
+     * Stop serving, and close the socket.
+     */
+    void stop();
+
+    /**
+     * @return true between start() and stop()
+     */
+    bool isRunning() const { return listener >= 0; }
+
+    /**
+     * @return a description of the last failure, if any
+     */
+    const std::string &error() const { return message; }
+
+private:
+    MetricsServer(const MetricsServer &);
+    MetricsServer &operator=(const MetricsServer &);
+
+    /**
+     * Answer requests until stopped.
+     */
+    void serve();
+
+    /**
+     * Read one request from a connection, and send the answer.
+     */
+    void answer(int connection);
+
+    const MetricsRegistry *registry;
+    int listener;                   // the listening socket, or -1
+    std::string socketPath;         // the Unix socket, to remove when stopped
+    std::string message;
+    std::atomic<bool> stopping;
+    std::thread server;
+};
+
+#endif // METRICS_H
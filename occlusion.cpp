@@ -0,0 +1,131 @@
+/*
+ * Occlusion of virtual objects by real ones, for OpenCV with OpenGL
+ * See occlusion.h for an overview.
+ */
+
+#include "occlusion.h"
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+#include <GL/gl.h>
+using namespace cv;
+using namespace std;
+
+Occluder::Occluder() : opened(false), still(false), depth(false), depthScale(0.001), texName(0) {
+}
+
+bool Occluder::open(const String &file) {
+    raw = imread(file, IMREAD_UNCHANGED);
+    still = !raw.empty();
+    if (!still) {
+        if (!video.open(file) || !video.read(raw) || raw.empty()) return false;
+    }
+    depth = raw.depth() == CV_16U;
+    opened = true;
+    return true;
+}
+
+void Occluder::next(Size frameSize) {
+    if (!opened) return;
+    if (!still && (!video.read(raw) || raw.empty())) {
+        // Stay in step with the input, which also starts over at the end
+        video.set(CAP_PROP_POS_FRAMES, 0);
+        if (!video.read(raw) || raw.empty()) return;
+    }
+
+    // Masks may arrive as color images; keep one channel
+    Mat single = raw;
+    if (!depth && raw.channels() > 1) cvtColor(raw, single, COLOR_BGR2GRAY);
+    if (single.size() == frameSize) {
+        resized = single;
+    } else {
+        // Nearest neighbor, so depths are not blended across edges
+        resize(single, resized, frameSize, 0, 0, INTER_NEAREST);
+    }
+}
+
+void Occluder::apply(unsigned int quadList, double zNear, double zFar) {
+    if (!opened || resized.empty()) return;
+    if (depth) {
+        applyDepth(zNear, zFar);
+    } else {
+        applyMask(quadList);
+    }
+}
+
+void Occluder::applyMask(unsigned int quadList) {
+    // Upload the mask as an alpha texture, in place when the size is unchanged
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    if (texName == 0) glGenTextures(1, &texName);
+    glBindTexture(GL_TEXTURE_2D, texName);
+    if (texSize != resized.size()) {
+        texSize = resized.size();
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_ALPHA, texSize.width, texSize.height, 0,
+                     GL_ALPHA, GL_UNSIGNED_BYTE, resized.ptr());
+    } else {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, texSize.width, texSize.height,
+                        GL_ALPHA, GL_UNSIGNED_BYTE, resized.ptr());
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    // Set the stencil to 1 wherever the mask is set, without touching the
+    // color or depth buffers.  The alpha test discards the unmasked pixels.
+    glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_TEXTURE_BIT);
+    glClearStencil(0);
+    glClear(GL_STENCIL_BUFFER_BIT);
+    glEnable(GL_STENCIL_TEST);
+    glStencilFunc(GL_ALWAYS, 1, 1);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_REPLACE);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDepthMask(GL_FALSE);
+    glDisable(GL_LIGHTING);
+    glEnable(GL_TEXTURE_2D);
+    glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+    glEnable(GL_ALPHA_TEST);
+    glAlphaFunc(GL_GREATER, 0.5f);
+    glCallList(quadList);
+    glPopAttrib();
+
+    // Draw the objects only where the stencil is clear
+    glEnable(GL_STENCIL_TEST);
+    glStencilFunc(GL_EQUAL, 0, 1);
+    glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
+}
+
+void Occluder::applyDepth(double zNear, double zFar) {
+    // Convert eye distances to window depths for the objects' projection:
+    // depth = far * (d - near) / ((far - near) * d).  Missing data is far away.
+    windowDepth.create(resized.size(), CV_32F);
+    float a = (float) (zFar / (zFar - zNear));
+    float b = (float) (zFar * zNear / (zFar - zNear));
+    float scale = (float) depthScale;
+    for (int y = 0; y < resized.rows; y++) {
+        // OpenGL rows run bottom to top
+        const ushort *src = resized.ptr<ushort>(y);
+        float *dst = windowDepth.ptr<float>(resized.rows - 1 - y);
+        for (int x = 0; x < resized.cols; x++) {
+            float d = src[x] * scale;
+            float z = d > zNear ? a - b / d : (src[x] == 0 ? 1.0f : 0.0f);
+            dst[x] = z < 1.0f ? z : 1.0f;
+        }
+    }
+
+    // Draw the depths over the window, from the bottom-left corner of the rectangle
+    GLint vp[4];
+    glGetIntegerv(GL_VIEWPORT, vp);
+    glPushAttrib(GL_ENABLE_BIT | GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_PIXEL_MODE_BIT);
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    glDisable(GL_LIGHTING);
+    glDisable(GL_TEXTURE_2D);
+    glEnable(GL_DEPTH_TEST);
+    glDepthFunc(GL_ALWAYS);
+    glRasterPos3f(-2.0f, -2.0f, 0.0f);
+    glPixelZoom((float) vp[2] / windowDepth.cols, (float) vp[3] / windowDepth.rows);
+    glDrawPixels(windowDepth.cols, windowDepth.rows, GL_DEPTH_COMPONENT, GL_FLOAT, windowDepth.ptr());
+    glPopAttrib();
+}
+
+void Occluder::finish() {
+    if (opened && !depth) glDisable(GL_STENCIL_TEST);
+}
@@ -0,0 +1,81 @@
+/*
+ * Occlusion of virtual objects by real ones, for OpenCV with OpenGL
+ *
+ * The background image is drawn without depth, so virtual objects always
+ * appear on top of it, even where something real (a hand, say) is in front
+ * of the marker.  An Occluder reads a per-frame description of the real
+ * foreground, and writes it into the stencil or depth buffer before the
+ * virtual objects are drawn, so the GPU hides the covered fragments.
+ *
+ * Two kinds of input are supported:
+ * - An 8-bit mask (e.g. from segmentation); nonzero pixels hide everything.
+ *   This is written to the stencil buffer.
+ * - A 16-bit depth map, registered to the color camera; pixels hide only
+ *   the parts of objects that are behind them.  This is written to the
+ *   depth buffer.  Zero means no data.
+ */
+
+#ifndef OCCLUSION_H
+#define OCCLUSION_H
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/videoio/videoio.hpp>
+
+class Occluder {
+public:
+    Occluder();
+
+    /**
+     * Open a mask or depth input: a still image, a video, or an image
+     * sequence pattern.  Its frames should correspond to the input frames.
+     * @param file the file name
+     * @return false if it could not be read
+     */
+    bool open(const cv::String &file);
+
+    /**
+     * @return true if an input is open
+     */
+    bool isOpen() const { return opened; }
+
+    /**
+     * @param scale scene units per depth unit (e.g. 0.001 for millimeters and meters)
+     */
+    void setDepthScale(double scale) { depthScale = scale; }
+
+    /**
+     * Read the next frame of the input (a still image is kept), and resize
+     * it to match the input frames.
+     * @param frameSize the size of the input frames
+     */
+    void next(cv::Size frameSize);
+
+    /**
+     * Write the occluders into the stencil or depth buffer.  Call after the
+     * background is drawn, with the same full-window orthographic projection.
+     * Leaves the stencil test set up for drawing the virtual objects; call
+     * finish() after they are drawn.
+     * @param quadList display list of the full-window rectangle
+     * @param zNear the near plane of the projection the objects will use
+     * @param zFar the far plane of the projection the objects will use
+     */
+    void apply(unsigned int quadList, double zNear, double zFar);
+
+    /**
+     * Restore the state changed by apply().
+     */
+    void finish();
+
+private:
+    void applyMask(unsigned int quadList);
+    void applyDepth(double zNear, double zFar);
+
+    cv::VideoCapture video;
+    bool opened, still, depth;
+    double depthScale;
+    cv::Mat raw, resized, windowDepth;
+    unsigned int texName;
+    cv::Size texSize;
+};
+
+#endif // OCCLUSION_H
@@ -0,0 +1,43 @@
+#!/bin/sh
+#
+# Build OpenCVWithOpenGL with profile-guided optimization.
+#
+# 1. Build an instrumented binary (OCVGL_PGO=GENERATE).
+# 2. Run the bundled headless replays to collect profiles: the dolly
+#    animation over ohio.jpg, and a synthetic video of a marker moving over
+#    ohio.jpg (detection, tracking, pose filtering and the AR render path).
+# 3. Rebuild the same build directory with the profiles (OCVGL_PGO=USE).
+#    GCC matches profiles to object files by path, so the instrumented and
+#    optimized builds must share the build directory.
+#
+# Usage: ./pgo.sh [BUILD_DIR] [extra CMake arguments...]
+#
+set -e
+
+SRC=$(cd "$(dirname "$0")" && pwd)
+BUILD=${1:-"$SRC/build"}
+[ $# -gt 0 ] && shift
+PROFILES="$BUILD/pgo"
+EXE="$BUILD/OpenCVWithOpenGL"
+
+rm -rf "$PROFILES"
+mkdir -p "$PROFILES"
+
+echo "== Building the instrumented binary"
+cmake -S "$SRC" -B "$BUILD" -DCMAKE_BUILD_TYPE=Release -DOCVGL_PGO=GENERATE -DOCVGL_PGO_DIR="$PROFILES" "$@"
+cmake --build "$BUILD" -j
+
+echo "== Collecting profiles"
+"$EXE" replay "$SRC/ohio.jpg" --frames 3200
+"$EXE" replay "$SRC/ohio.jpg" --frames 1200 --synthetic
+
+# Clang writes raw profiles, which have to be merged
+if ls "$PROFILES"/*.profraw >/dev/null 2>&1; then
+    llvm-profdata merge -output="$PROFILES/merged.profdata" "$PROFILES"/*.profraw
+fi
+
+echo "== Building the optimized binary"
+cmake -S "$SRC" -B "$BUILD" -DOCVGL_PGO=USE "$@"
+cmake --build "$BUILD" -j
+
+echo "== Done: $EXE"
@@ -0,0 +1,151 @@
+/*
+ * Pose smoothing for OpenCV with OpenGL
+ * See posefilter.h for an overview.
+ */
+
+#include "posefilter.h"
+#include <opencv2/calib3d/calib3d.hpp>
+#include <algorithm>
+#include <cmath>
+using namespace cv;
+using namespace std;
+
+/**
+ * Normalize a quaternion, falling back to the identity if it is degenerate.
+ */
+static Vec4d normalized(const Vec4d &q) {
+    double n = norm(q);
+    return n > 1e-12 ? q * (1.0 / n) : Vec4d(1, 0, 0, 0);
+}
+
+/**
+ * Hamilton product of two quaternions (w, x, y, z).
+ */
+static Vec4d multiply(const Vec4d &a, const Vec4d &b) {
+    return Vec4d(a[0] * b[0] - a[1] * b[1] - a[2] * b[2] - a[3] * b[3],
+                 a[0] * b[1] + a[1] * b[0] + a[2] * b[3] - a[3] * b[2],
+                 a[0] * b[2] - a[1] * b[3] + a[2] * b[0] + a[3] * b[1],
+                 a[0] * b[3] + a[1] * b[2] - a[2] * b[1] + a[3] * b[0]);
+}
+
+Pose::Pose() : t(0, 0, 0), q(1, 0, 0, 0) {
+}
+
+Pose Pose::fromRodrigues(const Vec3d &rvec, const Vec3d &tvec) {
+    Matx33d r;
+    Rodrigues(rvec, r);
+
+    // Convert the rotation matrix to a quaternion, choosing the largest
+    // component as the divisor for numerical stability
+    Pose p;
+    double trace = r(0, 0) + r(1, 1) + r(2, 2);
+    Vec4d q;
+    if (trace > 0) {
+        double s = 2.0 * sqrt(trace + 1.0);
+        q = Vec4d(0.25 * s, (r(2, 1) - r(1, 2)) / s, (r(0, 2) - r(2, 0)) / s, (r(1, 0) - r(0, 1)) / s);
+    } else if (r(0, 0) > r(1, 1) && r(0, 0) > r(2, 2)) {
+        double s = 2.0 * sqrt(1.0 + r(0, 0) - r(1, 1) - r(2, 2));
+        q = Vec4d((r(2, 1) - r(1, 2)) / s, 0.25 * s, (r(0, 1) + r(1, 0)) / s, (r(0, 2) + r(2, 0)) / s);
+    } else if (r(1, 1) > r(2, 2)) {
+        double s = 2.0 * sqrt(1.0 + r(1, 1) - r(0, 0) - r(2, 2));
+        q = Vec4d((r(0, 2) - r(2, 0)) / s, (r(0, 1) + r(1, 0)) / s, 0.25 * s, (r(1, 2) + r(2, 1)) / s);
+    } else {
+        double s = 2.0 * sqrt(1.0 + r(2, 2) - r(0, 0) - r(1, 1));
+        q = Vec4d((r(1, 0) - r(0, 1)) / s, (r(0, 2) + r(2, 0)) / s, (r(1, 2) + r(2, 1)) / s, 0.25 * s);
+    }
+    p.q = normalized(q);
+    p.t = tvec;
+    return p;
+}
+
+Matx33d Pose::rotation() const {
+    double w = q[0], x = q[1], y = q[2], z = q[3];
+    return Matx33d(1 - 2 * (y * y + z * z), 2 * (x * y - w * z),     2 * (x * z + w * y),
+                   2 * (x * y + w * z),     1 - 2 * (x * x + z * z), 2 * (y * z - w * x),
+                   2 * (x * z - w * y),     2 * (y * z + w * x),     1 - 2 * (x * x + y * y));
+}
+
+Pose Pose::then(const Pose &other) const {
+    Pose p;
+    p.q = normalized(multiply(other.q, q));
+    p.t = other.rotation() * t + other.t;
+    return p;
+}
+
+void Pose::glModelview(double m[16]) const {
+    Matx33d r = rotation();
+    for (int col = 0; col < 3; col++) {
+        m[col * 4 + 0] = r(0, col);
+        m[col * 4 + 1] = -r(1, col);
+        m[col * 4 + 2] = -r(2, col);
+        m[col * 4 + 3] = 0.0;
+    }
+    m[12] = t[0];
+    m[13] = -t[1];
+    m[14] = -t[2];
+    m[15] = 1.0;
+}
+
+/**
+ * Smoothing factor for an exponential filter with the given cutoff frequency.
+ */
+static double smoothing(double cutoff, double dt) {
+    double tau = 1.0 / (2.0 * CV_PI * cutoff);
+    return 1.0 / (1.0 + tau / dt);
+}
+
+OneEuroFilter::OneEuroFilter(double minCutoff, double beta, double dCutoff)
+    : minCutoff(minCutoff), beta(beta), dCutoff(dCutoff), initialized(false), x(0), dx(0), lastTime(0) {
+}
+
+double OneEuroFilter::filter(double sample, double t) {
+    if (!initialized) {
+        x = sample;
+        dx = 0.0;
+        lastTime = t;
+        initialized = true;
+        return x;
+    }
+    double dt = t - lastTime;
+    if (dt <= 0.0) return x;
+    lastTime = t;
+
+    dx += smoothing(dCutoff, dt) * ((sample - x) / dt - dx);
+    double cutoff = minCutoff + beta * fabs(dx);
+    x += smoothing(cutoff, dt) * (sample - x);
+    return x;
+}
+
+PoseFilter::PoseFilter(double minCutoff, double beta, double maxPrediction)
+    : maxPrediction(maxPrediction), initialized(false), lastTime(0), lastQ(1, 0, 0, 0) {
+    for (int i = 0; i < 7; i++) f[i] = OneEuroFilter(minCutoff, beta, 1.0);
+}
+
+void PoseFilter::update(const Pose &measured, double t) {
+    if (!initialized) {
+        for (int i = 0; i < 7; i++) f[i].reset();
+    }
+
+    // q and -q are the same rotation; keep to the hemisphere of the last
+    // estimate so the filter does not average across the flip
+    Vec4d q = measured.q;
+    if (initialized && q.dot(lastQ) < 0) q = -q;
+
+    for (int i = 0; i < 3; i++) f[i].filter(measured.t[i], t);
+    for (int i = 0; i < 4; i++) f[3 + i].filter(q[i], t);
+    lastQ = normalized(Vec4d(f[3].value(), f[4].value(), f[5].value(), f[6].value()));
+    lastTime = t;
+    initialized = true;
+}
+
+Pose PoseFilter::predict(double t) const {
+    Pose p;
+    if (!initialized) return p;
+
+    double dt = min(max(t - lastTime, 0.0), maxPrediction);
+    for (int i = 0; i < 3; i++) p.t[i] = f[i].value() + f[i].derivative() * dt;
+    Vec4d q;
+    for (int i = 0; i < 4; i++) q[i] = f[3 + i].value() + f[3 + i].derivative() * dt;
+    p.q = normalized(q);
+    return p;
+}
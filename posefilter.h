@@ -0,0 +1,141 @@
+/*
+ * Pose smoothing for OpenCV with OpenGL
+ *
+ * A marker pose measured independently in each frame jitters by a few
+ * pixels, and by the time a frame is displayed the camera has moved on.
+ * The PoseFilter smooths the measured poses with a one-euro filter (heavy
+ * smoothing when still, light smoothing when moving fast), and extrapolates
+ * the smoothed pose forward to the time the frame will be displayed.
+ */
+
+#ifndef POSEFILTER_H
+#define POSEFILTER_H
+
+#include <opencv2/core/core.hpp>
+
+/**
+ * A rigid transformation from marker (object) coordinates to camera
+ * coordinates, in the OpenCV convention (x right, y down, z forward).
+ */
+struct Pose {
+    cv::Vec3d t;    // translation
+    cv::Vec4d q;    // unit quaternion (w, x, y, z)
+
+    Pose();
+
+    /**
+     * Convert the output of solvePnP or estimatePoseSingleMarkers.
+     * @param rvec rotation, as a Rodrigues vector
+     * @param tvec translation
+     */
+    static Pose fromRodrigues(const cv::Vec3d &rvec, const cv::Vec3d &tvec);
+
+    /**
+     * @return the 3x3 rotation matrix for q
+     */
+    cv::Matx33d rotation() const;
+
+    /**
+     * @return this transformation followed by (applied after) other
+     */
+    Pose then(const Pose &other) const;
+
+    /**
+     * Compute the OpenGL modelview matrix for this pose.  The y and z axes
+     * are flipped, to convert from OpenCV to OpenGL eye coordinates.
+     * @param m receives the matrix, in column-major order (for glLoadMatrixd)
+     */
+    void glModelview(double m[16]) const;
+};
+
+/**
+ * The one-euro filter for a single value: a low-pass filter whose cutoff
+ * frequency rises with the speed of the signal.
+ * See Casiez et al., "1 Euro Filter", CHI 2012.
+ */
+class OneEuroFilter {
+public:
+    /**
+     * @param minCutoff cutoff frequency (Hz) when the signal is still; lower is smoother
+     * @param beta how quickly the cutoff rises with speed; higher reduces lag
+     * @param dCutoff cutoff frequency (Hz) for the speed estimate
+     */
+    OneEuroFilter(double minCutoff = 1.0, double beta = 0.0, double dCutoff = 1.0);
+
+    /**
+     * Add a sample and return the filtered value.
+     * @param x the sample
+     * @param t the time of the sample, in seconds
+     */
+    double filter(double x, double t);
+
+    /**
+     * @return the filtered value
+     */
+    double value() const { return x; }
+
+    /**
+     * @return the filtered rate of change, per second
+     */
+    double derivative() const { return dx; }
+
+    /**
+     * Forget all samples.
+     */
+    void reset() { initialized = false; }
+
+private:
+    double minCutoff, beta, dCutoff;
+    bool initialized;
+    double x, dx, lastTime;
+};
+
+/**
+ * Smooths a stream of poses and predicts the pose at a later time.
+ */
+class PoseFilter {
+public:
+    /**
+     * @param minCutoff cutoff frequency (Hz) when the marker is still
+     * @param beta increase in cutoff with speed
+     * @param maxPrediction the furthest ahead (seconds) the pose will be extrapolated
+     */
+    PoseFilter(double minCutoff = 1.0, double beta = 0.5, double maxPrediction = 0.1);
+
+    /**
+     * Add a measured pose.
+     * @param measured the pose from the detector
+     * @param t the capture time of the frame it was measured in, in seconds
+     */
+    void update(const Pose &measured, double t);
+
+    /**
+     * Predict the pose at a given time, extrapolating the smoothed motion.
+     * @param t the time, usually the expected display time of the frame
+     */
+    Pose predict(double t) const;
+
+    /**
+     * @return true once at least one pose has been added
+     */
+    bool valid() const { return initialized; }
+
+    /**
+     * @return the time of the most recently added pose
+     */
+    double lastUpdate() const { return lastTime; }
+
+    /**
+     * Forget all poses (e.g. when the marker is lost).
+     */
+    void reset() { initialized = false; }
+
+private:
+    OneEuroFilter f[7];     // tx, ty, tz, qw, qx, qy, qz
+    double maxPrediction;
+    bool initialized;
+    double lastTime;
+    cv::Vec4d lastQ;
+};
+
+#endif // POSEFILTER_H
@@ -0,0 +1,193 @@
+/*
+ * Video recording for OpenCV with OpenGL
+ * See recorder.h for an overview.
+ */
+
+#include "recorder.h"
+#include "glprocs.h"
+#include <opencv2/imgproc/imgproc.hpp>
+#include <iostream>
+#include "trace.h"
+using namespace cv;
+using namespace std;
+
+VideoRecorder::VideoRecorder() : fps(30.0), recording(false), blocking(false), next(0), pending(false),
+    stopping(false), written(0), dropped(0) {
+    pixelBuffers[0] = pixelBuffers[1] = 0;
+}
+
+VideoRecorder::~VideoRecorder() {
+    // Without a context, the pixel buffers cannot be read; just stop encoding
+    if (encoder.joinable()) {
+        {
+            unique_lock<mutex> guard(lock);
+            stopping = true;
+        }
+        changed.notify_all();
+        encoder.join();
+    }
+}
+
+void VideoRecorder::open(const string &name, double rate, int queueSize, const string &fourcc) {
+    file = name;
+    fps = rate > 0.0 ? rate : 30.0;
+    codec = fourcc;
+    if (codec.size() != 4) {
+        bool mp4 = file.size() > 4 && file.substr(file.size() - 4) == ".mp4";
+        codec = mp4 ? "mp4v" : "MJPG";
+    }
+    slots.clear();
+    slots.resize(max(1, queueSize));
+    freeSlots.clear();
+    queued.clear();
+    for (size_t i = 0; i < slots.size(); i++) freeSlots.push_back((int) i);
+    stopping = false;
+    written = dropped = 0;
+    pending = false;
+    next = 0;
+    message.clear();
+    recording = true;
+    encoder = thread(&VideoRecorder::encode, this);
+}
+
+void VideoRecorder::capture(int x, int y, int width, int height) {
+    if (!recording || width <= 0 || height <= 0) return;
+    if (pixelBuffers[0] == 0) glGenBuffers(2, pixelBuffers);
+
+    // Start reading this frame; glReadPixels returns at once, since the
+    // pixels go to a buffer object rather than to memory
+    size_t bytes = (size_t) width * height * 3;
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[next]);
+    glBufferData(GL_PIXEL_PACK_BUFFER, bytes, 0, GL_STREAM_READ);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(x, y, width, height, GL_BGR, GL_UNSIGNED_BYTE, 0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    // The previous frame has had a frame's time to arrive
+    next = 1 - next;
+    queuePending();
+    pending = true;
+    pendingSize = Size(width, height);
+}
+
+void VideoRecorder::queuePending() {
+    if (!pending) return;
+    pending = false;
+
+    // Take a free image, or wait for one, or drop the frame
+    int slot;
+    {
+        unique_lock<mutex> guard(lock);
+        if (freeSlots.empty() && blocking) {
+            changed.wait(guard, [this] { return !freeSlots.empty(); });
+        }
+        if (freeSlots.empty()) {
+            dropped++;
+            return;
+        }
+        slot = freeSlots.front();
+        freeSlots.pop_front();
+    }
+
+    // next now names the buffer holding the previous frame
+    Mat &img = slots[slot];
+    img.create(pendingSize, CV_8UC3);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, pixelBuffers[next]);
+    const void *pixels = glMapBuffer(GL_PIXEL_PACK_BUFFER, GL_READ_ONLY);
+    if (pixels) {
+        // OpenGL returns the bottom row first; turn it over while copying
+        // it out, rather than in a second pass
+        flip(Mat(pendingSize, CV_8UC3, (void *) pixels), img, 0);
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+    {
+        unique_lock<mutex> guard(lock);
+        if (pixels) {
+            queued.push_back(slot);
+        } else {
+            freeSlots.push_back(slot);
+        }
+    }
+    changed.notify_all();
+}
+
+int VideoRecorder::queueDepth() {
+    lock_guard<mutex> guard(lock);
+    return (int) queued.size();
+}
+
+long VideoRecorder::droppedFrames() {
+    lock_guard<mutex> guard(lock);
+    return dropped;
+}
+
+void VideoRecorder::close() {
+    if (!recording) return;
+
+    // The last frame is still in its pixel buffer
+    next = 1 - next;
+    queuePending();
+    {
+        unique_lock<mutex> guard(lock);
+        stopping = true;
+    }
+    changed.notify_all();
+    encoder.join();
+    if (pixelBuffers[0]) glDeleteBuffers(2, pixelBuffers);
+    pixelBuffers[0] = pixelBuffers[1] = 0;
+    recording = false;
+
+    if (!message.empty()) {
+        cout << message << endl;
+    } else {
+        cout << "Recorded " << written << " frames to " << file;
+        if (dropped > 0) cout << " (" << dropped << " dropped; the encoder could not keep up)";
+        cout << endl;
+    }
+}
+
+void VideoRecorder::encode() {
+    FrameTrace::nameThread("encode");
+    VideoWriter writer;
+    Size size;
+    Mat scaled;
+    for (;;) {
+        int slot;
+        {
+            unique_lock<mutex> guard(lock);
+            changed.wait(guard, [this] { return stopping || !queued.empty(); });
+            if (queued.empty()) break;
+            slot = queued.front();
+            queued.pop_front();
+        }
+
+        // The first frame sets the size; later frames of another size (the
+        // window was resized) are scaled to it
+        Mat &img = slots[slot];
+        if (!writer.isOpened() && message.empty()) {
+            size = img.size();
+            int fourcc = VideoWriter::fourcc(codec[0], codec[1], codec[2], codec[3]);
+            if (!writer.open(file, fourcc, fps, size)) message = "Cannot write video to " + file;
+        }
+        if (writer.isOpened()) {
+            TraceScope scope(TRACE_ENCODE, written);
+            if (img.size() == size) {
+                writer.write(img);
+            } else {
+                resize(img, scaled, size);
+                writer.write(scaled);
+            }
+            written++;
+        }
+
+        {
+            unique_lock<mutex> guard(lock);
+            freeSlots.push_back(slot);
+        }
+        changed.notify_all();
+    }
+    writer.release();
+}
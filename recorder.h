@@ -0,0 +1,114 @@
+/*
+ * Video recording for OpenCV with OpenGL
+ *
+ * Writes the rendered frames to a video file, with cv::VideoWriter.
+ * Encoding takes longer than rendering a frame, so it runs on a thread of
+ * its own: the render thread reads each frame back into one of a fixed
+ * number of preallocated images and queues it, and the encoding thread
+ * writes the queued images in order.  The readback itself goes through a
+ * pair of pixel buffer objects, so the render thread does not wait for the
+ * frame to finish: the pixels of each frame are fetched while the next one
+ * renders.  When the encoder falls behind and the queue is full, frames
+ * are either dropped (for live sessions, so rendering keeps its pace) or
+ * the render thread waits (for offscreen rendering, so none are lost).
+ */
+
+#ifndef RECORDER_H
+#define RECORDER_H
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/videoio/videoio.hpp>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+class VideoRecorder {
+public:
+    VideoRecorder();
+    ~VideoRecorder();
+
+    /**
+     * Start recording.  The file is opened when the first frame arrives,
+     * since its size is not known until then.
+     * @param file the video file; the codec follows the extension (MJPG
+     *        for .avi, mp4v for .mp4) unless given
+     * @param fps the frame rate written to the file
+     * @param queueSize the number of frames that can wait to be encoded
+     * @param fourcc the codec, as four characters, or empty for the default
+     */
+    void open(const std::string &file, double fps = 30.0, int queueSize = 8, const std::string &fourcc = "");
+
+    /**
+     * @return true between open() and close()
+     */
+    bool isOpen() const { return recording; }
+
+    /**
+     * Choose what happens when the queue is full.
+     * @param wait true to wait for the encoder, false to drop the frame
+     */
+    void setBlocking(bool wait) { blocking = wait; }
+
+    /**
+     * Read back the frame just rendered, and queue the one before it.
+     * Call on the render thread, with the context current, after drawing.
+     * Requires OpenGL 2.1 (pixel buffer objects).
+     * @param x the left of the area to record, in the framebuffer
+     * @param y the bottom of the area to record
+     * @param width the width of the area
+     * @param height the height of the area
+     */
+    void capture(int x, int y, int width, int height);
+
+    /**
+     * Queue the last frame read back, finish encoding, and close the file.
+     * Call on the render thread, with the context still current.
+     */
+    void close();
+
+    /**
+     * @return the frames waiting to be encoded
+     */
+    int queueDepth();
+
+    /**
+     * @return the frames dropped since open(), because the queue was full
+     */
+    long droppedFrames();
+
+    /**
+     * @return a description of the last failure, if any
+     */
+    const std::string &error() const { return message; }
+
+private:
+    VideoRecorder(const VideoRecorder &);
+    VideoRecorder &operator=(const VideoRecorder &);
+
+    void queuePending();
+    void encode();
+
+    std::string file, codec, message;
+    double fps;
+    bool recording, blocking;
+
+    // Readback, on the render thread
+    unsigned int pixelBuffers[2];
+    int next;                           // the pixel buffer the next frame goes to
+    bool pending;                       // the other pixel buffer holds a frame not yet queued
+    cv::Size pendingSize;
+
+    // The images, each either free or queued, and the encoding thread
+    std::vector<cv::Mat> slots;
+    std::deque<int> freeSlots, queued;
+    std::mutex lock;
+    std::condition_variable changed;
+    std::thread encoder;
+    bool stopping;
+    long written, dropped;
+};
+
+#endif // RECORDER_H
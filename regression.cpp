@@ -0,0 +1,57 @@
+/*
+ * Rendering regression checks for OpenCV with OpenGL
+ * See regression.h for an overview.
+ */
+
+#include "regression.h"
+#include <opencv2/core/core.hpp>
+#include <GL/gl.h>
+#include <algorithm>
+#include <cstdlib>
+using namespace cv;
+using namespace std;
+
+ImageDifference compareImages(const Mat &actual, const Mat &expected, int threshold, Mat &diff) {
+    ImageDifference result;
+    if (actual.size() != expected.size() || actual.type() != expected.type() || actual.depth() != CV_8U) {
+        result.meanError = 255.0;
+        result.maxError = 255;
+        result.badFraction = 1.0;
+        diff = Mat();
+        return result;
+    }
+
+    absdiff(actual, expected, diff);
+    int cn = diff.channels();
+    long long total = 0, bad = 0;
+    int maxError = 0;
+    for (int y = 0; y < diff.rows; y++) {
+        const uchar *p = diff.ptr<uchar>(y);
+        for (int x = 0; x < diff.cols; x++, p += cn) {
+            int worst = 0;
+            for (int c = 0; c < cn; c++) {
+                total += p[c];
+                worst = max(worst, (int) p[c]);
+            }
+            if (worst > threshold) bad++;
+            maxError = max(maxError, worst);
+        }
+    }
+
+    double pixels = (double) diff.rows * diff.cols;
+    result.meanError = pixels > 0 ? total / (pixels * cn) : 0.0;
+    result.maxError = maxError;
+    result.badFraction = pixels > 0 ? bad / pixels : 0.0;
+    return result;
+}
+
+Mat readFramebuffer(int width, int height) {
+    Mat img(height, width, CV_8UC3);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_BGR, GL_UNSIGNED_BYTE, img.ptr());
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+    // OpenGL returns the bottom row first
+    flip(img, img, 0);
+    return img;
+}
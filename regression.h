@@ -0,0 +1,42 @@
+/*
+ * Rendering regression checks for OpenCV with OpenGL
+ *
+ * Helpers for the regress subcommand, which renders fixed frames offscreen
+ * and compares them against golden images.  Software rasterizers do not
+ * all produce identical pixels (and neither do successive versions of the
+ * same one), so images are compared with a tolerance rather than exactly.
+ */
+
+#ifndef REGRESSION_H
+#define REGRESSION_H
+
+#include <opencv2/core/core.hpp>
+
+/**
+ * How much two images differ.
+ */
+struct ImageDifference {
+    double meanError;       // mean absolute difference per channel
+    int maxError;           // largest absolute difference of any channel
+    double badFraction;     // fraction of pixels with a channel differing by more than the threshold
+};
+
+/**
+ * Compare two images of the same size and type.
+ * @param actual the rendered image
+ * @param expected the golden image
+ * @param threshold the largest difference in a channel that still counts as a match
+ * @param diff receives an image of the differences, for inspection
+ * @return the differences; if the sizes differ, every pixel counts as bad
+ */
+ImageDifference compareImages(const cv::Mat &actual, const cv::Mat &expected, int threshold, cv::Mat &diff);
+
+/**
+ * Read the current OpenGL color buffer into an image.
+ * @param width the width of the area to read, from the lower-left corner
+ * @param height the height of the area to read
+ * @return the pixels, as BGR, with the top row first
+ */
+cv::Mat readFramebuffer(int width, int height);
+
+#endif // REGRESSION_H
@@ -0,0 +1,154 @@
+/*
+ * Scene registry for OpenCV with OpenGL
+ * See scene.h for an overview.
+ */
+
+#include "scene.h"
+#include <algorithm>
+using namespace cv;
+using namespace std;
+
+SceneRegistry::SceneRegistry(double markerLength, double holdTime)
+    : markerLength(markerLength), holdTime(holdTime) {
+}
+
+int SceneRegistry::addMarker(int markerId, const String &model, double scale, double length) {
+    SceneObject obj;
+    obj.model = model;
+    obj.handle = 0;
+    obj.markerId = markerId;
+    obj.markerLength = length > 0.0 ? length : markerLength;
+    obj.scale = scale * obj.markerLength;
+    obj.node = nodes.add();
+    int index = (int) objects.size();
+    objects.push_back(obj);
+    byMarker[markerId] = index;
+    return index;
+}
+
+int SceneRegistry::addBoard(const Ptr<aruco::Board> &board, const String &model, double scale) {
+    SceneObject obj;
+    obj.model = model;
+    obj.handle = 0;
+    obj.scale = scale;
+    obj.markerId = -1;
+    obj.markerLength = 0.0;
+    obj.board = board;
+    obj.node = nodes.add();
+    int index = (int) objects.size();
+    objects.push_back(obj);
+    boardObjects.push_back(index);
+    return index;
+}
+
+int SceneRegistry::addPart(int object, int parent, const String &model, double scale,
+                           const Vec3d &rvec, const Vec3d &offset) {
+    ScenePart part;
+    part.model = model;
+    part.handle = 0;
+    part.scale = scale;
+    part.node = nodes.add(parent >= 0 ? parts[parent].node : objects[object].node);
+    int index = (int) parts.size();
+    parts.push_back(part);
+    objects[object].parts.push_back(index);
+    setPartPose(index, rvec, offset);
+    return index;
+}
+
+void SceneRegistry::setPartPose(int part, const Vec3d &rvec, const Vec3d &offset) {
+    // The part's axes, in its parent's coordinates, are the columns
+    Matx33d r = Pose::fromRodrigues(rvec, offset).rotation();
+    double m[16] = {
+        r(0, 0), r(1, 0), r(2, 0), 0.0,
+        r(0, 1), r(1, 1), r(2, 1), 0.0,
+        r(0, 2), r(1, 2), r(2, 2), 0.0,
+        offset[0], offset[1], offset[2], 1.0
+    };
+    nodes.setLocal(parts[part].node, m);
+}
+
+/**
+ * Read a vector of three numbers from a file.
+ * @return the vector, or zero if the node is not a sequence of three
+ */
+static Vec3d readVec3(const FileNode &node) {
+    if (node.empty() || node.size() != 3) return Vec3d();
+    return Vec3d((double) node[0], (double) node[1], (double) node[2]);
+}
+
+void SceneRegistry::loadParts(const FileNode &list, int object, int parent) {
+    for (FileNodeIterator it = list.begin(); it != list.end(); ++it) {
+        FileNode node = *it;
+        String model = node["model"].empty() ? String("gem") : (String) node["model"];
+        double scale = node["scale"].empty() ? 1.0 : (double) node["scale"];
+        int part = addPart(object, parent, model, scale, readVec3(node["rotation"]), readVec3(node["offset"]));
+        loadParts(node["parts"], object, part);
+    }
+}
+
+bool SceneRegistry::load(const String &file, const Ptr<aruco::Dictionary> &dictionary) {
+    FileStorage fs(file, FileStorage::READ);
+    if (!fs.isOpened()) return false;
+
+    FileNode list = fs["objects"];
+    for (FileNodeIterator it = list.begin(); it != list.end(); ++it) {
+        FileNode node = *it;
+        String model = node["model"].empty() ? String("gem") : (String) node["model"];
+        FileNode board = node["board"];
+        if (!board.empty() && board.size() == 5) {
+            Ptr<aruco::Board> b = aruco::GridBoard::create((int) board[0], (int) board[1],
+                                                           (float) board[2], (float) board[3],
+                                                           dictionary, (int) board[4]);
+            double scale = node["scale"].empty() ? 1.0 : (double) node["scale"];
+            loadParts(node["parts"], addBoard(b, model, scale), -1);
+        } else if (!node["marker"].empty()) {
+            double scale = node["scale"].empty() ? 0.5 : (double) node["scale"];
+            double length = node["length"].empty() ? 0.0 : (double) node["length"];
+            loadParts(node["parts"], addMarker((int) node["marker"], model, scale, length), -1);
+        }
+    }
+    return true;
+}
+
+void SceneRegistry::update(const vector<Marker> &markers, const CameraModel &camera, double t) {
+    corners.resize(markers.size());
+    ids.resize(markers.size());
+    for (size_t i = 0; i < markers.size(); i++) {
+        if (!autoModel.empty() && byMarker.find(markers[i].id) == byMarker.end()) {
+            addMarker(markers[i].id, autoModel);
+        }
+        corners[i].assign(markers[i].corners.begin(), markers[i].corners.end());
+        ids[i] = markers[i].id;
+    }
+
+    // One call estimates every single-marker pose.  The translation scales
+    // with the side of the marker, so estimate for a unit marker and scale
+    // each result by its object's marker length.
+    if (!corners.empty()) {
+        aruco::estimatePoseSingleMarkers(corners, 1.0f, camera.cameraMatrix, camera.distCoeffs, rvecs, tvecs);
+        for (size_t i = 0; i < ids.size(); i++) {
+            unordered_map<int, int>::const_iterator it = byMarker.find(ids[i]);
+            if (it == byMarker.end()) continue;
+            SceneObject &obj = objects[it->second];
+            obj.pose.update(Pose::fromRodrigues(rvecs[i], tvecs[i] * obj.markerLength), t);
+        }
+    }
+
+    // Boards use all of their markers that are in view
+    for (size_t i = 0; i < boardObjects.size() && !corners.empty(); i++) {
+        SceneObject &obj = objects[boardObjects[i]];
+        Vec3d rvec, tvec;
+        if (aruco::estimatePoseBoard(corners, ids, obj.board, camera.cameraMatrix, camera.distCoeffs, rvec, tvec) > 0) {
+            obj.pose.update(Pose::fromRodrigues(rvec, tvec), t);
+        }
+    }
+
+    // Objects stay in view for a moment after their marker is lost, so a
+    // missed detection does not make them flicker
+    inView.clear();
+    for (size_t i = 0; i < objects.size(); i++) {
+        PoseFilter &pose = objects[i].pose;
+        if (pose.valid() && t - pose.lastUpdate() > holdTime) pose.reset();
+        if (pose.valid()) inView.push_back((int) i);
+    }
+}
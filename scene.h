@@ -0,0 +1,177 @@
+/*
+ * Scene registry for OpenCV with OpenGL
+ *
+ * Maps markers (or boards of markers) to the 3D objects placed on them.
+ * Each frame, the registry is updated from the markers found by the
+ * tracker: the pose of every object whose marker is in view is measured
+ * and smoothed, and only those objects are drawn.  All per-object state
+ * lives in the registry, so any number of objects can be tracked at once.
+ * Objects can carry parts, placed relative to the object or to another
+ * part, whose transformations are kept in a scene graph.
+ */
+
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/aruco.hpp>
+#include <unordered_map>
+#include <vector>
+#include "camera.h"
+#include "posefilter.h"
+#include "scenegraph.h"
+#include "tracking.h"
+
+/**
+ * A 3D object placed on a marker or a board.
+ */
+struct SceneObject {
+    cv::String model;       // name of the model to draw (e.g. "gem")
+    unsigned int handle;    // renderer's handle for the model, set by the caller
+    double scale;           // model units to scene units
+    int markerId;           // the marker the object sits on, or -1 for a board
+    double markerLength;    // side of the marker, in scene units
+    cv::Ptr<cv::aruco::Board> board;  // the board the object sits on, if any
+    PoseFilter pose;        // smoothed pose of the marker or board
+    int node;               // the object's node in the scene graph, whose local matrix is the modelview
+    std::vector<int> parts; // the indices of the parts attached to it, parents first
+};
+
+/**
+ * A model attached to an object, or to another part of the same object.
+ */
+struct ScenePart {
+    cv::String model;       // name of the model to draw
+    unsigned int handle;    // renderer's handle for the model, set by the caller
+    double scale;           // model units to scene units
+    int node;               // the part's node in the scene graph
+};
+
+/**
+ * The set of objects in the scene, and which of them are in view.
+ */
+class SceneRegistry {
+public:
+    /**
+     * @param markerLength default side of a marker, in scene units
+     * @param holdTime how long (seconds) an object stays in view after its marker is lost
+     */
+    SceneRegistry(double markerLength = 1.0, double holdTime = 0.5);
+
+    /**
+     * Place an object on a single marker.
+     * @param markerId the marker's ID in the tracker's dictionary
+     * @param model the name of the model to draw
+     * @param scale model units to marker sides (the gem is 2 units across, so 0.5 fits it to the marker)
+     * @param markerLength side of the marker (0 = the default)
+     * @return the index of the new object
+     */
+    int addMarker(int markerId, const cv::String &model, double scale = 0.5, double markerLength = 0.0);
+
+    /**
+     * Place an object on a board of markers.  Its pose is estimated from
+     * every marker of the board that is in view.
+     * @param board the board layout
+     * @param model the name of the model to draw
+     * @param scale model units to scene units
+     * @return the index of the new object
+     */
+    int addBoard(const cv::Ptr<cv::aruco::Board> &board, const cv::String &model, double scale = 1.0);
+
+    /**
+     * Attach a part to an object.
+     * @param object the index of the object
+     * @param parent the index of the part it is attached to, or -1 for the object itself
+     * @param model the name of the model to draw
+     * @param scale model units to scene units
+     * @param rvec rotation relative to the parent, as a Rodrigues vector
+     * @param offset translation relative to the parent, in scene units
+     * @return the index of the new part
+     */
+    int addPart(int object, int parent, const cv::String &model, double scale = 1.0,
+                const cv::Vec3d &rvec = cv::Vec3d(), const cv::Vec3d &offset = cv::Vec3d());
+
+    /**
+     * Move a part relative to its parent, e.g. to animate it.  Only the
+     * part and the parts attached to it are recomputed.
+     * @param part the index of the part
+     * @param rvec rotation, as a Rodrigues vector
+     * @param offset translation, in scene units
+     */
+    void setPartPose(int part, const cv::Vec3d &rvec, const cv::Vec3d &offset);
+
+    /**
+     * Read the objects from a file.  Each entry of the "objects" sequence has
+     * a "model", an optional "scale", and either a "marker" ID (with an
+     * optional "length") or a "board" given as [markersX, markersY,
+     * markerLength, markerSeparation, firstMarker].  It may also have a
+     * "parts" sequence, whose entries have a "model", an optional "scale",
+     * "offset" [x, y, z] (in scene units, along the marker's axes) and
+     * "rotation" [rx, ry, rz] (a Rodrigues vector), and "parts" of their own.
+     * @param file the file name (YAML or XML)
+     * @param dictionary the dictionary the tracker uses, for boards
+     * @return false if the file could not be read
+     */
+    bool load(const cv::String &file, const cv::Ptr<cv::aruco::Dictionary> &dictionary);
+
+    /**
+     * When enabled, a marker that has no object gets one automatically,
+     * showing the given model.  This is the default when there is no scene file.
+     * @param model the model for new objects, or empty to disable
+     */
+    void setAutoModel(const cv::String &model) { autoModel = model; }
+
+    /**
+     * Measure the pose of every object whose marker is in view.
+     * @param markers the markers found in the frame
+     * @param camera the camera that captured the frame
+     * @param t the capture time of the frame, in seconds
+     */
+    void update(const std::vector<Marker> &markers, const CameraModel &camera, double t);
+
+    /**
+     * @return the indices of the objects in view, in ascending order
+     */
+    const std::vector<int> &visible() const { return inView; }
+
+    /**
+     * @return the number of objects in the scene
+     */
+    size_t size() const { return objects.size(); }
+
+    SceneObject &operator[](size_t i) { return objects[i]; }
+    const SceneObject &operator[](size_t i) const { return objects[i]; }
+
+    /**
+     * @param i the index of a part
+     */
+    ScenePart &part(size_t i) { return parts[i]; }
+
+    /**
+     * @return the transformations of the objects and their parts
+     */
+    SceneGraph &graph() { return nodes; }
+
+private:
+    /**
+     * Add the parts listed in a file, and the parts attached to them.
+     */
+    void loadParts(const cv::FileNode &list, int object, int parent);
+
+
+    double markerLength, holdTime;
+    cv::String autoModel;
+    std::vector<SceneObject> objects;
+    std::vector<ScenePart> parts;
+    SceneGraph nodes;
+    std::unordered_map<int, int> byMarker;  // marker ID -> object index
+    std::vector<int> boardObjects;          // indices of objects on boards
+    std::vector<int> inView;
+
+    // Scratch storage, reused between frames
+    std::vector<std::vector<cv::Point2f> > corners;
+    std::vector<int> ids;
+    std::vector<cv::Vec3d> rvecs, tvecs;
+};
+
+#endif // SCENE_H
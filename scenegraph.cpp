@@ -0,0 +1,63 @@
+/*
+ * Scene graph for OpenCV with OpenGL
+ * See scenegraph.h for an overview.
+ */
+
+#include "scenegraph.h"
+#include <algorithm>
+using namespace std;
+
+static const double identity[16] = {
+    1.0, 0.0, 0.0, 0.0,
+    0.0, 1.0, 0.0, 0.0,
+    0.0, 0.0, 1.0, 0.0,
+    0.0, 0.0, 0.0, 1.0
+};
+
+int SceneGraph::add(int parent) {
+    int node = (int) parents.size();
+    parents.push_back(parent >= 0 && parent < node ? parent : -1);
+    locals.insert(locals.end(), identity, identity + 16);
+    worlds.insert(worlds.end(), identity, identity + 16);
+    dirty.push_back(1);
+    return node;
+}
+
+void SceneGraph::setLocal(int node, const double m[16]) {
+    copy(m, m + 16, &locals[16 * node]);
+    dirty[node] = 1;
+}
+
+/**
+ * Multiply two column-major 4x4 matrices.
+ * @param a the left matrix
+ * @param b the right matrix
+ * @param out set to a * b; must not overlap either
+ */
+static void multiply(const double *a, const double *b, double *out) {
+    for (int col = 0; col < 4; col++) {
+        for (int row = 0; row < 4; row++) {
+            out[col * 4 + row] = a[row] * b[col * 4] + a[4 + row] * b[col * 4 + 1]
+                               + a[8 + row] * b[col * 4 + 2] + a[12 + row] * b[col * 4 + 3];
+        }
+    }
+}
+
+size_t SceneGraph::update() {
+    // Parents come first, so by the time a node is reached, its parent's
+    // flag says whether anything above it changed
+    size_t count = 0;
+    for (size_t i = 0; i < parents.size(); i++) {
+        int p = parents[i];
+        if (p >= 0 && dirty[p]) dirty[i] = 1;
+        if (!dirty[i]) continue;
+        if (p >= 0) {
+            multiply(&worlds[16 * p], &locals[16 * i], &worlds[16 * i]);
+        } else {
+            copy(&locals[16 * i], &locals[16 * i] + 16, &worlds[16 * i]);
+        }
+        count++;
+    }
+    fill(dirty.begin(), dirty.end(), 0);
+    return count;
+}
@@ -0,0 +1,75 @@
+/*
+ * Scene graph for OpenCV with OpenGL
+ *
+ * A hierarchy of transformations, for overlays with parts that move with
+ * them (labels, arrows, the parts of a model).  The nodes are kept in flat
+ * arrays rather than as a tree of objects: each node has the index of its
+ * parent, which always comes before it, so one pass in index order visits
+ * every parent before its children.  Each node's local matrix (relative to
+ * its parent) is set by the caller; its world matrix is only recomputed
+ * when the local matrix of the node or of one of its ancestors has changed
+ * since the last update, so a marker out of view, or a static part, costs
+ * nothing.  The world matrices are stored together in one array, ready for
+ * glLoadMatrixd.
+ */
+
+#ifndef SCENEGRAPH_H
+#define SCENEGRAPH_H
+
+#include <cstddef>
+#include <vector>
+
+class SceneGraph {
+public:
+    /**
+     * Add a node, with an identity local matrix.
+     * @param parent the index of its parent, or -1 for a root
+     * @return the index of the new node
+     */
+    int add(int parent = -1);
+
+    /**
+     * Set the transformation of a node relative to its parent.
+     * @param node the index of the node
+     * @param m the matrix, column-major as in OpenGL
+     */
+    void setLocal(int node, const double m[16]);
+
+    /**
+     * Recompute the world matrices of the nodes that changed, and of all
+     * their descendants.
+     * @return the number of matrices recomputed
+     */
+    size_t update();
+
+    /**
+     * @param node the index of the node
+     * @return the matrix from the node's coordinates to the root's parent
+     *         (the camera, for nodes on markers), as of the last update()
+     */
+    const double *world(int node) const { return &worlds[16 * node]; }
+
+    /**
+     * @param node the index of the node
+     * @return the matrix from the node's coordinates to its parent's
+     */
+    const double *local(int node) const { return &locals[16 * node]; }
+
+    /**
+     * @param node the index of the node
+     * @return the index of its parent, or -1 for a root
+     */
+    int parent(int node) const { return parents[node]; }
+
+    /**
+     * @return the number of nodes
+     */
+    size_t size() const { return parents.size(); }
+
+private:
+    std::vector<int> parents;
+    std::vector<double> locals, worlds;     // 16 per node, column-major
+    std::vector<char> dirty;                // 1 if the local matrix changed since the last update
+};
+
+#endif // SCENEGRAPH_H
@@ -0,0 +1,200 @@
+/*
+ * Image sequence input for OpenCV with OpenGL
+ * See sequence.h for an overview.
+ */
+
+#include "sequence.h"
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <fstream>
+#include "trace.h"
+using namespace cv;
+using namespace std;
+
+static const int kDefaultThreads = 4;                       // decoder threads unless asked for more
+static const size_t kBufferBudget = (size_t) 256 << 20;     // frame buffers decoded ahead, by default
+
+/**
+ * Read a whole file into a buffer, reusing the buffer's memory.
+ * @return false if the file could not be read
+ */
+static bool readFile(const string &name, vector<uchar> &data) {
+    ifstream in(name.c_str(), ios::binary);
+    if (!in) return false;
+    in.seekg(0, ios::end);
+    streamoff size = in.tellg();
+    if (size <= 0) return false;
+    in.seekg(0, ios::beg);
+    data.resize((size_t) size);
+    return (bool) in.read((char *) &data[0], size);
+}
+
+/**
+ * @return true if a file exists and can be read
+ */
+static bool fileExists(const string &name) {
+    ifstream in(name.c_str(), ios::binary);
+    return (bool) in;
+}
+
+ImageSequence::ImageSequence() : first(0), count(0), pool(0), nextDecode(0), nextRead(0), stopping(false) {
+}
+
+ImageSequence::~ImageSequence() {
+    close();
+}
+
+bool ImageSequence::isPattern(const string &name) {
+    // Exactly one integer conversion, e.g. %d or %04d; %% is a literal %
+    int conversions = 0;
+    for (size_t i = 0; i < name.size(); i++) {
+        if (name[i] != '%') continue;
+        size_t j = i + 1;
+        if (j < name.size() && name[j] == '%') {
+            i = j;
+            continue;
+        }
+        while (j < name.size() && isdigit((unsigned char) name[j])) j++;
+        if (j >= name.size() || (name[j] != 'd' && name[j] != 'i' && name[j] != 'u')) return false;
+        conversions++;
+        i = j;
+    }
+    return conversions == 1;
+}
+
+string ImageSequence::fileName(long frame) const {
+    char name[4096];
+    snprintf(name, sizeof(name), pattern.c_str(), first + (int) (frame % count));
+    return name;
+}
+
+bool ImageSequence::open(const string &p, int threads, int ahead) {
+    close();
+    if (!isPattern(p)) return false;
+    pattern = p;
+
+    // Like cv::VideoCapture, start at 0 or 1, and end at the first gap
+    count = 1;
+    first = 0;
+    if (!fileExists(fileName(0))) first = 1;
+    if (!fileExists(fileName(0))) return false;
+    for (count = 1; ; count++) {
+        char name[4096];
+        snprintf(name, sizeof(name), pattern.c_str(), first + count);
+        if (!fileExists(name)) break;
+    }
+
+    // Decode the first frame here, for its size: the pool's buffers are
+    // allocated at that size, enough for every slot, the frame the reader
+    // holds, and the one it is giving up
+    vector<uchar> data;
+    Mat img;
+    if (!readFile(fileName(0), data)) return false;
+    imdecode(data, IMREAD_COLOR, &img);
+    if (img.empty()) return false;
+
+    // A few threads keep up with the display; by default, more would only
+    // multiply the buffers (a 4K frame is 25 MB), which are kept within a
+    // budget unless the threads themselves need more
+    if (threads <= 0) threads = min(getNumberOfCPUs(), kDefaultThreads);
+    if (ahead <= 0) {
+        size_t frameBytes = max((size_t) 1, img.total() * img.elemSize());
+        int affordable = (int) min((size_t) 1 << 20, kBufferBudget / frameBytes) - 2;
+        ahead = min(2 * threads, affordable);
+    }
+    slots.resize(max(ahead, threads));
+    Slot &head = slots[0];
+    head.data.swap(data);
+    pool = FramePool::create((int) slots.size() + 2, img.size(), img.type());
+    for (size_t i = 0; i < slots.size(); i++) slots[i].state = FREE;
+    pool->acquire(head.image);
+    img.copyTo(head.image);
+    head.state = READY;
+    nextDecode = 1;
+    nextRead = 0;
+
+    stopping = false;
+    for (int i = 0; i < threads; i++) workers.push_back(thread(&ImageSequence::decode, this));
+    return true;
+}
+
+void ImageSequence::decode() {
+    FrameTrace::nameThread("decode");
+    unique_lock<mutex> guard(lock);
+    for (;;) {
+        // The slot of the next frame is free once the frame before it in
+        // the slot has been read
+        freed.wait(guard, [this] { return stopping || slots[nextDecode % slots.size()].state == FREE; });
+        if (stopping) return;
+        long frame = nextDecode++;
+        Slot &slot = slots[frame % slots.size()];
+        slot.state = DECODING;
+
+        // Wait for a buffer, if the reader is holding on to frames
+        guard.unlock();
+        while (!pool->acquire(slot.image, 0.1)) {
+            lock_guard<mutex> stop(lock);
+            if (stopping) return;
+        }
+        int64_t start = FrameTrace::ticks();
+        bool ok = readFile(fileName(frame), slot.data);
+        if (ok) {
+            // Decodes into the buffer, unless the size has changed
+            imdecode(slot.data, IMREAD_COLOR, &slot.image);
+            ok = !slot.image.empty();
+        }
+        FrameTrace::instance().record(TRACE_DECODE, frame, start);
+        guard.lock();
+        slot.state = ok ? READY : FAILED;
+        decoded.notify_all();
+    }
+}
+
+bool ImageSequence::read(Mat &img) {
+    if (!isOpen()) return false;
+    unique_lock<mutex> guard(lock);
+    Slot &slot = slots[nextRead % slots.size()];
+    decoded.wait(guard, [&slot] { return slot.state == READY || slot.state == FAILED; });
+    bool ok = slot.state == READY;
+
+    // Hand the frame over; no decoder touches the slot until it is free again
+    guard.unlock();
+    if (ok) {
+        // The buffer goes back through its own UMatData; the caller's Mat
+        // must not keep the pool as its allocator, since the pool may be
+        // gone by the time the Mat is next created into
+        img = slot.image;
+        img.allocator = 0;
+    }
+    slot.image.release();
+    guard.lock();
+    slot.state = FREE;
+    nextRead++;
+    freed.notify_all();
+    return ok;
+}
+
+int ImageSequence::ready() {
+    lock_guard<mutex> guard(lock);
+    int n = 0;
+    for (size_t i = 0; i < slots.size(); i++) {
+        if (slots[i].state == READY) n++;
+    }
+    return n;
+}
+
+void ImageSequence::close() {
+    {
+        lock_guard<mutex> guard(lock);
+        stopping = true;
+    }
+    freed.notify_all();
+    for (size_t i = 0; i < workers.size(); i++) workers[i].join();
+    workers.clear();
+    slots.clear();
+    if (pool) pool->retire();
+    pool = 0;
+    stopping = false;
+}
@@ -0,0 +1,112 @@
+/*
+ * Image sequence input for OpenCV with OpenGL
+ *
+ * Reads a numbered sequence of image files (e.g. "frames/%04d.jpg") as a
+ * video.  cv::VideoCapture decodes one image at a time, on the thread that
+ * asks for it, and a 4K JPEG takes longer to decode than a frame takes to
+ * render.  Here a pool of decoder threads works ahead of the reader
+ * instead: each takes the next frame number, decodes that file into one
+ * slot of a fixed ring, and marks it ready.  The reader takes the frames
+ * from the ring in order, so up to the ring's size frames are decoded at
+ * once, on as many cores, while the frames still arrive in sequence.
+ *
+ * The images are decoded into buffers from a FramePool, allocated once,
+ * and handed to the reader as they are, without a copy; each buffer comes
+ * back to the pool when the reader lets go of its frame.  The buffers the
+ * files are read into are reused too.  Like a video file, the sequence
+ * starts again from the beginning when it ends.
+ */
+
+#ifndef SEQUENCE_H
+#define SEQUENCE_H
+
+#include <opencv2/core/core.hpp>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "framepool.h"
+
+class ImageSequence {
+public:
+    ImageSequence();
+    ~ImageSequence();
+
+    /**
+     * @param name an input name
+     * @return true if the name is a pattern with a frame number (printf style)
+     */
+    static bool isPattern(const std::string &name);
+
+    /**
+     * Find the files of a sequence, and start decoding them.  The sequence
+     * starts at frame 0 or 1, and ends before the first missing number.
+     * @param pattern the file name pattern, with one integer conversion
+     * @param threads the decoder threads; 0 for one per core, up to 4
+     * @param ahead the most frames decoded before they are read; 0 for two
+     *        per thread, as far as 256 MB of frame buffers allow (but at
+     *        least one per thread)
+     * @return false if there is no first frame
+     */
+    bool open(const std::string &pattern, int threads = 0, int ahead = 0);
+
+    /**
+     * @return true if a sequence is open
+     */
+    bool isOpen() const { return !workers.empty(); }
+
+    /**
+     * Get the next frame, waiting for it to be decoded if need be.
+     * @param img receives the frame, BGR, in a buffer of the pool; the
+     *            frame it held before is released
+     * @return false if the frame could not be read or decoded
+     */
+    bool read(cv::Mat &img);
+
+    /**
+     * @return the frames decoded and waiting to be read
+     */
+    int ready();
+
+    /**
+     * @return the number of frames in the sequence
+     */
+    int frameCount() const { return count; }
+
+    /**
+     * Stop the decoders, and release the ring.
+     */
+    void close();
+
+private:
+    enum SlotState { FREE, DECODING, READY, FAILED };
+
+    struct Slot {
+        cv::Mat image;                     // from the pool, while decoding or decoded
+        std::vector<unsigned char> data;   // the file's contents
+        SlotState state;
+    };
+
+    /**
+     * Decode frames into free slots until the sequence is closed.
+     */
+    void decode();
+
+    /**
+     * @return the file name of a frame, counted from the start of the sequence
+     */
+    std::string fileName(long frame) const;
+
+    std::string pattern;
+    int first, count;               // the number of the first file, and how many there are
+    std::vector<Slot> slots;        // frame f goes in slot f % slots.size()
+    FramePool *pool;
+    long nextDecode, nextRead;      // frame numbers; they keep counting when the sequence starts again
+    bool stopping;
+    std::mutex lock;
+    std::condition_variable decoded, freed;
+    std::vector<std::thread> workers;
+};
+
+#endif // SEQUENCE_H
@@ -0,0 +1,315 @@
+/*
+ * Mesh simplification for OpenCV with OpenGL
+ * See simplify.h for an overview.
+ */
+
+#include "simplify.h"
+#include <algorithm>
+#include <cmath>
+#include <queue>
+using namespace std;
+
+/**
+ * The sum of squared distances to a set of planes, as a symmetric 4x4
+ * matrix: for a point p, cost = p^T A p + 2 b^T p + c.
+ */
+struct Quadric {
+    double a00, a01, a02, a11, a12, a22, b0, b1, b2, c;
+    double weight;          // the total weight of the planes
+
+    Quadric() : a00(0), a01(0), a02(0), a11(0), a12(0), a22(0), b0(0), b1(0), b2(0), c(0), weight(0) {}
+
+    /**
+     * Add the plane n.x + d = 0, with n of unit length.
+     */
+    void addPlane(const double n[3], double d, double weight) {
+        a00 += weight * n[0] * n[0];
+        a01 += weight * n[0] * n[1];
+        a02 += weight * n[0] * n[2];
+        a11 += weight * n[1] * n[1];
+        a12 += weight * n[1] * n[2];
+        a22 += weight * n[2] * n[2];
+        b0 += weight * n[0] * d;
+        b1 += weight * n[1] * d;
+        b2 += weight * n[2] * d;
+        c += weight * d * d;
+        this->weight += weight;
+    }
+
+    void add(const Quadric &q) {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02;
+        a11 += q.a11; a12 += q.a12; a22 += q.a22;
+        b0 += q.b0; b1 += q.b1; b2 += q.b2;
+        c += q.c;
+        weight += q.weight;
+    }
+
+    double evaluate(const float *p) const {
+        double x = p[0], y = p[1], z = p[2];
+        double cost = a00 * x * x + a11 * y * y + a22 * z * z
+                    + 2.0 * (a01 * x * y + a02 * x * z + a12 * y * z)
+                    + 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+        return max(cost, 0.0);
+    }
+};
+
+/**
+ * A candidate collapse of vertex u onto vertex v.  It is stale if either
+ * vertex has changed since, as shown by their stamps.
+ */
+struct Collapse {
+    float cost;
+    uint32_t u, v;
+    uint32_t stampU, stampV;
+
+    bool operator>(const Collapse &other) const { return cost > other.cost; }
+};
+
+/**
+ * The unit normal of a triangle, and twice its area.
+ */
+static double triangleNormal(const float *a, const float *b, const float *c, double n[3]) {
+    double u[3] = { b[0] - a[0], b[1] - a[1], b[2] - a[2] };
+    double v[3] = { c[0] - a[0], c[1] - a[1], c[2] - a[2] };
+    n[0] = u[1] * v[2] - u[2] * v[1];
+    n[1] = u[2] * v[0] - u[0] * v[2];
+    n[2] = u[0] * v[1] - u[1] * v[0];
+    double len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+    if (len > 0.0) {
+        n[0] /= len;
+        n[1] /= len;
+        n[2] /= len;
+    }
+    return len;
+}
+
+typedef priority_queue<Collapse, vector<Collapse>, greater<Collapse> > CollapseQueue;
+
+/**
+ * Queue the cheaper way of collapsing an edge, if it can collapse at all.
+ */
+static void queueEdge(uint32_t a, uint32_t b, const float *p, const vector<Quadric> &quadrics,
+                      const vector<char> &boundary, const vector<uint32_t> &stamp, CollapseQueue &queue) {
+    Quadric q = quadrics[a];
+    q.add(quadrics[b]);
+    double costAB = q.evaluate(p + 3 * b), costBA = q.evaluate(p + 3 * a);
+
+    // A boundary vertex cannot move inside
+    if (boundary[a] && !boundary[b]) costAB = HUGE_VAL;
+    if (boundary[b] && !boundary[a]) costBA = HUGE_VAL;
+    if (costAB == HUGE_VAL && costBA == HUGE_VAL) return;
+
+    Collapse c;
+    bool ab = costAB <= costBA;
+    c.cost = (float) (ab ? costAB : costBA);
+    c.u = ab ? a : b;
+    c.v = ab ? b : a;
+    c.stampU = stamp[c.u];
+    c.stampV = stamp[c.v];
+    queue.push(c);
+}
+
+/**
+ * @return the indices of the triangles not removed
+ */
+static vector<uint32_t> liveTriangles(const vector<uint32_t> &tri, const vector<char> &deadTriangle, size_t live) {
+    vector<uint32_t> level;
+    level.reserve(3 * live);
+    for (size_t t = 0; t < deadTriangle.size(); t++) {
+        if (!deadTriangle[t]) level.insert(level.end(), &tri[3 * t], &tri[3 * t] + 3);
+    }
+    return level;
+}
+
+void buildLodChain(const Mesh &mesh, LodChain &chain, size_t minTriangles, double ratio) {
+    chain.indices.clear();
+    chain.errors.clear();
+    size_t vertexCount = mesh.vertexCount(), triangleCount = mesh.triangleCount();
+    size_t target = (size_t) (triangleCount * ratio);
+    if (target < minTriangles) return;
+
+    const float *p = mesh.positions.empty() ? 0 : &mesh.positions[0];
+    vector<uint32_t> tri(mesh.indices);
+    vector<char> deadTriangle(triangleCount, 0);
+
+    // The triangles around each vertex
+    vector<vector<uint32_t> > around(vertexCount);
+    for (size_t i = 0; i < tri.size(); i++) around[tri[i]].push_back((uint32_t) (i / 3));
+
+    // Each vertex starts with the planes of its triangles
+    vector<Quadric> quadrics(vertexCount);
+    for (size_t t = 0; t < triangleCount; t++) {
+        double n[3];
+        const uint32_t *v = &tri[3 * t];
+        triangleNormal(p + 3 * v[0], p + 3 * v[1], p + 3 * v[2], n);
+        double d = -(n[0] * p[3 * v[0]] + n[1] * p[3 * v[0] + 1] + n[2] * p[3 * v[0] + 2]);
+        for (int k = 0; k < 3; k++) quadrics[v[k]].addPlane(n, d, 1.0);
+    }
+
+    // Find the edges, and which are on a boundary (used by one triangle).
+    // Boundary vertices only move along the boundary, which is held in
+    // place by planes through the edge, perpendicular to the triangle.
+    vector<uint64_t> edges;
+    edges.reserve(tri.size());
+    for (size_t t = 0; t < triangleCount; t++) {
+        for (int k = 0; k < 3; k++) {
+            uint64_t a = tri[3 * t + k], b = tri[3 * t + (k + 1) % 3];
+            edges.push_back(a < b ? a << 32 | b : b << 32 | a);
+        }
+    }
+    sort(edges.begin(), edges.end());
+    vector<char> boundary(vertexCount, 0);
+    vector<uint64_t> edgeList;
+    edgeList.reserve(edges.size() / 2);
+    for (size_t i = 0; i < edges.size(); ) {
+        size_t j = i;
+        while (j < edges.size() && edges[j] == edges[i]) j++;
+        edgeList.push_back(edges[i]);
+        if (j - i == 1) {
+            uint32_t a = (uint32_t) (edges[i] >> 32), b = (uint32_t) edges[i];
+            boundary[a] = 1;
+            boundary[b] = 1;
+
+            // The plane through the edge, perpendicular to its triangle
+            for (size_t k = 0; k < around[a].size(); k++) {
+                const uint32_t *v = &tri[3 * around[a][k]];
+                if (v[0] != b && v[1] != b && v[2] != b) continue;
+                double n[3], e[3] = { p[3 * b] - p[3 * a], p[3 * b + 1] - p[3 * a + 1], p[3 * b + 2] - p[3 * a + 2] };
+                triangleNormal(p + 3 * v[0], p + 3 * v[1], p + 3 * v[2], n);
+                double m[3] = { e[1] * n[2] - e[2] * n[1], e[2] * n[0] - e[0] * n[2], e[0] * n[1] - e[1] * n[0] };
+                double len = sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+                if (len == 0.0) break;
+                for (int c = 0; c < 3; c++) m[c] /= len;
+                double d = -(m[0] * p[3 * a] + m[1] * p[3 * a + 1] + m[2] * p[3 * a + 2]);
+                quadrics[a].addPlane(m, d, 1.0);
+                quadrics[b].addPlane(m, d, 1.0);
+                break;
+            }
+        }
+        i = j;
+    }
+    edges.clear();
+
+    // Queue the cheaper direction of each edge that can collapse at all
+    vector<uint32_t> stamp(vertexCount, 0);
+    vector<char> dead(vertexCount, 0);
+    CollapseQueue queue;
+    for (size_t i = 0; i < edgeList.size(); i++) {
+        queueEdge((uint32_t) (edgeList[i] >> 32), (uint32_t) edgeList[i], p, quadrics, boundary, stamp, queue);
+    }
+    vector<uint64_t>().swap(edgeList);
+
+    size_t live = triangleCount;
+    double maxError = 0.0;
+    vector<uint32_t> neighbors;
+    while (!queue.empty()) {
+        Collapse c = queue.top();
+        queue.pop();
+        uint32_t u = c.u, v = c.v;
+        if (dead[u] || dead[v] || stamp[u] != c.stampU || stamp[v] != c.stampV) continue;
+
+        // Check the triangles around u: a boundary vertex may only move
+        // along a boundary edge, and no triangle may flip over
+        int shared = 0;
+        bool valid = true;
+        const vector<uint32_t> &ring = around[u];
+        for (size_t k = 0; k < ring.size() && valid; k++) {
+            uint32_t t = ring[k];
+            if (deadTriangle[t]) continue;
+            const uint32_t *w = &tri[3 * t];
+            if (w[0] == v || w[1] == v || w[2] == v) {
+                shared++;
+                continue;
+            }
+            double before[3], after[3];
+            triangleNormal(p + 3 * w[0], p + 3 * w[1], p + 3 * w[2], before);
+            const float *q[3];
+            for (int j = 0; j < 3; j++) q[j] = p + 3 * (w[j] == u ? v : w[j]);
+            if (triangleNormal(q[0], q[1], q[2], after) == 0.0 ||
+                before[0] * after[0] + before[1] * after[1] + before[2] * after[2] < 0.2) valid = false;
+        }
+        if (shared == 0 || (boundary[u] && shared != 1)) valid = false;
+        if (!valid) continue;
+
+        // Collapse: triangles on the edge go, the rest move to v
+        for (size_t k = 0; k < ring.size(); k++) {
+            uint32_t t = ring[k];
+            if (deadTriangle[t]) continue;
+            uint32_t *w = &tri[3 * t];
+            if (w[0] == v || w[1] == v || w[2] == v) {
+                deadTriangle[t] = 1;
+                live--;
+                continue;
+            }
+            for (int j = 0; j < 3; j++) {
+                if (w[j] == u) w[j] = v;
+            }
+            around[v].push_back(t);
+        }
+        vector<uint32_t>().swap(around[u]);
+        dead[u] = 1;
+        quadrics[v].add(quadrics[u]);
+        stamp[v]++;
+
+        // The error is estimated from the RMS distance to the planes of the
+        // merged triangles; the largest distance is typically two or three
+        // times that, so this errs on the side of detail
+        double rms = sqrt(c.cost / quadrics[v].weight);
+        maxError = max(maxError, 3.0 * rms);
+
+        // Drop the removed triangles from v's list, and requeue its edges
+        vector<uint32_t> &vRing = around[v];
+        neighbors.clear();
+        size_t kept = 0;
+        for (size_t k = 0; k < vRing.size(); k++) {
+            uint32_t t = vRing[k];
+            if (deadTriangle[t]) continue;
+            vRing[kept++] = t;
+            for (int j = 0; j < 3; j++) {
+                if (tri[3 * t + j] != v) neighbors.push_back(tri[3 * t + j]);
+            }
+        }
+        vRing.resize(kept);
+        sort(neighbors.begin(), neighbors.end());
+        neighbors.erase(unique(neighbors.begin(), neighbors.end()), neighbors.end());
+        for (size_t k = 0; k < neighbors.size(); k++) {
+            queueEdge(v, neighbors[k], p, quadrics, boundary, stamp, queue);
+        }
+
+        // Keep a level each time the target is reached
+        if (live <= target) {
+            chain.indices.push_back(liveTriangles(tri, deadTriangle, live));
+            chain.errors.push_back((float) maxError);
+            target = (size_t) (live * ratio);
+            if (target < minTriangles) return;
+        }
+    }
+
+    // Keep what the last collapses achieved, if it is worth a level
+    size_t previous = chain.indices.empty() ? triangleCount : chain.indices.back().size() / 3;
+    if (live < 0.8 * previous && live > 0) {
+        chain.indices.push_back(liveTriangles(tri, deadTriangle, live));
+        chain.errors.push_back((float) maxError);
+    }
+}
+
+int selectLevel(const float *errors, int count, const float center[3], float radius,
+                const double m[16], const double p[16], int viewportHeight, double tolerance) {
+    if (count < 1 || tolerance <= 0.0) return 0;
+
+    // How many pixels one model unit covers at the nearest point of the
+    // bounding sphere: the projection's vertical focal length, times the
+    // scale of the modelview transformation, over the distance
+    double unit = sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+    double pixels = p[5] * viewportHeight / 2.0 * unit;
+    if (p[11] != 0.0) {
+        double z = m[2] * center[0] + m[6] * center[1] + m[10] * center[2] + m[14];
+        double distance = -z - unit * radius;
+        if (distance <= 0.0) return 0;
+        pixels /= distance;
+    }
+
+    int level = 0;
+    while (level < count && errors[level] * pixels <= tolerance) level++;
+    return level;
+}
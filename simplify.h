@@ -0,0 +1,45 @@
+/*
+ * Mesh simplification for OpenCV with OpenGL
+ *
+ * Builds levels of detail by collapsing edges, cheapest first, where the
+ * cost is the quadric error metric (Garland and Heckbert, "Surface
+ * simplification using quadric error metrics").  Each edge collapses onto
+ * one of its own vertices, so every level uses a subset of the original
+ * vertices, with their original normals, and the levels differ only in
+ * their indices.  Open boundaries and seams (where a vertex is split for a
+ * hard edge) are kept in place.
+ */
+
+#ifndef SIMPLIFY_H
+#define SIMPLIFY_H
+
+#include "mesh.h"
+
+/**
+ * Build coarser and coarser versions of a mesh, each with about ratio
+ * times as many triangles as the one before, until fewer than
+ * minTriangles would be left, or the mesh cannot be simplified further.
+ * @param mesh the mesh
+ * @param chain receives the levels; none, for a small mesh
+ * @param minTriangles the fewest triangles worth a level
+ * @param ratio the reduction from one level to the next
+ */
+void buildLodChain(const Mesh &mesh, LodChain &chain, size_t minTriangles = 256, double ratio = 0.5);
+
+/**
+ * Choose the coarsest level of detail whose error, at the nearest point of
+ * the mesh, covers at most a given number of pixels.
+ * @param errors the error of each coarser level, in model units, increasing
+ * @param count the number of coarser levels
+ * @param center the center of a sphere around the mesh, in model units
+ * @param radius the radius of the sphere
+ * @param modelview the modelview matrix, column-major
+ * @param projection the projection matrix, column-major
+ * @param viewportHeight the height of the viewport, in pixels
+ * @param tolerance the largest error to allow, in pixels
+ * @return 0 for full detail, or 1 + the index of the coarser level
+ */
+int selectLevel(const float *errors, int count, const float center[3], float radius,
+                const double modelview[16], const double projection[16], int viewportHeight, double tolerance);
+
+#endif // SIMPLIFY_H
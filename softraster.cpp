@@ -0,0 +1,421 @@
+/*
+ * Software rendering for OpenCV with OpenGL
+ * See softraster.h for an overview.
+ */
+
+#include "softraster.h"
+#include <opencv2/imgproc/imgproc.hpp>
+#include <algorithm>
+#include <cmath>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+using namespace cv;
+using namespace std;
+
+static const int kTileSize = 64;
+
+// Clip coordinates beyond this many times w are clipped, so window
+// coordinates stay small enough for exact edge functions: for frames up
+// to 8K wide, under 2^20 sixteenths of a pixel
+static const double kGuardBand = 8.0;
+
+// Edge functions further than this from zero are clamped to it before
+// they go into 32-bit lanes; the few pixels across a chunk cannot change
+// their sign
+static const int64_t kEdgeLimit = (int64_t) 1 << 30;
+
+// The lighting of the window (see setupLighting() in geometry.cpp): the
+// gem's material, OpenGL's default diffuse color, and a directional light
+// from the upper right front, fixed in eye coordinates, without a local
+// viewer
+static const float kAmbient[3] = { 0.5f * 0.8f, 0.5f * 0.1f, 0.5f * 0.1f };   // global ambient * material, BGR
+static const float kDiffuse[3] = { 0.8f, 0.8f, 0.8f };
+static const float kSpecular[3] = { 1.0f, 0.8f, 0.8f };
+static const float kShininess = 50.0f;
+
+// Lanes: a few floats (or 32-bit integers) operated on at once, with the
+// widest instructions the compiler is allowed to use.  A mask has all bits
+// set in the lanes where a comparison held.
+#if defined(__AVX2__)
+static const int kLanes = 8;
+typedef __m256 Lanes;
+typedef __m256i IntLanes;
+static inline Lanes splat(float v) { return _mm256_set1_ps(v); }
+static inline Lanes ramp() { return _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f); }
+static inline Lanes add(Lanes a, Lanes b) { return _mm256_add_ps(a, b); }
+static inline Lanes mul(Lanes a, Lanes b) { return _mm256_mul_ps(a, b); }
+static inline Lanes load(const float *p) { return _mm256_loadu_ps(p); }
+static inline void store(float *p, Lanes a) { _mm256_storeu_ps(p, a); }
+static inline Lanes atLeast(Lanes a, Lanes b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+static inline Lanes above(Lanes a, Lanes b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+static inline Lanes below(Lanes a, Lanes b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+static inline Lanes both(Lanes a, Lanes b) { return _mm256_and_ps(a, b); }
+static inline Lanes select(Lanes mask, Lanes a, Lanes b) { return _mm256_blendv_ps(b, a, mask); }
+static inline int bits(Lanes mask) { return _mm256_movemask_ps(mask); }
+static inline IntLanes splatInt(int32_t v) { return _mm256_set1_epi32(v); }
+static inline IntLanes rampInt(int32_t s) { return _mm256_setr_epi32(0, s, 2 * s, 3 * s, 4 * s, 5 * s, 6 * s, 7 * s); }
+static inline IntLanes addInt(IntLanes a, IntLanes b) { return _mm256_add_epi32(a, b); }
+static inline Lanes notNegative(IntLanes a) { return _mm256_castsi256_ps(_mm256_cmpgt_epi32(a, _mm256_set1_epi32(-1))); }
+#elif defined(__SSE2__) || defined(_M_X64)
+static const int kLanes = 4;
+typedef __m128 Lanes;
+typedef __m128i IntLanes;
+static inline Lanes splat(float v) { return _mm_set1_ps(v); }
+static inline Lanes ramp() { return _mm_setr_ps(0.0f, 1.0f, 2.0f, 3.0f); }
+static inline Lanes add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+static inline Lanes mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+static inline Lanes load(const float *p) { return _mm_loadu_ps(p); }
+static inline void store(float *p, Lanes a) { _mm_storeu_ps(p, a); }
+static inline Lanes atLeast(Lanes a, Lanes b) { return _mm_cmpge_ps(a, b); }
+static inline Lanes above(Lanes a, Lanes b) { return _mm_cmpgt_ps(a, b); }
+static inline Lanes below(Lanes a, Lanes b) { return _mm_cmplt_ps(a, b); }
+static inline Lanes both(Lanes a, Lanes b) { return _mm_and_ps(a, b); }
+static inline Lanes select(Lanes mask, Lanes a, Lanes b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+static inline int bits(Lanes mask) { return _mm_movemask_ps(mask); }
+static inline IntLanes splatInt(int32_t v) { return _mm_set1_epi32(v); }
+static inline IntLanes rampInt(int32_t s) { return _mm_setr_epi32(0, s, 2 * s, 3 * s); }
+static inline IntLanes addInt(IntLanes a, IntLanes b) { return _mm_add_epi32(a, b); }
+static inline Lanes notNegative(IntLanes a) { return _mm_castsi128_ps(_mm_cmpgt_epi32(a, _mm_set1_epi32(-1))); }
+#else
+static const int kLanes = 1;
+typedef float Lanes;
+typedef int32_t IntLanes;
+static inline Lanes splat(float v) { return v; }
+static inline Lanes ramp() { return 0.0f; }
+static inline Lanes add(Lanes a, Lanes b) { return a + b; }
+static inline Lanes mul(Lanes a, Lanes b) { return a * b; }
+static inline Lanes load(const float *p) { return *p; }
+static inline void store(float *p, Lanes a) { *p = a; }
+static inline Lanes atLeast(Lanes a, Lanes b) { return a >= b ? 1.0f : 0.0f; }
+static inline Lanes above(Lanes a, Lanes b) { return a > b ? 1.0f : 0.0f; }
+static inline Lanes below(Lanes a, Lanes b) { return a < b ? 1.0f : 0.0f; }
+static inline Lanes both(Lanes a, Lanes b) { return a * b; }
+static inline Lanes select(Lanes mask, Lanes a, Lanes b) { return mask != 0.0f ? a : b; }
+static inline int bits(Lanes mask) { return mask != 0.0f ? 1 : 0; }
+static inline IntLanes splatInt(int32_t v) { return v; }
+static inline IntLanes rampInt(int32_t) { return 0; }
+static inline IntLanes addInt(IntLanes a, IntLanes b) { return a + b; }
+static inline Lanes notNegative(IntLanes a) { return a >= 0 ? 1.0f : 0.0f; }
+#endif
+
+/**
+ * How far inside a clipping plane a vertex is; negative if outside.
+ * @param q clip coordinates
+ * @param plane 0 for the near plane, then the guard band at -x, +x, -y, +y
+ */
+static inline double planeDistance(const double q[4], int plane) {
+    if (plane == 0) return q[2] + q[3];
+    double sign = (plane & 1) ? -1.0 : 1.0;
+    return kGuardBand * q[3] + sign * q[(plane - 1) / 2];
+}
+
+SoftRasterizer::SoftRasterizer() : pixels(0), step(0), width(0), height(0), tilesX(0), tilesY(0) {
+    fill(projection, projection + 16, 0.0);
+    projection[0] = projection[5] = projection[10] = projection[15] = 1.0;
+}
+
+void SoftRasterizer::begin(const Mat &background, Size size) {
+    // The background texture is sampled without filtering
+    if (background.size() == size) {
+        background.copyTo(frame);
+    } else {
+        resize(background, frame, size, 0.0, 0.0, INTER_NEAREST);
+    }
+    begin(frame.ptr(), frame.step, frame.cols, frame.rows);
+}
+
+void SoftRasterizer::begin(unsigned char *p, size_t s, int w, int h) {
+    pixels = p;
+    step = s;
+    width = w;
+    height = h;
+    tilesX = (w + kTileSize - 1) / kTileSize;
+    tilesY = (h + kTileSize - 1) / kTileSize;
+
+    // Depth rows are padded to whole tiles, so a tile's lanes never reach
+    // into another tile's pixels
+    depth.assign((size_t) tilesX * kTileSize * h + kLanes, 1.0f);
+    triangles.clear();
+    bins.resize(tilesX * tilesY);
+    for (size_t i = 0; i < bins.size(); i++) bins[i].clear();
+}
+
+Mat SoftRasterizer::depthImage() const {
+    return Mat(height, width, CV_32F, (void *) &depth[0], (size_t) tilesX * kTileSize * sizeof(float));
+}
+
+void SoftRasterizer::setProjection(const double p[16]) {
+    copy(p, p + 16, projection);
+}
+
+void SoftRasterizer::drawMesh(const Mesh &mesh, const double modelview[16]) {
+    if (mesh.indices.empty()) return;
+    drawTriangles(&mesh.positions[0], mesh.normals.empty() ? 0 : &mesh.normals[0], mesh.vertexCount(),
+                  &mesh.indices[0], mesh.indices.size(), modelview);
+}
+
+void SoftRasterizer::drawTriangles(const float *positions, const float *normals, size_t vertexCount,
+                                   const uint32_t *indices, size_t indexCount, const double m[16]) {
+    if (!pixels) return;
+
+    // Model to clip coordinates, in one matrix
+    double mvp[16];
+    for (int col = 0; col < 4; col++) {
+        for (int row = 0; row < 4; row++) {
+            double sum = 0.0;
+            for (int k = 0; k < 4; k++) sum += projection[k * 4 + row] * m[col * 4 + k];
+            mvp[col * 4 + row] = sum;
+        }
+    }
+
+    // Light each vertex, in eye coordinates.  The modelview matrices are
+    // rotations with a uniform scale, so they transform normals too, once
+    // the normals are normalized again.
+    static const float light[3] = { 0.57735f, 0.57735f, 0.57735f };
+    static const float halfway[3] = { 0.32505f, 0.32505f, 0.88807f };   // between the light and the viewer
+    vertices.resize(vertexCount);
+    for (size_t i = 0; i < vertexCount; i++) {
+        const float *p = &positions[3 * i];
+        ClipVertex &v = vertices[i];
+        for (int row = 0; row < 4; row++) {
+            v.clip[row] = mvp[row] * p[0] + mvp[4 + row] * p[1] + mvp[8 + row] * p[2] + mvp[12 + row];
+        }
+
+        float n[3] = { 0.0f, 0.0f, 1.0f };
+        if (normals) {
+            const float *o = &normals[3 * i];
+            for (int k = 0; k < 3; k++) n[k] = (float) (m[k] * o[0] + m[4 + k] * o[1] + m[8 + k] * o[2]);
+            float len = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+            if (len > 0.0f) {
+                for (int k = 0; k < 3; k++) n[k] /= len;
+            }
+        }
+        float diffuse = n[0] * light[0] + n[1] * light[1] + n[2] * light[2];
+        float specular = 0.0f;
+        if (diffuse > 0.0f) {
+            float h = n[0] * halfway[0] + n[1] * halfway[1] + n[2] * halfway[2];
+            if (h > 0.0f) specular = pow(h, kShininess);
+        } else {
+            diffuse = 0.0f;
+        }
+        for (int k = 0; k < 3; k++) {
+            v.color[k] = min(1.0f, kAmbient[k] + diffuse * kDiffuse[k] + specular * kSpecular[k]);
+        }
+    }
+
+    // Clip each triangle against the near plane and the guard band, and
+    // set up what is left
+    for (size_t t = 0; t + 2 < indexCount; t += 3) {
+        const ClipVertex &a = vertices[indices[t]], &b = vertices[indices[t + 1]], &c = vertices[indices[t + 2]];
+
+        // Inside every plane: the common case, with nothing to clip
+        int outside = 0;
+        bool allOutside = false;
+        for (int plane = 0; plane < 5; plane++) {
+            int count = 0;
+            const ClipVertex *tri[3] = { &a, &b, &c };
+            for (int k = 0; k < 3; k++) {
+                if (planeDistance(tri[k]->clip, plane) < 0.0) count++;
+            }
+            if (count == 3) allOutside = true;
+            if (count > 0) outside |= 1 << plane;
+        }
+        if (allOutside) continue;
+        if (!outside) {
+            setup(a, b, c);
+            continue;
+        }
+
+        polygon.clear();
+        polygon.push_back(a);
+        polygon.push_back(b);
+        polygon.push_back(c);
+        for (int plane = 0; plane < 5 && polygon.size() >= 3; plane++) {
+            if (!(outside & (1 << plane))) continue;
+            clipped.clear();
+            for (size_t k = 0; k < polygon.size(); k++) {
+                const ClipVertex &p = polygon[k], &q = polygon[(k + 1) % polygon.size()];
+                double dp = planeDistance(p.clip, plane), dq = planeDistance(q.clip, plane);
+                if (dp >= 0.0) clipped.push_back(p);
+                if ((dp >= 0.0) != (dq >= 0.0)) {
+                    double s = dp / (dp - dq);
+                    ClipVertex v;
+                    for (int j = 0; j < 4; j++) v.clip[j] = p.clip[j] + s * (q.clip[j] - p.clip[j]);
+                    for (int j = 0; j < 3; j++) v.color[j] = (float) (p.color[j] + s * (q.color[j] - p.color[j]));
+                    clipped.push_back(v);
+                }
+            }
+            polygon.swap(clipped);
+        }
+        for (size_t k = 2; k < polygon.size(); k++) setup(polygon[0], polygon[k - 1], polygon[k]);
+    }
+}
+
+void SoftRasterizer::setup(const ClipVertex &a, const ClipVertex &b, const ClipVertex &c) {
+    // Window coordinates, y down, in sixteenths of a pixel
+    const ClipVertex *in[3] = { &a, &b, &c };
+    int64_t x[3], y[3];
+    float z[3];
+    for (int k = 0; k < 3; k++) {
+        const double *q = in[k]->clip;
+        x[k] = (int64_t) floor(((q[0] / q[3]) * 0.5 + 0.5) * width * 16.0 + 0.5);
+        y[k] = (int64_t) floor((0.5 - (q[1] / q[3]) * 0.5) * height * 16.0 + 0.5);
+        z[k] = (float) ((q[2] / q[3]) * 0.5 + 0.5);
+    }
+
+    // Wind the triangle so that the edge functions are positive inside
+    int64_t area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+    if (area == 0) return;
+    int order[3] = { 0, 1, 2 };
+    if (area < 0) {
+        swap(order[1], order[2]);
+        area = -area;
+    }
+
+    Triangle tri;
+    int64_t minX = x[0], minY = y[0], maxX = x[0], maxY = y[0];
+    float attrs[4][3];
+    for (int i = 0; i < 3; i++) {
+        // The edge opposite vertex i; a pixel center exactly on an edge
+        // belongs to just one of the two triangles sharing it (the top-left
+        // rule), so the others are moved off it by one
+        int from = order[(i + 1) % 3], to = order[(i + 2) % 3];
+        int64_t edgeX = y[from] - y[to], edgeY = x[to] - x[from];
+        tri.edgeX[i] = (int32_t) edgeX;
+        tri.edgeY[i] = (int32_t) edgeY;
+        tri.edge0[i] = -(edgeX * x[from] + edgeY * y[from]);
+        if (!(edgeX > 0 || (edgeX == 0 && edgeY > 0))) tri.edge0[i]--;
+
+        const ClipVertex &v = *in[order[i]];
+        attrs[0][i] = z[order[i]];
+        for (int k = 0; k < 3; k++) attrs[1 + k][i] = v.color[k];
+        minX = min(minX, x[i]);
+        minY = min(minY, y[i]);
+        maxX = max(maxX, x[i]);
+        maxY = max(maxY, y[i]);
+    }
+
+    // Depth and color as planes through the first vertex, per pixel
+    double x0 = x[order[0]] / 16.0, y0 = y[order[0]] / 16.0;
+    double dx1 = x[order[1]] / 16.0 - x0, dy1 = y[order[1]] / 16.0 - y0;
+    double dx2 = x[order[2]] / 16.0 - x0, dy2 = y[order[2]] / 16.0 - y0;
+    double pixelArea = area / 256.0;
+    tri.x0 = x0;
+    tri.y0 = y0;
+    tri.flat = true;
+    for (int k = 0; k < 4; k++) {
+        double d1 = attrs[k][1] - attrs[k][0], d2 = attrs[k][2] - attrs[k][0];
+        tri.attr0[k] = attrs[k][0];
+        tri.attrX[k] = (float) ((d1 * dy2 - d2 * dy1) / pixelArea);
+        tri.attrY[k] = (float) ((d2 * dx1 - d1 * dx2) / pixelArea);
+        if (k > 0 && (d1 != 0.0 || d2 != 0.0)) tri.flat = false;
+    }
+
+    // The pixels whose centers may be inside
+    tri.minX = max(0, (int) ceil((minX - 8) / 16.0));
+    tri.minY = max(0, (int) ceil((minY - 8) / 16.0));
+    tri.maxX = min(width - 1, (int) floor((maxX - 8) / 16.0));
+    tri.maxY = min(height - 1, (int) floor((maxY - 8) / 16.0));
+    if (tri.minX > tri.maxX || tri.minY > tri.maxY) return;
+
+    uint32_t index = (uint32_t) triangles.size();
+    triangles.push_back(tri);
+    for (int ty = tri.minY / kTileSize; ty <= tri.maxY / kTileSize; ty++) {
+        for (int tx = tri.minX / kTileSize; tx <= tri.maxX / kTileSize; tx++) bins[ty * tilesX + tx].push_back(index);
+    }
+}
+
+void SoftRasterizer::rasterizeTile(int tile) {
+    const vector<uint32_t> &bin = bins[tile];
+    if (bin.empty()) return;
+    int tileX = (tile % tilesX) * kTileSize, tileY = (tile / tilesX) * kTileSize;
+    size_t depthStep = (size_t) tilesX * kTileSize;
+    const Lanes offsets = ramp();
+
+    float lanes[4][kLanes];
+
+    for (size_t b = 0; b < bin.size(); b++) {
+        const Triangle &tri = triangles[bin[b]];
+        int x0 = max(tri.minX, tileX), x1 = min(tri.maxX, tileX + kTileSize - 1);
+        int y0 = max(tri.minY, tileY), y1 = min(tri.maxY, tileY + kTileSize - 1);
+        if (x0 > x1 || y0 > y1) continue;
+
+        // Chunks start at multiples of the lane count from the tile's
+        // left, so they stay inside the tile
+        int start = tileX + (x0 - tileX) / kLanes * kLanes;
+        Lanes first = splat((float) x0), last = splat((float) x1);
+        IntLanes edgeX[3];
+        Lanes attrX[4];
+        for (int i = 0; i < 3; i++) edgeX[i] = rampInt(tri.edgeX[i] * 16);
+        for (int k = 0; k < 4; k++) attrX[k] = mul(splat(tri.attrX[k]), offsets);
+
+        for (int y = y0; y <= y1; y++) {
+            float *depthRow = &depth[y * depthStep];
+            unsigned char *row = pixels + y * step;
+
+            // The edge functions at the first chunk's first pixel center,
+            // exactly, and the change from one chunk to the next
+            int64_t edge[3];
+            for (int i = 0; i < 3; i++) {
+                edge[i] = tri.edge0[i] + (int64_t) tri.edgeX[i] * (16 * start + 8) + (int64_t) tri.edgeY[i] * (16 * y + 8);
+            }
+            double cy = y + 0.5 - tri.y0;
+            for (int x = start; x <= x1; x += kLanes) {
+                // The edge functions at each lane's pixel center
+                Lanes inside = atLeast(add(splat((float) x), offsets), first);
+                inside = both(inside, atLeast(last, add(splat((float) x), offsets)));
+                for (int i = 0; i < 3; i++) {
+                    int32_t e = (int32_t) max(-kEdgeLimit, min(kEdgeLimit, edge[i]));
+                    inside = both(inside, notNegative(addInt(splatInt(e), edgeX[i])));
+                    edge[i] += (int64_t) tri.edgeX[i] * 16 * kLanes;
+                }
+                if (!bits(inside)) continue;
+
+                // The depth test
+                double cx = x + 0.5 - tri.x0;
+                Lanes z = add(splat((float) (tri.attr0[0] + tri.attrX[0] * cx + tri.attrY[0] * cy)), attrX[0]);
+                Lanes stored = load(depthRow + x);
+                Lanes pass = both(inside, below(z, stored));
+                int mask = bits(pass);
+                if (!mask) continue;
+                store(depthRow + x, select(pass, z, stored));
+
+                // The colors of the pixels that passed
+                for (int k = 1; k < 4; k++) {
+                    Lanes c = tri.flat ? splat(tri.attr0[k])
+                            : add(splat((float) (tri.attr0[k] + tri.attrX[k] * cx + tri.attrY[k] * cy)), attrX[k]);
+                    store(lanes[k], c);
+                }
+                for (int i = 0; i < kLanes; i++) {
+                    if (!(mask & (1 << i))) continue;
+                    unsigned char *p = row + 3 * (x + i);
+                    for (int k = 0; k < 3; k++) p[k] = (unsigned char) (min(1.0f, max(0.0f, lanes[1 + k][i])) * 255.0f + 0.5f);
+                }
+            }
+        }
+    }
+}
+
+/**
+ * Rasterizes a range of tiles; tiles do not share pixels, so any number
+ * can be rasterized at once.
+ */
+class TileRasterizer : public ParallelLoopBody {
+public:
+    TileRasterizer(SoftRasterizer &r) : r(r) {}
+
+    void operator()(const Range &range) const {
+        for (int i = range.start; i < range.end; i++) r.rasterizeTile(i);
+    }
+
+private:
+    SoftRasterizer &r;
+};
+
+void SoftRasterizer::finish() {
+    if (!pixels || triangles.empty()) return;
+    parallel_for_(Range(0, tilesX * tilesY), TileRasterizer(*this));
+}
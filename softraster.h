@@ -0,0 +1,132 @@
+/*
+ * Software rendering for OpenCV with OpenGL
+ *
+ * A CPU rasterizer for the one scene the program draws: an image filling
+ * the frame, with small lit triangle meshes on top of it.  It is for when
+ * there is no OpenGL at all, and for batch jobs, where a rasterizer that
+ * does only this beats a general software OpenGL driver.
+ *
+ * The background is copied (or scaled) straight into the frame.  Meshes
+ * are transformed and lit per vertex on the CPU, with the same fixed-
+ * function lighting as the window, clipped, and sorted into tiles of 64 x
+ * 64 pixels.  finish() then rasterizes the tiles in parallel, each with
+ * its triangles in the order they were drawn, testing several pixels at
+ * once against the edge functions and the depth buffer with SIMD
+ * instructions (8 pixels with AVX2, 4 with SSE2; the compiler must be told
+ * to use AVX2, e.g. with OCVGL_NATIVE_ARCH).  Vertices are snapped to 1/16
+ * of a pixel and the edge functions are integers, so a pixel on an edge
+ * shared by two triangles is drawn by exactly one of them.  Colors are interpolated
+ * linearly in screen space, which, for meshes this small on screen, is
+ * indistinguishable from OpenGL's perspective-correct interpolation.
+ */
+
+#ifndef SOFTRASTER_H
+#define SOFTRASTER_H
+
+#include <opencv2/core/core.hpp>
+#include <stdint.h>
+#include <vector>
+#include "mesh.h"
+
+class SoftRasterizer {
+public:
+    SoftRasterizer();
+
+    /**
+     * Start a frame with a background image, scaled to the frame size.
+     * @param background the image, BGR
+     * @param size the size of the frame
+     */
+    void begin(const cv::Mat &background, cv::Size size);
+
+    /**
+     * Start a frame in a buffer the caller owns, which already holds the
+     * background.
+     * @param pixels the first row of the frame, BGR
+     * @param step the bytes from one row to the next
+     * @param width the width of the frame
+     * @param height the height of the frame
+     */
+    void begin(unsigned char *pixels, size_t step, int width, int height);
+
+    /**
+     * Set the projection, for the meshes drawn after.
+     * @param projection the matrix, column-major as in OpenGL
+     */
+    void setProjection(const double projection[16]);
+
+    /**
+     * Transform, light and clip triangles, and queue them for finish().
+     * @param positions x, y, z per vertex
+     * @param normals x, y, z per vertex
+     * @param vertexCount the number of vertices
+     * @param indices 3 per triangle
+     * @param indexCount the number of indices
+     * @param modelview the modelview matrix, column-major as in OpenGL
+     */
+    void drawTriangles(const float *positions, const float *normals, size_t vertexCount,
+                       const uint32_t *indices, size_t indexCount, const double modelview[16]);
+
+    /**
+     * Draw a whole mesh; see drawTriangles().
+     */
+    void drawMesh(const Mesh &mesh, const double modelview[16]);
+
+    /**
+     * Rasterize the triangles queued since begin(), using all cores.
+     */
+    void finish();
+
+    /**
+     * @return the frame, when started by begin() with a background image
+     */
+    const cv::Mat &image() const { return frame; }
+
+    /**
+     * @return the depth of each pixel, from 0 at the near plane to 1 where
+     *         nothing was drawn; shares the rasterizer's memory until the
+     *         next begin()
+     */
+    cv::Mat depthImage() const;
+
+private:
+    /**
+     * A triangle set up for rasterizing, in window coordinates (pixels,
+     * y down), with its edges and attributes as planes.
+     */
+    struct Triangle {
+        int32_t edgeX[3], edgeY[3]; // the change in each edge function per 1/16 pixel
+        int64_t edge0[3];           // each edge function at (0, 0); one less if it excludes pixels on the edge
+        double x0, y0;              // the first vertex, which the attribute planes are relative to
+        float attr0[4];             // depth, blue, green, red at the first vertex
+        float attrX[4], attrY[4];   // their change per pixel
+        bool flat;                  // the same color at every vertex
+        int minX, minY, maxX, maxY; // bounds, in pixels, inclusive
+    };
+
+    struct ClipVertex {
+        double clip[4];             // clip coordinates
+        float color[3];             // blue, green, red
+    };
+
+    void setup(const ClipVertex &a, const ClipVertex &b, const ClipVertex &c);
+    void rasterizeTile(int tile);
+
+    cv::Mat frame;
+    unsigned char *pixels;
+    size_t step;
+    int width, height, tilesX, tilesY;
+    std::vector<float> depth;
+    double projection[16];
+
+    std::vector<Triangle> triangles;
+    std::vector<std::vector<uint32_t> > bins;   // the triangles touching each tile, in order
+
+    // Scratch storage, reused between meshes
+    std::vector<ClipVertex> vertices;
+    std::vector<ClipVertex> polygon, clipped;
+
+    friend class TileRasterizer;
+};
+
+#endif // SOFTRASTER_H
@@ -0,0 +1,114 @@
+/*
+ * Overlay sprites for OpenCV with OpenGL
+ * See sprite.h for an overview.
+ */
+
+#include "sprite.h"
+#include <algorithm>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+using namespace cv;
+using namespace std;
+
+/**
+ * Blend premultiplied colors over a background: out = color + background
+ * * transparency / 255, rounded, on each byte.
+ * @param color the premultiplied colors
+ * @param transparency 255 minus the opacity of each byte
+ * @param background the background, overwritten with the result
+ * @param n the number of bytes
+ */
+static void blendRow(const uchar *color, const uchar *transparency, uchar *background, int n) {
+    int i = 0;
+#if defined(__AVX2__)
+    const __m256i zero = _mm256_setzero_si256(), half = _mm256_set1_epi16(128);
+    for (; i + 32 <= n; i += 32) {
+        __m256i b = _mm256_loadu_si256((const __m256i *) (background + i));
+        __m256i t = _mm256_loadu_si256((const __m256i *) (transparency + i));
+        __m256i lo = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpacklo_epi8(b, zero), _mm256_unpacklo_epi8(t, zero)), half);
+        __m256i hi = _mm256_add_epi16(_mm256_mullo_epi16(_mm256_unpackhi_epi8(b, zero), _mm256_unpackhi_epi8(t, zero)), half);
+        lo = _mm256_srli_epi16(_mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+        hi = _mm256_srli_epi16(_mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+        __m256i c = _mm256_loadu_si256((const __m256i *) (color + i));
+        _mm256_storeu_si256((__m256i *) (background + i), _mm256_adds_epu8(_mm256_packus_epi16(lo, hi), c));
+    }
+#elif defined(__SSE2__) || defined(_M_X64)
+    const __m128i zero = _mm_setzero_si128(), half = _mm_set1_epi16(128);
+    for (; i + 16 <= n; i += 16) {
+        __m128i b = _mm_loadu_si128((const __m128i *) (background + i));
+        __m128i t = _mm_loadu_si128((const __m128i *) (transparency + i));
+        __m128i lo = _mm_add_epi16(_mm_mullo_epi16(_mm_unpacklo_epi8(b, zero), _mm_unpacklo_epi8(t, zero)), half);
+        __m128i hi = _mm_add_epi16(_mm_mullo_epi16(_mm_unpackhi_epi8(b, zero), _mm_unpackhi_epi8(t, zero)), half);
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+        __m128i c = _mm_loadu_si128((const __m128i *) (color + i));
+        _mm_storeu_si128((__m128i *) (background + i), _mm_adds_epu8(_mm_packus_epi16(lo, hi), c));
+    }
+#endif
+    // The rest, one byte at a time; x / 255, rounded, is (x + 128 + ((x + 128) >> 8)) >> 8
+    for (; i < n; i++) {
+        int x = background[i] * transparency[i] + 128;
+        background[i] = saturate_cast<uchar>(color[i] + ((x + (x >> 8)) >> 8));
+    }
+}
+
+OverlaySprite::OverlaySprite(const Mat &color, const Mat &depth) : imageSize(color.size()) {
+    CV_Assert(color.type() == CV_8UC3 && depth.type() == CV_32F && depth.size() == color.size());
+
+    // The rectangle around the pixels that were drawn
+    int minX = color.cols, minY = color.rows, maxX = -1, maxY = -1;
+    for (int y = 0; y < depth.rows; y++) {
+        const float *d = depth.ptr<float>(y);
+        for (int x = 0; x < depth.cols; x++) {
+            if (d[x] >= 1.0f) continue;
+            minX = min(minX, x);
+            maxX = max(maxX, x);
+            minY = min(minY, y);
+            maxY = y;
+        }
+    }
+    if (maxX < 0) return;
+    rect = Rect(minX, minY, maxX - minX + 1, maxY - minY + 1);
+
+    premultiplied.create(rect.size(), CV_8UC3);
+    transparency.create(rect.size(), CV_8UC3);
+    for (int y = 0; y < rect.height; y++) {
+        const float *d = depth.ptr<float>(rect.y + y) + rect.x;
+        const uchar *c = color.ptr(rect.y + y) + 3 * rect.x;
+        uchar *p = premultiplied.ptr(y), *t = transparency.ptr(y);
+        for (int x = 0; x < rect.width; x++) {
+            bool opaque = d[x] < 1.0f;
+            for (int k = 0; k < 3; k++) {
+                p[3 * x + k] = opaque ? c[3 * x + k] : 0;
+                t[3 * x + k] = opaque ? 0 : 255;
+            }
+        }
+    }
+}
+
+void OverlaySprite::drawOn(Mat &image) const {
+    CV_Assert(image.type() == CV_8UC3 && image.size() == imageSize);
+    for (int y = 0; y < rect.height; y++) {
+        blendRow(premultiplied.ptr(y), transparency.ptr(y), image.ptr(rect.y + y) + 3 * rect.x, 3 * rect.width);
+    }
+}
+
+Ptr<const OverlaySprite> SpriteCache::find(const string &key) {
+    lock_guard<mutex> guard(lock);
+    map<string, Ptr<const OverlaySprite> >::const_iterator it = sprites.find(key);
+    return it != sprites.end() ? it->second : Ptr<const OverlaySprite>();
+}
+
+void SpriteCache::insert(const string &key, const Ptr<const OverlaySprite> &sprite) {
+    lock_guard<mutex> guard(lock);
+    if (sprites.count(key)) return;
+    if (sprites.size() >= capacity && !order.empty()) {
+        sprites.erase(order.front());
+        order.pop_front();
+    }
+    sprites[key] = sprite;
+    order.push_back(key);
+}
@@ -0,0 +1,89 @@
+/*
+ * Overlay sprites for OpenCV with OpenGL
+ *
+ * When the objects are drawn at the same pose on every image, as in a
+ * batch job with a fixed pose, rendering them once is enough: the overlay
+ * is rendered over nothing, kept as a sprite, and blended onto each
+ * background.  Compositing an image is then a pass over the memory the
+ * overlay covers, and no 3D rendering at all.
+ *
+ * A sprite keeps only the rectangle around the overlay, with its colors
+ * premultiplied by its opacity, and the transparency repeated for each of
+ * the three channels, so blending is the same arithmetic on every byte:
+ * 32 of them at a time with AVX2, 16 with SSE2.
+ */
+
+#ifndef SPRITE_H
+#define SPRITE_H
+
+#include <opencv2/core/core.hpp>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+
+class OverlaySprite {
+public:
+    /**
+     * Make a sprite from an overlay rendered over nothing.  The pixels
+     * that were drawn, whose depth is less than 1, are opaque; the others
+     * are transparent.
+     * @param color the rendered overlay, BGR
+     * @param depth the depth of each pixel, CV_32F, 1 where nothing was drawn
+     */
+    OverlaySprite(const cv::Mat &color, const cv::Mat &depth);
+
+    /**
+     * Blend the overlay onto an image of the size it was rendered at.
+     * @param image the background, BGR, overwritten
+     */
+    void drawOn(cv::Mat &image) const;
+
+    /**
+     * @return the size of the image the overlay was rendered at
+     */
+    cv::Size size() const { return imageSize; }
+
+    /**
+     * @return the rectangle around the overlay, empty if nothing was drawn
+     */
+    cv::Rect bounds() const { return rect; }
+
+private:
+    cv::Size imageSize;
+    cv::Rect rect;
+    cv::Mat premultiplied;      // the colors times the opacity, within the rectangle
+    cv::Mat transparency;       // 255 minus the opacity, per channel, within the rectangle
+};
+
+/**
+ * The sprites of the last few poses, shared by several threads.
+ */
+class SpriteCache {
+public:
+    /**
+     * @param capacity the most sprites to keep; the oldest are dropped first
+     */
+    SpriteCache(size_t capacity = 16) : capacity(capacity) {}
+
+    /**
+     * @param key the pose, projection and size the sprite was rendered with
+     * @return the sprite, or an empty pointer if there is none
+     */
+    cv::Ptr<const OverlaySprite> find(const std::string &key);
+
+    /**
+     * Keep a sprite, unless another thread rendered the same one first.
+     * @param key the pose, projection and size the sprite was rendered with
+     * @param sprite the sprite
+     */
+    void insert(const std::string &key, const cv::Ptr<const OverlaySprite> &sprite);
+
+private:
+    size_t capacity;
+    std::map<std::string, cv::Ptr<const OverlaySprite> > sprites;
+    std::deque<std::string> order;      // the keys, oldest first
+    std::mutex lock;
+};
+
+#endif // SPRITE_H
@@ -0,0 +1,48 @@
+/*
+ * Synthetic video for OpenCV with OpenGL
+ * See synthetic.h for an overview.
+ */
+
+#include "synthetic.h"
+#include <opencv2/imgproc/imgproc.hpp>
+#include <algorithm>
+#include <cmath>
+using namespace cv;
+using namespace std;
+
+SyntheticVideo::SyntheticVideo(const Mat &background, int markerId, int dictionary)
+    : background(background), index(0) {
+    // Draw the marker with a white border, which the detector needs
+    Mat code;
+    aruco::drawMarker(aruco::getPredefinedDictionary(aruco::PREDEFINED_DICTIONARY_NAME(dictionary)),
+                      markerId, 120, code);
+    Mat bordered(160, 160, CV_8UC1, Scalar(255));
+    code.copyTo(bordered(Rect(20, 20, 120, 120)));
+    cvtColor(bordered, marker, COLOR_GRAY2BGR);
+}
+
+bool SyntheticVideo::read(Mat &frame) {
+    background.copyTo(frame);
+
+    // Move along a Lissajous curve, spinning slowly and tilting back and
+    // forth (by foreshortening one side), with a period of 600 frames
+    double t = 2.0 * CV_PI * (index++ % 600) / 600.0;
+    double w = background.cols, h = background.rows;
+    double size = min(w, h) * 0.3;
+    Point2f center((float) (w * (0.5 + 0.3 * sin(t))), (float) (h * (0.5 + 0.3 * sin(2.0 * t))));
+    double angle = t;
+    double tilt = 0.25 * sin(3.0 * t);
+
+    Point2f src[4] = { Point2f(0, 0), Point2f(160, 0), Point2f(160, 160), Point2f(0, 160) };
+    Point2f dst[4];
+    for (int i = 0; i < 4; i++) {
+        double x = (src[i].x / 160.0 - 0.5) * size;
+        double y = (src[i].y / 160.0 - 0.5) * size;
+        x *= 1.0 + (y > 0 ? tilt : -tilt);
+        dst[i] = Point2f((float) (center.x + x * cos(angle) - y * sin(angle)),
+                         (float) (center.y + x * sin(angle) + y * cos(angle)));
+    }
+    Mat warp = getPerspectiveTransform(src, dst);
+    warpPerspective(marker, frame, warp, frame.size(), INTER_LINEAR, BORDER_TRANSPARENT);
+    return true;
+}
@@ -0,0 +1,47 @@
+/*
+ * Synthetic video for OpenCV with OpenGL
+ *
+ * Generates frames of a marker moving over a background image, so the
+ * whole pipeline (detection, tracking, pose filtering and rendering) can
+ * be exercised repeatably without a camera or a recorded video.
+ */
+
+#ifndef SYNTHETIC_H
+#define SYNTHETIC_H
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/aruco.hpp>
+
+class SyntheticVideo {
+public:
+    /**
+     * @param background the image the marker moves over (BGR)
+     * @param markerId the marker to draw
+     * @param dictionary the ArUco dictionary of the marker
+     */
+    SyntheticVideo(const cv::Mat &background, int markerId = 0, int dictionary = cv::aruco::DICT_4X4_50);
+
+    /**
+     * Generate the next frame.  The marker follows a closed path that
+     * repeats every few hundred frames, turning and tilting as it goes.
+     * @param frame receives the frame, the same size as the background
+     * @return true (there is always another frame)
+     */
+    bool read(cv::Mat &frame);
+
+    /**
+     * Start again from the first frame.
+     */
+    void rewind() { index = 0; }
+
+    /**
+     * @return the number of frames generated since the last rewind
+     */
+    int position() const { return index; }
+
+private:
+    cv::Mat background, marker;
+    int index;
+};
+
+#endif // SYNTHETIC_H
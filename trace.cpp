@@ -0,0 +1,263 @@
+/*
+ * Frame tracing for OpenCV with OpenGL
+ * See trace.h for an overview.
+ *
+ * The file holds, in the machine's byte order:
+ * - "OCVGLTR1"
+ * - the ticks per second (double)
+ * - the stage names: a count, then each as a length and the characters
+ * - the thread names: a count, then each as the thread's number, a
+ *   length and the characters
+ * - the records: a count (64 bits), then the TraceRecords as they are
+ */
+
+#include "trace.h"
+#include <opencv2/core/core.hpp>
+#include <csignal>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <mutex>
+#include <utility>
+using namespace std;
+
+static const size_t kRecords = 1 << 16;     // about three minutes of frames at 60 fps
+static const char kMagic[8] = { 'O', 'C', 'V', 'G', 'L', 'T', 'R', '1' };
+
+static const char *stageNames[TRACE_STAGES] = {
+    "frame", "read", "detect", "upload", "render", "finish", "decode", "encode"
+};
+
+// Threads are numbered as they first record, and may be named
+static atomic<int> threadCount(0);
+static thread_local int threadNumber = -1;
+static mutex namesLock;
+static vector<pair<int, string> > threadNames;
+
+// Raised by the signal handler
+static volatile sig_atomic_t dumpRequested = 0;
+
+/**
+ * @return the number of the calling thread
+ */
+static int currentThread() {
+    if (threadNumber < 0) threadNumber = threadCount++;
+    return threadNumber;
+}
+
+FrameTrace &FrameTrace::instance() {
+    // Never destroyed, so that threads still running during exit can record
+    static FrameTrace *trace = new FrameTrace();
+    return *trace;
+}
+
+int64_t FrameTrace::ticks() {
+    return cv::getTickCount();
+}
+
+FrameTrace::FrameTrace() : slots(kRecords), head(0) {
+    for (size_t i = 0; i < slots.size(); i++) slots[i].sequence.store(0, memory_order_relaxed);
+}
+
+void FrameTrace::record(int stage, long frame, int64_t start, int64_t end) {
+    uint64_t index = head.fetch_add(1, memory_order_relaxed);
+    Slot &slot = slots[index & (slots.size() - 1)];
+
+    // Mark the slot incomplete while it is written, so a dump skips it
+    slot.sequence.store(0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    slot.record.frame = (uint32_t) frame;
+    slot.record.stage = (uint16_t) stage;
+    slot.record.thread = (uint16_t) currentThread();
+    slot.record.start = start;
+    slot.record.end = end;
+    slot.sequence.store(index + 1, memory_order_release);
+}
+
+void FrameTrace::nameThread(const string &name) {
+    int number = currentThread();
+    lock_guard<mutex> guard(namesLock);
+    for (size_t i = 0; i < threadNames.size(); i++) {
+        if (threadNames[i].first == number) {
+            threadNames[i].second = name;
+            return;
+        }
+    }
+    threadNames.push_back(make_pair(number, name));
+}
+
+static void writeString(ofstream &out, const string &text) {
+    uint32_t length = (uint32_t) text.size();
+    out.write((const char *) &length, sizeof(length));
+    out.write(text.data(), length);
+}
+
+bool FrameTrace::dump(const string &file) const {
+    // Copy the complete records, oldest first
+    uint64_t end = head.load(memory_order_acquire);
+    uint64_t begin = end > slots.size() ? end - slots.size() : 0;
+    vector<TraceRecord> records;
+    records.reserve((size_t) (end - begin));
+    for (uint64_t i = begin; i < end; i++) {
+        const Slot &slot = slots[i & (slots.size() - 1)];
+        uint64_t before = slot.sequence.load(memory_order_acquire);
+        TraceRecord record = slot.record;
+        atomic_thread_fence(memory_order_acquire);
+        if (before == i + 1 && slot.sequence.load(memory_order_relaxed) == before) records.push_back(record);
+    }
+    vector<pair<int, string> > names;
+    {
+        lock_guard<mutex> guard(namesLock);
+        names = threadNames;
+    }
+
+    ofstream out(file.c_str(), ios::binary);
+    if (!out) return false;
+    out.write(kMagic, sizeof(kMagic));
+    double frequency = cv::getTickFrequency();
+    out.write((const char *) &frequency, sizeof(frequency));
+    uint32_t count = TRACE_STAGES;
+    out.write((const char *) &count, sizeof(count));
+    for (int i = 0; i < TRACE_STAGES; i++) writeString(out, stageNames[i]);
+    count = (uint32_t) names.size();
+    out.write((const char *) &count, sizeof(count));
+    for (size_t i = 0; i < names.size(); i++) {
+        uint32_t number = (uint32_t) names[i].first;
+        out.write((const char *) &number, sizeof(number));
+        writeString(out, names[i].second);
+    }
+    uint64_t recordCount = records.size();
+    out.write((const char *) &recordCount, sizeof(recordCount));
+    if (!records.empty()) out.write((const char *) &records[0], records.size() * sizeof(TraceRecord));
+    return (bool) out;
+}
+
+static void requestDump(int) {
+    dumpRequested = 1;
+}
+
+void FrameTrace::dumpOnSignal() {
+#ifdef SIGUSR1
+    signal(SIGUSR1, requestDump);
+#endif
+}
+
+bool FrameTrace::takeDumpRequest() {
+    if (!dumpRequested) return false;
+    dumpRequested = 0;
+    return true;
+}
+
+static bool readString(ifstream &in, string &text) {
+    uint32_t length;
+    if (!in.read((char *) &length, sizeof(length)) || length > 4096) return false;
+    text.resize(length);
+    return length == 0 || in.read(&text[0], length);
+}
+
+/**
+ * @return text as a JSON string, quoted
+ */
+static string quote(const string &text) {
+    string quoted = "\"";
+    for (size_t i = 0; i < text.size(); i++) {
+        char c = text[i];
+        if (c == '"' || c == '\\') {
+            quoted += '\\';
+            quoted += c;
+        } else if ((unsigned char) c < 0x20) {
+            quoted += ' ';
+        } else {
+            quoted += c;
+        }
+    }
+    return quoted + "\"";
+}
+
+int traceCommand(int argc, char *argv[]) {
+    string input, output;
+    for (int i = 0; i < argc; i++) {
+        string arg = argv[i];
+        if (arg == "--output" && i + 1 < argc) {
+            output = argv[++i];
+        } else if (arg[0] != '-' && input.empty()) {
+            input = arg;
+        }
+    }
+    if (input.empty()) {
+        cout << "Usage: OpenCVWithOpenGL trace FILE [options]" << endl;
+        cout << "Converts a trace file to the Chrome trace event format, for ui.perfetto.dev or chrome://tracing" << endl;
+        cout << "Options:" << endl;
+        cout << "  --output FILE         where to write the JSON (default FILE with extension .json)" << endl;
+        return -1;
+    }
+    if (output.empty()) {
+        size_t dot = input.rfind('.');
+        output = (dot == string::npos ? input : input.substr(0, dot)) + ".json";
+    }
+
+    // Read the header, the names and the records
+    ifstream in(input.c_str(), ios::binary);
+    char magic[sizeof(kMagic)];
+    double frequency;
+    uint32_t stageCount, nameCount;
+    vector<string> stages;
+    vector<pair<uint32_t, string> > threads;
+    vector<TraceRecord> records;
+    bool ok = in.read(magic, sizeof(magic)) && memcmp(magic, kMagic, sizeof(kMagic)) == 0
+              && in.read((char *) &frequency, sizeof(frequency)) && frequency > 0.0
+              && in.read((char *) &stageCount, sizeof(stageCount)) && stageCount <= 256;
+    for (uint32_t i = 0; ok && i < stageCount; i++) {
+        stages.push_back(string());
+        ok = readString(in, stages.back());
+    }
+    ok = ok && in.read((char *) &nameCount, sizeof(nameCount)) && nameCount <= 65536;
+    for (uint32_t i = 0; ok && i < nameCount; i++) {
+        threads.push_back(make_pair(0u, string()));
+        ok = in.read((char *) &threads.back().first, sizeof(uint32_t)) && readString(in, threads.back().second);
+    }
+    uint64_t recordCount;
+    ok = ok && in.read((char *) &recordCount, sizeof(recordCount)) && recordCount <= (1u << 30);
+    if (ok) {
+        records.resize((size_t) recordCount);
+        ok = recordCount == 0 || in.read((char *) &records[0], records.size() * sizeof(TraceRecord));
+    }
+    if (!ok) {
+        cout << "Not a trace file, or truncated: " << input << endl;
+        return -1;
+    }
+
+    // One complete event per record, in microseconds from the first
+    int64_t origin = 0;
+    for (size_t i = 0; i < records.size(); i++) {
+        if (i == 0 || records[i].start < origin) origin = records[i].start;
+    }
+    ofstream out(output.c_str());
+    if (!out) {
+        cout << "Unable to write " << output << endl;
+        return -1;
+    }
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[" << endl;
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"args\":{\"name\":\"OpenCVWithOpenGL\"}}";
+    for (size_t i = 0; i < threads.size(); i++) {
+        out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << threads[i].first
+            << ",\"args\":{\"name\":" << quote(threads[i].second) << "}}";
+    }
+    char times[64];
+    for (size_t i = 0; i < records.size(); i++) {
+        const TraceRecord &r = records[i];
+        string name = r.stage < stages.size() ? stages[r.stage] : "stage " + to_string(r.stage);
+        snprintf(times, sizeof(times), "\"ts\":%.3f,\"dur\":%.3f",
+                 (r.start - origin) * 1e6 / frequency, (r.end - r.start) * 1e6 / frequency);
+        out << ",\n{\"name\":" << quote(name) << ",\"ph\":\"X\",\"pid\":1,\"tid\":" << r.thread
+            << "," << times << ",\"args\":{\"frame\":" << r.frame << "}}";
+    }
+    out << "\n]}" << endl;
+    if (!out) {
+        cout << "Unable to write " << output << endl;
+        return -1;
+    }
+    cout << "Wrote " << records.size() << " events to " << output << endl;
+    return 0;
+}
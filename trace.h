@@ -0,0 +1,135 @@
+/*
+ * Frame tracing for OpenCV with OpenGL
+ *
+ * When a frame hitches in the field, the metrics say that it happened,
+ * but not where the time went.  FrameTrace keeps a record of every stage
+ * of every frame (which frame, which stage, on which thread, when it
+ * started and ended), always on, in a fixed ring of fixed-size records:
+ * recording one is a clock read and an atomic increment, with no lock and
+ * no allocation, so it costs far less than a microsecond against frames of
+ * milliseconds.  The ring holds the last few minutes; when something goes
+ * wrong (a slow frame, or a signal from whoever is investigating) it is
+ * written to a compact binary file, which the trace subcommand converts to
+ * the Chrome trace event format that Perfetto (ui.perfetto.dev) and
+ * chrome://tracing show as a timeline.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+enum TraceStage {
+    TRACE_FRAME,            // the whole frame, on the render thread
+    TRACE_READ,             // reading (or waiting for) the video frame
+    TRACE_DETECT,           // finding the markers
+    TRACE_UPLOAD,           // replacing the background texture
+    TRACE_RENDER,           // drawing
+    TRACE_FINISH,           // recording, flushing and waiting for the GPU
+    TRACE_DECODE,           // decoding an image of a sequence, on a decoder thread
+    TRACE_ENCODE,           // encoding a recorded frame, on the encoder thread
+    TRACE_STAGES
+};
+
+/**
+ * One stage of one frame, as stored in the ring and in the file.
+ */
+struct TraceRecord {
+    uint32_t frame;         // the rendered frame; for decode and encode, that thread's own count
+    uint16_t stage;         // a TraceStage
+    uint16_t thread;        // the thread, numbered in the order threads first record
+    int64_t start, end;     // cv::getTickCount() ticks
+};
+
+class FrameTrace {
+public:
+    /**
+     * @return the trace every thread records to, created on first use
+     */
+    static FrameTrace &instance();
+
+    /**
+     * @return the current time, in the ticks records use
+     */
+    static int64_t ticks();
+
+    /**
+     * Record a stage.  Safe to call from any thread.
+     * @param stage a TraceStage
+     * @param frame the frame number
+     * @param start when the stage started, from ticks()
+     * @param end when it ended
+     */
+    void record(int stage, long frame, int64_t start, int64_t end);
+
+    /**
+     * Record a stage that has just ended.
+     */
+    void record(int stage, long frame, int64_t start) { record(stage, frame, start, ticks()); }
+
+    /**
+     * Name the calling thread, for the timeline.
+     */
+    static void nameThread(const std::string &name);
+
+    /**
+     * Write the records in the ring, oldest first, to a file.  Records
+     * being written as the ring is copied are left out.
+     * @return false if the file could not be written
+     */
+    bool dump(const std::string &file) const;
+
+    /**
+     * Ask for a dump when SIGUSR1 arrives (on POSIX systems).  The signal
+     * handler only raises a flag; the frame loop does the writing, when
+     * takeDumpRequest() says so.
+     */
+    static void dumpOnSignal();
+
+    /**
+     * @return true once for each signal received since the last call
+     */
+    static bool takeDumpRequest();
+
+private:
+    FrameTrace();
+    FrameTrace(const FrameTrace &);
+    FrameTrace &operator=(const FrameTrace &);
+
+    struct Slot {
+        TraceRecord record;
+        std::atomic<uint64_t> sequence;     // 1 + the index of the record, once complete; 0 while written
+    };
+
+    std::vector<Slot> slots;                // a power of two of them
+    std::atomic<uint64_t> head;             // the index of the next record
+};
+
+/**
+ * Record the stage from construction to destruction, e.g. for a function:
+ * TraceScope scope(TRACE_DECODE, frame);
+ */
+class TraceScope {
+public:
+    TraceScope(int stage, long frame) : stage(stage), frame(frame), start(FrameTrace::ticks()) {}
+    ~TraceScope() { FrameTrace::instance().record(stage, frame, start); }
+
+private:
+    int stage;
+    long frame;
+    int64_t start;
+};
+
+/**
+ * Run the trace subcommand: convert a trace file to the Chrome trace
+ * event format (JSON), for Perfetto or chrome://tracing.
+ * @param argc the number of arguments after "trace"
+ * @param argv the arguments after "trace"
+ * @return the program exit code
+ */
+int traceCommand(int argc, char *argv[]);
+
+#endif // TRACE_H
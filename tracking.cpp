@@ -0,0 +1,142 @@
+/*
+ * Marker tracking for OpenCV with OpenGL
+ * See tracking.h for an overview.
+ */
+
+#include "tracking.h"
+#include <opencv2/imgproc/imgproc.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+using namespace cv;
+using namespace std;
+
+RoiScheduler::RoiScheduler(float margin, float growth, int maxMisses, int fullScanInterval)
+    : margin(margin), growth(growth), maxMisses(maxMisses), fullScanInterval(fullScanInterval) {
+    reset();
+}
+
+void RoiScheduler::reset() {
+    tracking = false;
+    center = Point2f(0, 0);
+    velocity = Point2f(0, 0);
+    size = Size2f(0, 0);
+    lastTime = 0.0;
+    misses = 0;
+    framesSinceFull = 0;
+    lastWasFull = true;
+}
+
+Rect RoiScheduler::next(Size frameSize, double t) {
+    Rect full(0, 0, frameSize.width, frameSize.height);
+    framesSinceFull++;
+    bool periodic = fullScanInterval > 0 && framesSinceFull >= fullScanInterval;
+    if (!tracking || misses >= maxMisses || periodic) {
+        framesSinceFull = 0;
+        lastWasFull = true;
+        return full;
+    }
+
+    // Extrapolate the last box, and pad it by the margin (which grows with
+    // each miss) plus the distance the markers could have moved.
+    float dt = (float) max(0.0, t - lastTime);
+    Point2f predicted = center + velocity * dt;
+    float border = margin * pow(growth, (float) misses);
+    float halfW = size.width * (0.5f + border) + fabs(velocity.x) * dt;
+    float halfH = size.height * (0.5f + border) + fabs(velocity.y) * dt;
+    Rect roi(Point((int) floor(predicted.x - halfW), (int) floor(predicted.y - halfH)),
+             Point((int) ceil(predicted.x + halfW), (int) ceil(predicted.y + halfH)));
+    roi &= full;
+
+    lastWasFull = roi.area() == 0 || roi == full;
+    if (roi.area() == 0) {
+        framesSinceFull = 0;
+        return full;
+    }
+    return roi;
+}
+
+void RoiScheduler::hit(const Rect2f &found, double t) {
+    Point2f c(found.x + found.width * 0.5f, found.y + found.height * 0.5f);
+    if (tracking && t > lastTime) {
+        // Blend the new velocity estimate with the old, to damp detector noise
+        Point2f v = (c - center) * (float) (1.0 / (t - lastTime));
+        velocity = velocity * 0.5f + v * 0.5f;
+    } else {
+        velocity = Point2f(0, 0);
+    }
+    center = c;
+    size = found.size();
+    lastTime = t;
+    misses = 0;
+    tracking = true;
+}
+
+void RoiScheduler::miss() {
+    if (lastWasFull) {
+        // Nothing anywhere in the frame; start over
+        tracking = false;
+        velocity = Point2f(0, 0);
+        misses = 0;
+    } else {
+        misses++;
+    }
+}
+
+// aruco in OpenCV 3.1 only takes the enum; the int overload came later
+MarkerTracker::MarkerTracker(int dictionary)
+    : dictionary(aruco::getPredefinedDictionary(aruco::PREDEFINED_DICTIONARY_NAME(dictionary))),
+      params(aruco::DetectorParameters::create()),
+      scale(1.0) {
+}
+
+const vector<Marker> &MarkerTracker::detect(const Mat &frame, double t) {
+    roi = scheduler.next(frame.size(), t);
+
+    // Search only the region of interest.  This is a view into the frame,
+    // not a copy, so small regions of large frames are cheap.
+    Mat view = frame(roi);
+    if (scale < 1.0) {
+        resize(view, small, Size(), scale, scale, INTER_AREA);
+        aruco::detectMarkers(small, dictionary, corners, ids, params);
+    } else {
+        aruco::detectMarkers(view, dictionary, corners, ids, params);
+    }
+
+    if (ids.empty()) {
+        found.clear();
+        scheduler.miss();
+        return found;
+    }
+
+    // Map the corners back into full-frame coordinates.  Resizing rounds
+    // the size, so the scale is taken per axis from the sizes themselves,
+    // and it applies to pixel centers, half a pixel in from the corners.
+    float rx = 1.0f, ry = 1.0f;
+    if (scale < 1.0) {
+        rx = view.cols / (float) small.cols;
+        ry = view.rows / (float) small.rows;
+    }
+    Point2f offset((float) roi.x, (float) roi.y);
+    // The markers are refilled in place, so their corner lists keep their
+    // memory from frame to frame
+    Point2f lo(FLT_MAX, FLT_MAX), hi(-FLT_MAX, -FLT_MAX);
+    found.resize(ids.size());
+    for (size_t i = 0; i < ids.size(); i++) {
+        Marker &m = found[i];
+        m.id = ids[i];
+        m.corners.resize(corners[i].size());
+        for (size_t j = 0; j < corners[i].size(); j++) {
+            const Point2f &c = corners[i][j];
+            Point2f p((c.x + 0.5f) * rx - 0.5f, (c.y + 0.5f) * ry - 0.5f);
+            p += offset;
+            m.corners[j] = p;
+            lo.x = min(lo.x, p.x);
+            lo.y = min(lo.y, p.y);
+            hi.x = max(hi.x, p.x);
+            hi.y = max(hi.y, p.y);
+        }
+    }
+    scheduler.hit(Rect2f(lo, hi), t);
+    return found;
+}
@@ -0,0 +1,147 @@
+/*
+ * Marker tracking for OpenCV with OpenGL
+ *
+ * Markers are detected with the OpenCV ArUco module.  Rather than scanning
+ * the whole frame every time, the tracker predicts where the markers will be
+ * in the next frame (using a constant-velocity model) and only searches a
+ * region of interest around that prediction.  The region grows each time a
+ * search fails, and falls back to the full frame after a few misses.
+ */
+
+#ifndef TRACKING_H
+#define TRACKING_H
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/aruco.hpp>
+#include <vector>
+
+/**
+ * A single marker found in a frame.  Corners are in full-frame pixel
+ * coordinates, in the order returned by ArUco (clockwise from top-left).
+ */
+struct Marker {
+    int id;
+    std::vector<cv::Point2f> corners;
+};
+
+/**
+ * Chooses the region of the next frame to search for markers.
+ * The prediction is a constant-velocity extrapolation of the bounding box
+ * of all markers found in the previous successful search.
+ */
+class RoiScheduler {
+public:
+    /**
+     * @param margin extra border around the predicted box, as a fraction of its size
+     * @param growth factor applied to the border after each failed search
+     * @param maxMisses number of failed searches before scanning the full frame
+     * @param fullScanInterval scan the full frame every this many frames, so new markers are found (0 = never)
+     */
+    RoiScheduler(float margin = 0.5f, float growth = 2.0f, int maxMisses = 3, int fullScanInterval = 30);
+
+    /**
+     * Compute the region to search in the next frame.
+     * @param frameSize the size of the frame that will be searched
+     * @param t the capture time of the frame, in seconds
+     * @return the region to search, clipped to the frame
+     */
+    cv::Rect next(cv::Size frameSize, double t);
+
+    /**
+     * Report a successful search.
+     * @param found the bounding box of all markers found, in full-frame coordinates
+     * @param t the capture time of the frame, in seconds
+     */
+    void hit(const cv::Rect2f &found, double t);
+
+    /**
+     * Report a failed search.  The next region will be larger.
+     */
+    void miss();
+
+    /**
+     * Forget the prediction, so the next search covers the full frame.
+     */
+    void reset();
+
+    /**
+     * @return true if the most recent region covered the full frame
+     */
+    bool fullFrame() const { return lastWasFull; }
+
+private:
+    float margin, growth;
+    int maxMisses, fullScanInterval;
+
+    bool tracking;          // true once a box has been found
+    cv::Point2f center;     // center of the last box found
+    cv::Point2f velocity;   // pixels per second
+    cv::Size2f size;        // size of the last box found
+    double lastTime;        // capture time of the last box found
+    int misses;             // consecutive failed searches
+    int framesSinceFull;    // frames since the full frame was scanned
+    bool lastWasFull;
+};
+
+/**
+ * Detects ArUco markers, restricting the search to the region chosen by a
+ * RoiScheduler.  The region is cropped without copying pixel data.
+ */
+class MarkerTracker {
+public:
+    /**
+     * @param dictionary the predefined ArUco dictionary to search for
+     */
+    explicit MarkerTracker(int dictionary = cv::aruco::DICT_4X4_50);
+
+    /**
+     * Find markers in a frame.
+     * @param frame the captured frame (BGR or grayscale)
+     * @param t the capture time of the frame, in seconds
+     * @return the markers found (also available through markers())
+     */
+    const std::vector<Marker> &detect(const cv::Mat &frame, double t);
+
+    /**
+     * Forget where the markers were, so the next frame is searched in
+     * full; for frames that do not follow on from each other.
+     */
+    void reset() { scheduler.reset(); }
+
+    /**
+     * @return the markers found by the most recent call to detect()
+     */
+    const std::vector<Marker> &markers() const { return found; }
+
+    /**
+     * @return the region searched by the most recent call to detect()
+     */
+    cv::Rect lastRoi() const { return roi; }
+
+    /**
+     * Search a downscaled copy of the region, for speed.  Corners are still
+     * reported in full-resolution coordinates.
+     * @param s the scale factor (1 = full resolution)
+     */
+    void setScale(double s) { scale = s > 0.0 && s < 1.0 ? s : 1.0; }
+
+    /**
+     * @return the ArUco dictionary used by this tracker
+     */
+    const cv::Ptr<cv::aruco::Dictionary> &getDictionary() const { return dictionary; }
+
+private:
+    cv::Ptr<cv::aruco::Dictionary> dictionary;
+    cv::Ptr<cv::aruco::DetectorParameters> params;
+    RoiScheduler scheduler;
+    cv::Rect roi;
+    double scale;
+    std::vector<Marker> found;
+
+    // Scratch storage, reused between frames
+    cv::Mat small;
+    std::vector<std::vector<cv::Point2f> > corners;
+    std::vector<int> ids;
+};
+
+#endif // TRACKING_H